@@ -1,23 +1,39 @@
 #pragma once
 #include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "batch.h"
+#include "alg_a.h"
 #include <atomic>
 #include <mutex>
 using namespace std;
 
+template <typename K = uint32_t, class Policy = marked_key_policy<K>, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
 class AlgorithmB {
 public:
-    static constexpr int TOMBSTONE = (int) 0x7FFFFFFF;
+    typedef K key_type;
+    static constexpr K TOMBSTONE = Policy::TOMBSTONE;
 
     char padding0[PADDING_BYTES];
     const int numThreads;
     int capacity;
     char padding2[PADDING_BYTES];
-    paddedData * data;
+    paddedData<K> * data;
 
     AlgorithmB(const int _numThreads, const int _capacity);
     ~AlgorithmB();
-    bool insertIfAbsent(const int tid, const int & key);
-    bool erase(const int tid, const int & key);
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    void bulkLoad(const K * keys, const size_t n, const int nthreads);
+    bool insertIfAbsentFrom(const int tid, const K & key, const uint32_t h);
+    bool eraseFrom(const int tid, const K & key, const uint32_t h);
+    bool containsFrom(const int tid, const K & key, const uint32_t h);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
     long getSumOfKeys();
     void printDebuggingDetails(); 
 };
@@ -28,21 +44,28 @@ public:
  * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
-AlgorithmB::AlgorithmB(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), capacity(_capacity) {
-    data = new paddedData[capacity]();
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmB<K, Policy, Hash, Range, Alloc>::AlgorithmB(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(Range::roundCapacity(_capacity)) {
+    data = Alloc::template allocate<paddedData<K>>(capacity, omp_get_max_threads());
 }
 
 // destructor: clean up any allocated memory, etc.
-AlgorithmB::~AlgorithmB() {
-    delete data;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmB<K, Policy, Hash, Range, Alloc>::~AlgorithmB() {
+    Alloc::deallocate(data, capacity);
 } 
 
 // semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
-bool AlgorithmB::insertIfAbsent(const int tid, const int & key) {
-    uint32_t h = murmur3(key); // Generate hash that is indexed to our array.
-    for (uint32_t i = 0; i < capacity; i++) {
-        uint32_t index = (h + i) % capacity;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key) {
+    return insertIfAbsentFrom(tid, key, Hash::hash(key));
+}
+
+// same as insertIfAbsent, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::insertIfAbsentFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
         if (data[index].d == key) {
             return false; // No need to lock as there is no risk of overwriting
         }
@@ -66,11 +89,15 @@ bool AlgorithmB::insertIfAbsent(const int tid, const int & key) {
 }
 
 // semantics: try to erase key. return true if successful, and false otherwise
-bool AlgorithmB::erase(const int tid, const int & key) {
-    // return false;
-    uint32_t h = murmur3(key); // Generate hash that is indexed to our array.
-    for (uint32_t i = 0; i < capacity; i++) {
-        uint32_t index = (h + i) % capacity;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    return eraseFrom(tid, key, Hash::hash(key));
+}
+
+// same as erase, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::eraseFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
         
         if(data[index].d == key) {
             // Locking to ensure no overwrites occur.
@@ -95,23 +122,87 @@ bool AlgorithmB::erase(const int tid, const int & key) {
     return false; // Return false if there was no space, and the key wasn't found.
 }
 
-// semantics: return the sum of all KEYS in the set
-int64_t AlgorithmB::getSumOfKeys() {
-	int64_t sum = 0;
-	for (int i = 0; i < capacity; i++) {
-        data[i].m.lock();
-        if(data[i].d == TOMBSTONE){
+// semantics: return true if key is in the set, and false otherwise
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    return containsFrom(tid, key, Hash::hash(key));
+}
+
+// same as contains, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmB<K, Policy, Hash, Range, Alloc>::containsFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
+        K value = data[index].d;
+        if (value == key) {
+            return true; // No need to lock as we are not writing
         }
-        else {
-		    sum += data[i].d;
+        if (value == 0) { // Empty
+            return false;
         }
-        data[i].m.unlock();
     }
-	return sum;
+    return false; // The key wasn't found anywhere in the table.
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1], with results[i] = insertIfAbsent(tid, keys[i])
+// (keys are hashed and their slots prefetched a group at a time, see batch.h)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 1); },
+            [&](const K & key, uint32_t h) { return insertIfAbsentFrom(tid, key, h); });
+}
+
+// semantics: erase every key in keys[0..n-1], with results[i] = erase(tid, keys[i])
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 1); },
+            [&](const K & key, uint32_t h) { return eraseFrom(tid, key, h); });
+}
+
+// semantics: results[i] = contains(tid, keys[i]) for every key in keys[0..n-1]
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 0); },
+            [&](const K & key, uint32_t h) { return containsFrom(tid, key, h); });
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1] using nthreads threads (see bulk_load.h).
+// The table keeps the capacity it was constructed with, and no other operation may run during the load.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::bulkLoad(const K * keys, const size_t n, const int nthreads) {
+    bulkLoadLinearProbing(keys, n, nthreads, capacity,
+            [&](const K & key) { return Range::reduce(Hash::hash(key), capacity); },
+            [&](uint32_t i) -> atomic<K> & { return data[i].d; },
+            [&](const int tid, const K & key) { return insertIfAbsent(tid, key); });
+}
+
+// semantics: call fn(tid, key) for every key in the set, splitting the slots across nthreads OpenMP threads
+// (tid is the OpenMP thread number). Weakly consistent with concurrent updates, see scan.h.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    scanSlots<K>(capacity, nthreads, TOMBSTONE, (K) ~(K) 0,
+            [&](uint64_t i) -> atomic<K> & { return data[i].d; }, fn);
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmB<K, Policy, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int64_t AlgorithmB<K, Policy, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
 }
 
 // print any debugging details you want at the end of a trial in this function
-void AlgorithmB::printDebuggingDetails() {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmB<K, Policy, Hash, Range, Alloc>::printDebuggingDetails() {
     // int printAmount;
     // if (capacity < 500)
     //     printAmount = capacity;
@@ -1,31 +1,61 @@
 #pragma once
 #include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "batch.h"
+#include "bulk_load.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "table_stats.h"
 #include <atomic>
 using namespace std;
 
+template <typename K>
 struct paddedDataNoLock {
     char padding2[PADDING_BYTES];
-    atomic<uint32_t> d;
+    atomic<K> d;
     char padding3[PADDING_BYTES];
 };
 
+template <typename K = uint32_t, class Policy = plain_key_policy<K>, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
 class AlgorithmC {
 public:
-    static constexpr int TOMBSTONE = -1;
+    typedef K key_type;
+    static constexpr K TOMBSTONE = Policy::TOMBSTONE;
 
     char padding0[PADDING_BYTES];
     const int numThreads;
     int capacity;
     char padding2[PADDING_BYTES];
     
-    paddedDataNoLock * data;
+    paddedDataNoLock<K> * data;
+    TABLE_STAT(tableStats stats;)
+    void * mapping;             // the snapshot file data lives in, if the table was opened from one (else NULL)
+    size_t mappingBytes;
 
     AlgorithmC(const int _numThreads, const int _capacity);
     ~AlgorithmC();
-    bool insertIfAbsent(const int tid, const int & key);
-    bool erase(const int tid, const int & key);
+    bool snapshot(const char * path);
+    static AlgorithmC * open(const char * path, const int numThreads);
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    void bulkLoad(const K * keys, const size_t n, const int nthreads);
+    bool insertIfAbsentFrom(const int tid, const K & key, const uint32_t h);
+    bool eraseFrom(const int tid, const K & key, const uint32_t h);
+    bool containsFrom(const int tid, const K & key, const uint32_t h);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
     long getSumOfKeys();
     void printDebuggingDetails(); 
+
+private:
+    AlgorithmC(const int _numThreads, const int _capacity, void * _mapping, const size_t _mappingBytes);
+    static snapshot_header describe(const uint64_t capacity);
 };
 
 /**
@@ -34,74 +64,214 @@ public:
  * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
-AlgorithmC::AlgorithmC(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), capacity(_capacity) {
-    data = new paddedDataNoLock[capacity];
-    for (int i = 0; i < _capacity; i++)
-        data[i].d = 0; // Initalize the data structure.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmC<K, Policy, Hash, Range, Alloc>::AlgorithmC(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(Range::roundCapacity(_capacity)), mapping(NULL), mappingBytes(0) {
+    data = Alloc::template allocate<paddedDataNoLock<K>>(capacity, omp_get_max_threads()); // Initalize the data structure.
+}
+
+// constructor for open(): the slots are the ones in the (private) mapping of a snapshot file
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmC<K, Policy, Hash, Range, Alloc>::AlgorithmC(const int _numThreads, const int _capacity, void * _mapping, const size_t _mappingBytes)
+: numThreads(_numThreads), capacity(_capacity), mapping(_mapping), mappingBytes(_mappingBytes) {
+    data = (paddedDataNoLock<K> *) ((char *) mapping + SNAPSHOT_HEADER_BYTES);
 }
 
 // destructor: clean up any allocated memory, etc.
-AlgorithmC::~AlgorithmC() {
-    delete data;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmC<K, Policy, Hash, Range, Alloc>::~AlgorithmC() {
+    if (mapping) munmap(mapping, mappingBytes);
+    else Alloc::deallocate(data, capacity);
+}
+
+// the snapshot header for a table of this type with the given capacity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+snapshot_header AlgorithmC<K, Policy, Hash, Range, Alloc>::describe(const uint64_t capacity) {
+    snapshot_header header;
+    header.setNames("AlgorithmC", Hash::name(), Range::name());
+    header.keyBytes = sizeof(K);
+    header.slotBytes = sizeof(paddedDataNoLock<K>);
+    header.capacity = capacity;
+    header.empty = Policy::EMPTY;
+    header.tombstone = Policy::TOMBSTONE;
+    return header;
+}
+
+// semantics: write the table to path (see snapshot.h); return true if successful.
+// Concurrent updates may or may not be captured (as for forEachKey).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::snapshot(const char * path) {
+    return writeSnapshot<paddedDataNoLock<K>>(path, describe(capacity), capacity,
+            [&](paddedDataNoLock<K> * buffer, const size_t begin, const size_t n) {
+                memset((void *) buffer, 0, n * sizeof(paddedDataNoLock<K>));
+                for (size_t i = 0; i < n; ++i) {
+                    buffer[i].d.store(data[begin + i].d.load(memory_order_relaxed), memory_order_relaxed);
+                }
+            });
+}
+
+// semantics: return a table that serves operations straight from a private mapping of the snapshot at path
+// (pages are read in as they are first probed, and updates never reach the file), or NULL if path cannot be
+// mapped or was written by a table with a different layout, hash or sentinels.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmC<K, Policy, Hash, Range, Alloc> * AlgorithmC<K, Policy, Hash, Range, Alloc>::open(const char * path, const int numThreads) {
+    snapshot_header header;
+    size_t mappedBytes;
+    void * base = mapSnapshot(path, &header, &mappedBytes);
+    if (!base) return NULL;
+    if (!header.matches(describe(header.capacity), path)) {
+        munmap(base, mappedBytes);
+        return NULL;
+    }
+    return new AlgorithmC(numThreads, header.capacity, base, mappedBytes);
 }
 
 // semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
-bool AlgorithmC::insertIfAbsent(const int tid, const int & key) {
-    uint32_t h = murmur3(key); // Generate hash that is indexed to our array.
-    for (uint32_t i = 0; i < capacity; i++) {
-        uint32_t index = (h + i) % capacity;
-        uint32_t value = data[index].d;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key) {
+    return insertIfAbsentFrom(tid, key, Hash::hash(key));
+}
+
+// same as insertIfAbsent, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::insertIfAbsentFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
+        K value = data[index].d;
         
         if(value == key) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
             return false; // No need to lock as there is no risk of overwriting
         }
 
         if(value == 0) { // Empty
             if(data[index].d.compare_exchange_strong(value, key)){
+                TABLE_STAT(stats.addProbe(tid, i + 1);)
                 return true;
             }
-            else if (data[index].d == key) {
+            TABLE_STAT(stats.casFailures.inc(tid);)
+            if (data[index].d == key) {
+                TABLE_STAT(stats.addProbe(tid, i + 1);)
                 return false;
             }
         }
     }
+    TABLE_STAT(stats.addProbe(tid, capacity);)
     return false; // Return false if there was no space, and the key wasn't found.
 }
 
 // semantics: try to erase key. return true if successful, and false otherwise
-bool AlgorithmC::erase(const int tid, const int & key) {
-    uint32_t h = (murmur3(key)/0xFFFFFFFF); // Generate hash that is indexed to our array.
-    for (uint32_t i = 0; i < capacity; i++) {
-        uint32_t index = (h + i) % capacity;
-        uint32_t value = data[index].d;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    return eraseFrom(tid, key, Hash::hash(key));
+}
+
+// same as erase, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::eraseFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
+        K value = data[index].d;
         
         if(data[index].d == 0) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
             return false;
         }
         else if(data[index].d == key) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
             // This is returning if the CAS was successful or not.
-            return data[index].d.compare_exchange_strong(value, TOMBSTONE);
+            bool erased = data[index].d.compare_exchange_strong(value, TOMBSTONE);
+            TABLE_STAT(if (!erased) stats.casFailures.inc(tid);)
+            return erased;
         }
     }
+    TABLE_STAT(stats.addProbe(tid, capacity);)
     return false; // Return false if there was no space, and the key wasn't found.
 }
 
-// semantics: return the sum of all KEYS in the set
-int64_t AlgorithmC::getSumOfKeys() {
-    int64_t sum = 0;
-	for (int i = 0; i < capacity; i++) {
-        if(data[i].d == TOMBSTONE){
+// semantics: return true if key is in the set, and false otherwise
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    return containsFrom(tid, key, Hash::hash(key));
+}
+
+// same as contains, but probing from the precomputed hash h
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmC<K, Policy, Hash, Range, Alloc>::containsFrom(const int tid, const K & key, const uint32_t h) {
+    for (uint32_t i = 0, index = Range::reduce(h, capacity); i < capacity; i++, index = probeNext(index, capacity)) {
+        K value = data[index].d;
+        
+        if(value == key) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return true;
         }
-        else {
-		    sum += data[i].d;
+        else if(value == 0) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
         }
     }
-	return sum;
+    TABLE_STAT(stats.addProbe(tid, capacity);)
+    return false; // The key wasn't found anywhere in the table.
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1], with results[i] = insertIfAbsent(tid, keys[i])
+// (keys are hashed and their slots prefetched a group at a time, see batch.h)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 1); },
+            [&](const K & key, uint32_t h) { return insertIfAbsentFrom(tid, key, h); });
+}
+
+// semantics: erase every key in keys[0..n-1], with results[i] = erase(tid, keys[i])
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 1); },
+            [&](const K & key, uint32_t h) { return eraseFrom(tid, key, h); });
+}
+
+// semantics: results[i] = contains(tid, keys[i]) for every key in keys[0..n-1]
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&data[Range::reduce(h, capacity)].d, 0); },
+            [&](const K & key, uint32_t h) { return containsFrom(tid, key, h); });
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1] using nthreads threads (see bulk_load.h).
+// The table keeps the capacity it was constructed with, and no other operation may run during the load.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::bulkLoad(const K * keys, const size_t n, const int nthreads) {
+    bulkLoadLinearProbing(keys, n, nthreads, capacity,
+            [&](const K & key) { return Range::reduce(Hash::hash(key), capacity); },
+            [&](uint32_t i) -> atomic<K> & { return data[i].d; },
+            [&](const int tid, const K & key) { return insertIfAbsent(tid, key); });
+}
+
+// semantics: call fn(tid, key) for every key in the set, splitting the slots across nthreads OpenMP threads
+// (tid is the OpenMP thread number). Weakly consistent with concurrent updates, see scan.h.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    scanSlots<K>(capacity, nthreads, TOMBSTONE, (K) ~(K) 0,
+            [&](uint64_t i) -> atomic<K> & { return data[i].d; }, fn);
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmC<K, Policy, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int64_t AlgorithmC<K, Policy, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
 }
 
 // print any debugging details you want at the end of a trial in this function
-void AlgorithmC::printDebuggingDetails() {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmC<K, Policy, Hash, Range, Alloc>::printDebuggingDetails() {
     // int printAmount;
     // if (capacity < 500)
     //     printAmount = capacity;
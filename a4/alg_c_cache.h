@@ -0,0 +1,289 @@
+#pragma once
+#include "util.h"
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Fixed-capacity concurrent cache from 62-bit keys to 64-bit values, with CLOCK eviction.
+ *
+ * Like AlgorithmC, a linear-probing table updated with CAS, but a key may only live in the PROBE_WINDOW slots
+ * starting at its home slot, and evicting an entry makes its slot EMPTY again (so a full cache does not fill up
+ * with tombstones, and put() never fails: it evicts instead).
+ *
+ * Each slot holds {key, value} in 16 bytes, changed with cmpxchg16b (build with -mcx16), as in AlgorithmDMap.
+ * The key word also holds two flags:
+ *   - REF_MASK is CLOCK's reference bit: a get() hit sets it, and the hand clears it (second chance) or, if it
+ *     is already clear, evicts the entry. Setting or clearing it is an 8-byte CAS on the key word, so the eviction
+ *     CAS (which expects the key word without REF_MASK) fails if the entry was used after the hand looked at it.
+ *   - PENDING_MASK marks a slot claimed by a put() that has not decided yet whether its key is a duplicate.
+ *     Only that put() ever changes a PENDING slot.
+ *
+ * put() of a key that is not present claims a slot (EMPTY, or a victim chosen by CLOCK within the window) as
+ * PENDING, then rescans the window for other copies of the key: it gives up its slot if there is a committed
+ * copy or a PENDING copy earlier in the window, and waits for any PENDING copy later in the window to commit or
+ * give up. So at most one copy of a key is ever committed, and get() only looks at committed copies.
+ *
+ * Eviction is mostly done by a shared CLOCK hand: once the cache holds more than TARGET_LOAD_PERCENT of its
+ * capacity, every put() that adds a key also advances the hand by SWEEP_BUDGET slots. The budget is per put(), not
+ * per thread: the hand moves SWEEP_BUDGET slots for each key added, however many threads are adding them, and each
+ * inserting thread sweeps in proportion to the keys it adds. A put() whose window is full anyway runs CLOCK over
+ * its own window.
+ */
+class AlgorithmCCache {
+private:
+    static const uint64_t PENDING_MASK = 0x8000000000000000ULL;
+    static const uint64_t REF_MASK = 0x4000000000000000ULL;
+    static const uint64_t KEY_MASK = ~(PENDING_MASK | REF_MASK);
+    static const uint64_t EMPTY = 0;
+    // with these definitions, the largest "real" key we allow in the cache is 0x3FFFFFFFFFFFFFFF, and the smallest is 1 !!
+
+    static const int PROBE_WINDOW = 8;          // two or three cache lines
+    static const int TARGET_LOAD_PERCENT = 75;
+    static const int SWEEP_BUDGET = 32;         // slots the hand advances for each put() over the target load
+
+    struct slot {
+        volatile uint64_t key;
+        volatile uint64_t value;
+    } __attribute__((aligned(16)));
+
+    static bool cas16(slot * s, uint64_t expKey, uint64_t expValue, uint64_t newKey, uint64_t newValue);
+    static bool cas8(slot * s, uint64_t expKey, uint64_t newKey);
+    static void readSlot(slot * s, uint64_t & key, uint64_t & value);
+
+    uint32_t homeOf(const uint64_t key);
+    uint32_t slotAt(const uint32_t home, const int offset);
+    int findVictim(const uint32_t home);
+    bool isDuplicate(const uint64_t key, const uint32_t home, const int myOffset);
+    void sweep(const int tid);
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    const uint32_t capacity;
+    slot * data;
+    char padding1[PADDING_BYTES];
+    atomic<uint64_t> hand;                      // free-running: the next slot to sweep is hand % capacity
+    char padding2[PADDING_BYTES];
+    counter inserted;                           // keys added (the cache holds inserted - evicted)
+    counter evicted;
+    debugCounter hits;
+    debugCounter misses;
+    debugCounter sweeps;
+
+public:
+    AlgorithmCCache(const int _numThreads, const int _capacity);
+    ~AlgorithmCCache();
+    bool put(const int tid, const uint64_t key, const uint64_t value);
+    bool get(const int tid, const uint64_t key, uint64_t * value);
+    template <class Fn> void forEachEntry(Fn fn);
+    uint32_t getCapacity();
+    int64_t getSize();
+    long long getHits();
+    long long getMisses();
+    int64_t getEvictions();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the cache's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the cache (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the number of slots (the cache holds about TARGET_LOAD_PERCENT of this many entries)
+ */
+AlgorithmCCache::AlgorithmCCache(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(max(_capacity, PROBE_WINDOW)), hand(0), inserted(_numThreads), evicted(_numThreads) {
+    data = new slot[capacity]();
+}
+
+// destructor: clean up any allocated memory, etc.
+AlgorithmCCache::~AlgorithmCCache() {
+    delete[] data;
+}
+
+bool AlgorithmCCache::cas16(slot * s, uint64_t expKey, uint64_t expValue, uint64_t newKey, uint64_t newValue) {
+    // key is the low word on x86
+    unsigned __int128 expected = ((unsigned __int128) expValue << 64) | expKey;
+    unsigned __int128 desired = ((unsigned __int128) newValue << 64) | newKey;
+    return __sync_bool_compare_and_swap((unsigned __int128 *) s, expected, desired);
+}
+
+// CAS on the key word alone (only to set or clear REF_MASK; x86 orders it with the 16-byte CAS on the same slot)
+bool AlgorithmCCache::cas8(slot * s, uint64_t expKey, uint64_t newKey) {
+    return __sync_bool_compare_and_swap(&s->key, expKey, newKey);
+}
+
+// Snapshot of a slot without writing to it: retry until the key (ignoring REF_MASK) reads the same before and
+// after the value. Eviction leaves the value in place, so even if the slot was evicted and refilled with the same
+// key in between, the value we read was that key's value at some point while we read.
+void AlgorithmCCache::readSlot(slot * s, uint64_t & key, uint64_t & value) {
+    while (true) {
+        key = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+        value = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+        if ((__atomic_load_n(&s->key, __ATOMIC_ACQUIRE) & ~REF_MASK) == (key & ~REF_MASK)) return;
+    }
+}
+
+// multiply-shift the top 32 hash bits into [0, capacity)
+uint32_t AlgorithmCCache::homeOf(const uint64_t key) {
+    return (uint32_t) (((murmur3fmix64(key) >> 32) * capacity) >> 32);
+}
+
+uint32_t AlgorithmCCache::slotAt(const uint32_t home, const int offset) {
+    uint32_t index = home + offset;
+    return (index >= capacity) ? index - capacity : index;
+}
+
+// CLOCK over home's window: the offset of an EMPTY slot, or of the first committed entry whose reference bit is
+// clear (clearing set bits on the way, for up to two passes). -1 if every slot stayed PENDING or referenced.
+int AlgorithmCCache::findVictim(const uint32_t home) {
+    for (int i = 0; i < 2 * PROBE_WINDOW; ++i) {
+        const int offset = i % PROBE_WINDOW;
+        slot * s = &data[slotAt(home, offset)];
+        uint64_t k = s->key;
+        if (k == EMPTY) return offset;
+        if (k & PENDING_MASK) continue;
+        if (!(k & REF_MASK)) return offset;
+        cas8(s, k, k & ~REF_MASK);
+    }
+    return -1;
+}
+
+// having claimed the slot at myOffset as PENDING, must this put() give it up? (see the class comment)
+bool AlgorithmCCache::isDuplicate(const uint64_t key, const uint32_t home, const int myOffset) {
+    for (int offset = 0; offset < PROBE_WINDOW; ++offset) {
+        if (offset == myOffset) continue;
+        slot * s = &data[slotAt(home, offset)];
+        uint64_t k = s->key;
+        if ((k & KEY_MASK) != key) continue;
+        if (!(k & PENDING_MASK) || offset < myOffset) return true;
+        // a later PENDING copy may have missed ours: wait for it to commit (then we lose) or give up
+        while (s->key == k) {}
+        if ((s->key & KEY_MASK) == key) return true;
+    }
+    return false;
+}
+
+// advance the shared CLOCK hand by SWEEP_BUDGET slots (called once per put() that adds a key over the target load):
+// clear set reference bits, and evict the other entries
+void AlgorithmCCache::sweep(const int tid) {
+    const uint64_t start = hand.fetch_add(SWEEP_BUDGET);
+    for (uint64_t i = start; i < start + SWEEP_BUDGET; ++i) {
+        slot * s = &data[i % capacity];
+        uint64_t k, v;
+        readSlot(s, k, v);
+        if (k == EMPTY || (k & PENDING_MASK)) continue;
+        if (k & REF_MASK) {
+            cas8(s, k, k & ~REF_MASK);
+        } else if (cas16(s, k, v, EMPTY, v)) {
+            evicted.inc(tid);
+        }
+    }
+    sweeps.inc(tid);
+}
+
+// semantics: set key's value, inserting key (and evicting another entry if needed) if it is absent.
+// return true if key was inserted, and false if it was already present (in which case its value is overwritten)
+bool AlgorithmCCache::put(const int tid, const uint64_t key, const uint64_t value) {
+    assert(key != EMPTY && key <= KEY_MASK);
+
+    const uint32_t home = homeOf(key);
+    while (true) {
+        // overwrite a committed copy, or wait out a PENDING one
+        bool pending = false;
+        bool retry = false;
+        for (int offset = 0; offset < PROBE_WINDOW; ++offset) {
+            slot * s = &data[slotAt(home, offset)];
+            uint64_t k, v;
+            readSlot(s, k, v);
+            if ((k & KEY_MASK) != key) continue;
+            if (k & PENDING_MASK) {
+                pending = true;
+            } else if (cas16(s, k, v, k | REF_MASK, value)) {
+                return false;
+            } else {
+                retry = true;   // the value or reference bit changed, or the entry was evicted: look again
+            }
+            break;
+        }
+        if (pending || retry) continue;
+
+        // claim an EMPTY slot or a victim
+        const int offset = findVictim(home);
+        if (offset < 0) continue;
+        slot * s = &data[slotAt(home, offset)];
+        uint64_t k, v;
+        readSlot(s, k, v);
+        if ((k & (PENDING_MASK | REF_MASK)) || !cas16(s, k, v, key | PENDING_MASK, value)) continue;
+        if (k != EMPTY) evicted.inc(tid);
+
+        if (isDuplicate(key, home, offset)) {
+            __atomic_store_n(&s->key, EMPTY, __ATOMIC_RELEASE);
+            continue;   // the other copy wins: overwrite it on the next pass
+        }
+        __atomic_store_n(&s->key, key, __ATOMIC_RELEASE);
+        inserted.inc(tid);
+        if (inserted.get() - evicted.get() > (int64_t) capacity * TARGET_LOAD_PERCENT / 100) {
+            sweep(tid);
+        }
+        return true;
+    }
+}
+
+// semantics: return true and set *value if key is present (and mark it referenced), and false otherwise
+bool AlgorithmCCache::get(const int tid, const uint64_t key, uint64_t * value) {
+    const uint32_t home = homeOf(key);
+    for (int offset = 0; offset < PROBE_WINDOW; ++offset) {
+        slot * s = &data[slotAt(home, offset)];
+        if ((s->key & ~REF_MASK) != key) continue;
+        uint64_t k, v;
+        readSlot(s, k, v);
+        if ((k & ~REF_MASK) != key) continue;   // evicted (or claimed by another key) under us
+        if (!(k & REF_MASK)) cas8(s, k, k | REF_MASK);
+        *value = v;
+        hits.inc(tid);
+        return true;
+    }
+    misses.inc(tid);
+    return false;
+}
+
+// semantics: call fn(key, value) for every committed entry (weakly consistent with concurrent updates)
+template <class Fn>
+void AlgorithmCCache::forEachEntry(Fn fn) {
+    for (uint32_t i = 0; i < capacity; ++i) {
+        uint64_t k, v;
+        readSlot(&data[i], k, v);
+        if (k != EMPTY && !(k & PENDING_MASK)) fn(k & KEY_MASK, v);
+    }
+}
+
+uint32_t AlgorithmCCache::getCapacity() {
+    return capacity;
+}
+
+// number of entries, from the insert and eviction counts
+int64_t AlgorithmCCache::getSize() {
+    return inserted.getAccurate() - evicted.getAccurate();
+}
+
+long long AlgorithmCCache::getHits() {
+    return hits.getTotal();
+}
+
+long long AlgorithmCCache::getMisses() {
+    return misses.getTotal();
+}
+
+int64_t AlgorithmCCache::getEvictions() {
+    return evicted.getAccurate();
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmCCache::printDebuggingDetails() {
+    cout<<"capacity              : "<<capacity<<endl;
+    cout<<"entries               : "<<getSize()<<endl;
+    cout<<"evictions             : "<<getEvictions()<<endl;
+    cout<<"hand sweeps           : "<<sweeps.getTotal()<<" ("<<(sweeps.getTotal() * SWEEP_BUDGET / max(1U, capacity))<<" revolutions)"<<endl;
+}
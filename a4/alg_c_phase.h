@@ -0,0 +1,226 @@
+#pragma once
+#include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "scan.h"
+#include <atomic>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Phase-concurrent deterministic hash set (Shun and Blelloch, "Phase-concurrent hash tables for determinism").
+ *
+ * Like AlgorithmC, a fixed-capacity linear-probing table updated with CAS, but with dense slots and no tombstones.
+ * It is only correct when operations run in PHASES: within a phase, every thread performs the same operation type
+ * (all inserts, all erases, or all lookups), and phases are separated by a barrier (e.g., joining the threads).
+ *
+ * Keys are their own priorities (a larger key has priority over a smaller one, and EMPTY = 0 is the lowest).
+ * Invariant: every slot between a key's home slot and the slot holding it holds a larger key. So:
+ *   - insert walks its probe sequence and swaps itself in ahead of the first smaller key, then carries on
+ *     inserting the key it displaced, until it fills an EMPTY slot,
+ *   - erase replaces the key with the first later key in the cluster that may move back to its slot (the largest
+ *     such key), then erases that key's old copy the same way, until it moves an EMPTY slot in
+ *     (this follows the phase-concurrent table in PBBS, which walks back to the copy it removes),
+ *   - contains stops at the first smaller key, so a miss is usually as short as a hit.
+ * The contents of every slot after a phase therefore depend only on the SET of keys, not on how the operations of
+ * the phase interleaved (or how many threads ran them).
+ *
+ * Inside a phase, two operations on the same key can both return true (e.g., an insert that meets a copy of the
+ * key while another insert is moving it one slot along). The set itself is always exact once the phase ends.
+ * The table must never fill up: it has no room to carry a displaced key.
+ */
+template <typename K = uint32_t, class Policy = plain_key_policy<K>, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
+class AlgorithmCPhase {
+public:
+    typedef K key_type;
+    static constexpr K EMPTY = Policy::EMPTY;
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    uint32_t capacity;
+    char padding2[PADDING_BYTES];
+
+    atomic<K> * data;
+
+    AlgorithmCPhase(const int _numThreads, const int _capacity);
+    ~AlgorithmCPhase();
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
+    int64_t getSumOfKeys();
+    uint64_t getLayoutHash();
+    uint32_t getCapacity();
+    void printDebuggingDetails();
+
+private:
+    uint32_t homeOf(const K & key);
+    uint32_t findSlot(const K & key, uint32_t index);
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the size of the hash table (it must always have more slots than keys)
+ */
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::AlgorithmCPhase(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(Range::roundCapacity(_capacity)) {
+    data = Alloc::template allocate<atomic<K>>(capacity, omp_get_max_threads());
+}
+
+// destructor: clean up any allocated memory, etc.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::~AlgorithmCPhase() {
+    Alloc::deallocate(data, capacity);
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::homeOf(const K & key) {
+    return Range::reduce(Hash::hash(key), capacity);
+}
+
+// the slot holding key, or (if key is not in the table) the slot where it would go: walk from index past larger keys
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::findSlot(const K & key, uint32_t index) {
+    for (uint32_t i = 0; i < capacity && data[index] > key; ++i) {
+        index = probeNext(index, capacity);
+    }
+    return index;
+}
+
+// semantics: insert key (insert phase only). return true if this call added key (see the class comment)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key) {
+    assert(key != EMPTY);
+    bool added = false;
+    K v = key;      // the key we are placing: key itself, then whatever it (or a later key) displaced
+    uint32_t index = homeOf(key);
+    for (uint32_t i = 0; i < capacity; ) {
+        K c = data[index];
+        if (c == v) return added;           // already here (or another insert is carrying it along)
+        if (c < v) {                        // v outranks c (and every key outranks EMPTY)
+            if (!data[index].compare_exchange_strong(c, v)) continue; // the slot changed: look at it again
+            if (v == key) added = true;
+            if (c == EMPTY) return added;
+            v = c;                          // c's home is at or before index, so it goes somewhere after index
+        }
+        index = probeNext(index, capacity);
+        ++i;
+    }
+    return added; // Only reached if the table is full.
+}
+
+// can key, whose home slot is home, move back from slot index to the slot distance slots before it?
+// (yes unless home lies strictly after that slot, i.e., in the distance slots up to and including index)
+static inline bool canMoveBack(const uint32_t home, const uint32_t index, const uint32_t distance, const uint32_t capacity) {
+    uint32_t target = (index >= distance) ? index - distance : index + capacity - distance;
+    uint32_t homeDistance = (home >= target) ? home - target : home + capacity - target;
+    return homeDistance == 0 || homeDistance > distance;
+}
+
+// semantics: erase key (erase phase only). return true if this call removed key (see the class comment)
+// During an erase phase a slot only ever changes to a smaller key (or EMPTY), as keys move back toward their homes.
+// So if v is in the table, a copy of it is at or before any slot we have seen it in, and the copy to remove is found
+// by walking back from there (toward v's home).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    assert(key != EMPTY);
+    bool removed = false;
+    K v = key;                      // the key to remove: key itself, then each key moved back (to remove its old copy)
+    uint32_t home = homeOf(v);
+    uint32_t index = findSlot(v, home);
+    K c = data[index];
+    while (true) {
+        if (c != v) {
+            if (index == home) return removed;  // no copy left (a concurrent erase removed it)
+            index = probePrev(index, capacity);
+            c = data[index];
+            continue;
+        }
+
+        // The replacement is the first later key in the cluster that may move back to index (or the EMPTY slot that
+        // ends the cluster): it is the largest key that may (any later one had to probe past it).
+        uint32_t j = probeNext(index, capacity);
+        uint32_t distance = 1;      // from index to j
+        K w = data[j];
+        while (w != EMPTY && !canMoveBack(homeOf(w), j, distance, capacity) && distance < capacity) {
+            j = probeNext(j, capacity);
+            ++distance;
+            w = data[j];
+        }
+        // A concurrent erase may have moved a key that may move back (or an EMPTY slot) in behind us: take the first.
+        uint32_t b = probePrev(j, capacity);
+        for (uint32_t d = distance - 1; d > 0; --d, b = probePrev(b, capacity)) {
+            K y = data[b];
+            if (y == EMPTY || canMoveBack(homeOf(y), b, d, capacity)) {
+                w = y;
+                j = b;
+            }
+        }
+
+        if (data[index].compare_exchange_strong(c, w)) {
+            if (v == key) removed = true;
+            if (w == EMPTY) return removed;
+            // w now has two copies, and we remove one (whichever is found first walking back from j);
+            // if a concurrent erase removes either copy, we remove the other
+            v = w;
+            home = homeOf(v);
+            index = j;
+        }
+        c = data[index];
+    }
+}
+
+// semantics: return true if key is in the set, and false otherwise (lookup phase only)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    return data[findSlot(key, homeOf(key))] == key;
+}
+
+// semantics: call fn(tid, key) for every key in the set, splitting the slots across nthreads OpenMP threads
+// (tid is the OpenMP thread number). Only between phases.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    // there are no tombstones, so EMPTY doubles as the value to skip
+    scanDense<K>(data, capacity, nthreads, EMPTY, (K) ~(K) 0, fn);
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int64_t AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
+}
+
+// semantics: a hash of every (slot, key) pair, which (between phases) depends only on the set of keys
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint64_t AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::getLayoutHash() {
+    uint64_t result = 0;
+    #pragma omp parallel for reduction(+:result)
+    for (uint64_t i = 0; i < capacity; ++i) {
+        K key = data[i].load(memory_order_relaxed);
+        if (key != EMPTY) result += murmur3fmix64(((uint64_t) i << 32) ^ (uint64_t) key ^ ((uint64_t) key >> 32 << 40));
+    }
+    return result;
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::getCapacity() {
+    return capacity;
+}
+
+// print any debugging details you want at the end of a trial in this function
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmCPhase<K, Policy, Hash, Range, Alloc>::printDebuggingDetails() {
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "util.h"
+#include "hash_policy.h"
+#include "key_arena.h"
+#include "table_stats.h"
+#include <atomic>
+#include <iostream>
+#include <stdint.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Fixed-capacity concurrent map from variable-length byte-string keys to 64-bit values, in the style of
+ * AlgorithmC (linear probing, CAS on EMPTY to insert, TOMBSTONE to erase; a value is set when its key is inserted).
+ *
+ * Key bytes (and values) live in a keyArena. Each slot is one 64-bit word: the top 16 bits are a fingerprint of
+ * the key (the low 16 bits of its 64-bit hash; the home slot comes from the top 32), and the low 48 bits are the
+ * offset of the key's record in the arena. A probe only reads a key's bytes when the fingerprints match, so about
+ * 1 in 65536 mismatched slots costs a key comparison, and a miss usually touches no key bytes at all.
+ *
+ * insertIfAbsent appends the key to the thread's arena only when it is about to CAS an EMPTY slot, and takes the
+ * record back if the key turns out to be present. Erased keys' records stay in the arena until it is destroyed.
+ */
+class AlgorithmCString {
+private:
+    static const uint64_t EMPTY = 0;
+    static const uint64_t TOMBSTONE = ~0ULL;    // its offset is not 8-byte aligned, so it never names a record
+    static const uint64_t OFFSET_MASK = keyArena::OFFSET_MASK;
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    const uint32_t capacity;
+    char padding1[PADDING_BYTES];
+    atomic<uint64_t> * data;
+    keyArena arena;
+    TABLE_STAT(debugCounter keyCompares;)          // fingerprint matches that compared key bytes
+    TABLE_STAT(debugCounter falseMatches;)         // ... and found a different key
+
+    static uint64_t fingerprintOf(const uint64_t h) {
+        return (h & 0xFFFF) << keyArena::OFFSET_BITS;
+    }
+    uint32_t homeOf(const uint64_t h) {
+        return (uint32_t) (((h >> 32) * capacity) >> 32);
+    }
+    bool matches(const int tid, const uint64_t word, const uint64_t fingerprint, const char * key, const size_t length);
+
+public:
+    TABLE_STAT(tableStats stats;)
+
+    AlgorithmCString(const int _numThreads, const int _capacity);
+    ~AlgorithmCString();
+    bool insertIfAbsent(const int tid, const char * key, const size_t length, const uint64_t value = 0);
+    bool erase(const int tid, const char * key, const size_t length);
+    bool contains(const int tid, const char * key, const size_t length);
+    bool get(const int tid, const char * key, const size_t length, uint64_t * value);
+    template <class Fn> void forEachEntry(Fn fn);
+    uint64_t getSumOfValues();
+    uint32_t getCapacity();
+    size_t getMemoryBytes();
+    size_t getArenaBytes();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the size of the hash table (maximum number of keys it can contain, counting erased ones)
+ */
+AlgorithmCString::AlgorithmCString(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(_capacity), arena(_numThreads) {
+    data = new atomic<uint64_t>[capacity]();
+}
+
+// destructor: clean up any allocated memory, etc.
+AlgorithmCString::~AlgorithmCString() {
+    delete[] data;
+}
+
+// does the slot word hold key? (the fingerprint first, then the bytes)
+bool AlgorithmCString::matches(const int tid, const uint64_t word, const uint64_t fingerprint, const char * key, const size_t length) {
+    if ((word & ~OFFSET_MASK) != fingerprint || word == TOMBSTONE) return false;
+    TABLE_STAT(keyCompares.inc(tid);)
+    const keyArena::record * r = arena.at(word & OFFSET_MASK);
+    const bool result = r->length == length && !memcmp(r->bytes(), key, length);
+    TABLE_STAT(if (!result) falseMatches.inc(tid);)
+    return result;
+}
+
+// semantics: try to insert key (with value). return true if successful (if key doesn't already exist), and false otherwise
+bool AlgorithmCString::insertIfAbsent(const int tid, const char * key, const size_t length, const uint64_t value) {
+    const uint64_t h = murmur64a(key, length);
+    const uint64_t fingerprint = fingerprintOf(h);
+    uint64_t word = EMPTY;      // ours, once the key is in the arena
+    for (uint32_t i = 0, index = homeOf(h); i < capacity; i++, index = probeNext(index, capacity)) {
+        uint64_t found = data[index];
+        if (found == EMPTY) {
+            if (word == EMPTY) word = fingerprint | arena.append(tid, key, length, value);
+            if (data[index].compare_exchange_strong(found, word)) {
+                TABLE_STAT(stats.addProbe(tid, i + 1);)
+                return true;
+            }
+            TABLE_STAT(stats.casFailures.inc(tid);)
+            // found is now whatever beat us to the slot: maybe our key
+        }
+        if (matches(tid, found, fingerprint, key, length)) {
+            if (word != EMPTY) arena.unappend(tid, word & OFFSET_MASK);
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
+        }
+    }
+    if (word != EMPTY) arena.unappend(tid, word & OFFSET_MASK);
+    TABLE_STAT(stats.addProbe(tid, capacity);)
+    return false; // Return false if there was no space, and the key wasn't found.
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+bool AlgorithmCString::erase(const int tid, const char * key, const size_t length) {
+    const uint64_t h = murmur64a(key, length);
+    const uint64_t fingerprint = fingerprintOf(h);
+    for (uint32_t i = 0, index = homeOf(h); i < capacity; i++, index = probeNext(index, capacity)) {
+        uint64_t found = data[index];
+        if (found == EMPTY) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
+        }
+        if (matches(tid, found, fingerprint, key, length)) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            bool erased = data[index].compare_exchange_strong(found, TOMBSTONE);
+            TABLE_STAT(if (!erased) stats.casFailures.inc(tid);)
+            return erased;
+        }
+    }
+    TABLE_STAT(stats.addProbe(tid, capacity);)
+    return false;
+}
+
+// semantics: return true if key is in the set, and false otherwise
+bool AlgorithmCString::contains(const int tid, const char * key, const size_t length) {
+    uint64_t value;
+    return get(tid, key, length, &value);
+}
+
+// semantics: return true and set *value (the value key was inserted with) if key is present, and false otherwise
+bool AlgorithmCString::get(const int tid, const char * key, const size_t length, uint64_t * value) {
+    const uint64_t h = murmur64a(key, length);
+    const uint64_t fingerprint = fingerprintOf(h);
+    for (uint32_t i = 0, index = homeOf(h); i < capacity; i++, index = probeNext(index, capacity)) {
+        uint64_t found = data[index];
+        if (found == EMPTY) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
+        }
+        if (matches(tid, found, fingerprint, key, length)) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            *value = arena.at(found & OFFSET_MASK)->value;
+            return true;
+        }
+    }
+    TABLE_STAT(stats.addProbe(tid, capacity);)
+    return false; // The key wasn't found anywhere in the table.
+}
+
+// semantics: call fn(bytes, length, value) for every key in the map (weakly consistent with concurrent updates)
+template <class Fn>
+void AlgorithmCString::forEachEntry(Fn fn) {
+    for (uint32_t i = 0; i < capacity; ++i) {
+        uint64_t word = data[i].load(memory_order_acquire);
+        if (word == EMPTY || word == TOMBSTONE) continue;
+        const keyArena::record * r = arena.at(word & OFFSET_MASK);
+        fn(r->bytes(), (size_t) r->length, r->value);
+    }
+}
+
+// semantics: return the sum of all VALUES in the map (modulo 2^64)
+uint64_t AlgorithmCString::getSumOfValues() {
+    uint64_t sum = 0;
+    forEachEntry([&](const char *, size_t, uint64_t value) { sum += value; });
+    return sum;
+}
+
+uint32_t AlgorithmCString::getCapacity() {
+    return capacity;
+}
+
+// bytes of slots plus bytes of key records
+size_t AlgorithmCString::getMemoryBytes() {
+    return (size_t) capacity * sizeof(uint64_t) + arena.getMemoryBytes();
+}
+
+size_t AlgorithmCString::getArenaBytes() {
+    return arena.getMemoryBytes();
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmCString::printDebuggingDetails() {
+    cout<<"arena bytes           : "<<arena.getMemoryBytes()<<endl;
+#ifdef TABLE_STATS
+    cout<<"key compares          : "<<keyCompares.getTotal()<<" ("<<falseMatches.getTotal()<<" fingerprint collisions)"<<endl;
+#endif
+}
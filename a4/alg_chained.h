@@ -0,0 +1,325 @@
+#pragma once
+#include "util.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "batch.h"
+#include "scan.h"
+#include "table_stats.h"
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <stdint.h>
+#include <assert.h>
+
+// with TABLE_STATS, also let the record manager count fresh node allocations and requests to its pool
+#if defined(TABLE_STATS) && !defined(MEMORY_STATS)
+#define MEMORY_STATS if(1)
+#define MEMORY_STATS2 if(1)
+#endif
+// the record manager defines its own TRACE; keep a4's (which benchmark_debug sets on the command line)
+#pragma push_macro("TRACE")
+#undef TRACE
+#include "../a6/recordmgr/record_manager.h"
+#undef TRACE
+#pragma pop_macro("TRACE")
+using namespace std;
+
+template <typename K>
+struct chainedNode {
+    K key;
+    atomic<uintptr_t> next;     // successor, with MARK_BIT set once this node is logically erased
+};
+
+/**
+ * Lock-free chained hash set: a fixed array of buckets, each the head of a Harris-Michael sorted linked list
+ * (Michael, "High performance dynamic lock-free hash tables and list-based sets", SPAA 2002).
+ *
+ * erase marks the victim's next pointer (the logical delete), then tries to swing its predecessor past it; any
+ * operation that meets a marked node on its way helps unlink it. Every key value is allowed (there are no
+ * EMPTY/TOMBSTONE sentinels), erased keys leave nothing behind, and the table never migrates: the capacity is the
+ * number of buckets, and chains just get longer as the load factor grows past 1.
+ *
+ * Nodes come from a6's record manager: DEBRA (epoch-based reclamation) frees an unlinked node only once no
+ * operation that could still hold it is running, and pool_perthread_and_shared hands reclaimed nodes back to
+ * allocate, so once the pools have warmed up, inserts and erases allocate nothing. Because a node cannot be reused
+ * while any operation that read it is running, the CASs on next pointers have no ABA problem.
+ */
+template <typename K = uint32_t, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
+class AlgorithmChained {
+public:
+    typedef K key_type;
+    typedef chainedNode<K> Node;
+    typedef record_manager<reclaimer_debra<>, allocator_new<>, pool_perthread_and_shared<>, Node> RecordManager;
+
+private:
+    static const uintptr_t MARK_BIT = 1;
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    const int capacity;
+    const int scanThreads;          // thread ids [numThreads, numThreads + scanThreads) are forEachKey's
+    char padding1[PADDING_BYTES];
+    atomic<uintptr_t> * buckets;    // dense: a chain's nodes are where the cache misses are
+    RecordManager * recmgr;
+    char padding2[PADDING_BYTES];
+    TABLE_STAT(debugCounter nodesRetired;)
+
+    static bool isMarked(const uintptr_t p) { return p & MARK_BIT; }
+    static Node * nodeOf(const uintptr_t p) { return (Node *) (p & ~MARK_BIT); }
+    bool find(const int tid, const K & key, atomic<uintptr_t> * head, atomic<uintptr_t> ** prevOut, Node ** currOut);
+
+public:
+    TABLE_STAT(tableStats stats;)
+
+    AlgorithmChained(const int _numThreads, const int _capacity);
+    ~AlgorithmChained();
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    bool insertIfAbsentFrom(const int tid, const K & key, const uint32_t h);
+    bool eraseFrom(const int tid, const K & key, const uint32_t h);
+    bool containsFrom(const int tid, const K & key, const uint32_t h);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
+    int64_t getSumOfKeys();
+    uint64_t getCapacity();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the number of buckets (the table holds any number of keys, but chains grow with keys per bucket)
+ */
+template <typename K, class Hash, class Range, class Alloc>
+AlgorithmChained<K, Hash, Range, Alloc>::AlgorithmChained(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(Range::roundCapacity(_capacity)),
+  scanThreads(max(1, min(omp_get_max_threads(), MAX_THREADS - _numThreads))) {
+    assert(numThreads < MAX_THREADS);
+    buckets = Alloc::template allocate<atomic<uintptr_t>>(capacity, omp_get_max_threads());
+    recmgr = new RecordManager(numThreads + scanThreads);
+}
+
+// destructor: clean up any allocated memory, etc.
+template <typename K, class Hash, class Range, class Alloc>
+AlgorithmChained<K, Hash, Range, Alloc>::~AlgorithmChained() {
+    // no operation is running, so the nodes still in the chains can go straight back to the record manager
+    for (int i = 0; i < capacity; ++i) {
+        Node * curr = nodeOf(buckets[i].load(memory_order_relaxed));
+        while (curr) {
+            Node * next = nodeOf(curr->next.load(memory_order_relaxed));
+            recmgr->deallocate(0, curr);
+            curr = next;
+        }
+    }
+    delete recmgr;
+    Alloc::deallocate(buckets, capacity);
+}
+
+// Harris-Michael search of the chain at head for key, unlinking (and retiring) every marked node it passes.
+// On return, *currOut is the first node with a key >= key (or NULL), and *prevOut is the unmarked link that
+// pointed to it. returns true if *currOut holds key. Must run inside a record manager guard.
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::find(const int tid, const K & key, atomic<uintptr_t> * head, atomic<uintptr_t> ** prevOut, Node ** currOut) {
+retry:
+    atomic<uintptr_t> * prev = head;
+    uintptr_t curr = prev->load(memory_order_acquire);
+    uint32_t visited = 0;
+    while (true) {
+        Node * node = nodeOf(curr);
+        if (node == NULL) break;
+        ++visited;
+        uintptr_t next = node->next.load(memory_order_acquire);
+        if (isMarked(next)) {
+            // node is erased: swing prev past it. this fails if prev changed or its own node was marked
+            if (!prev->compare_exchange_strong(curr, next & ~MARK_BIT)) {
+                TABLE_STAT(stats.markedRestarts.inc(tid);)
+                goto retry;
+            }
+            recmgr->retire(tid, node);
+            TABLE_STAT(nodesRetired.inc(tid);)
+            curr = next & ~MARK_BIT;
+            continue;
+        }
+        if (!(node->key < key)) break;
+        prev = &node->next;
+        curr = next;
+    }
+    TABLE_STAT(stats.addProbe(tid, max(1U, visited));)
+    *prevOut = prev;
+    *currOut = nodeOf(curr);
+    return *currOut && (*currOut)->key == key;
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key) {
+    return insertIfAbsentFrom(tid, key, Hash::hash(key));
+}
+
+// insertIfAbsent, given h = Hash::hash(key)
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::insertIfAbsentFrom(const int tid, const K & key, const uint32_t h) {
+    auto guard = recmgr->getGuard(tid);
+    atomic<uintptr_t> * head = &buckets[Range::reduce(h, capacity)];
+    Node * node = NULL;
+    while (true) {
+        atomic<uintptr_t> * prev;
+        Node * curr;
+        if (find(tid, key, head, &prev, &curr)) {
+            if (node) recmgr->deallocate(tid, node);    // never published, so it can be reused right away
+            return false;
+        }
+        if (node == NULL) {
+            node = recmgr->template allocate<Node>(tid);
+            node->key = key;
+        }
+        node->next.store((uintptr_t) curr, memory_order_relaxed);
+        uintptr_t expected = (uintptr_t) curr;
+        if (prev->compare_exchange_strong(expected, (uintptr_t) node)) return true;
+        TABLE_STAT(stats.casFailures.inc(tid);)
+    }
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    return eraseFrom(tid, key, Hash::hash(key));
+}
+
+// erase, given h = Hash::hash(key)
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::eraseFrom(const int tid, const K & key, const uint32_t h) {
+    auto guard = recmgr->getGuard(tid);
+    atomic<uintptr_t> * head = &buckets[Range::reduce(h, capacity)];
+    while (true) {
+        atomic<uintptr_t> * prev;
+        Node * curr;
+        if (!find(tid, key, head, &prev, &curr)) return false;
+        uintptr_t next = curr->next.load(memory_order_acquire);
+        if (isMarked(next)) continue;   // another erase got there first; find will unlink it
+        if (!curr->next.compare_exchange_strong(next, next | MARK_BIT)) {
+            TABLE_STAT(stats.casFailures.inc(tid);)
+            continue;
+        }
+        // the key is erased. try to unlink the node once, and leave it to find if that fails
+        uintptr_t expected = (uintptr_t) curr;
+        if (prev->compare_exchange_strong(expected, next)) {
+            recmgr->retire(tid, curr);
+            TABLE_STAT(nodesRetired.inc(tid);)
+        } else {
+            find(tid, key, head, &prev, &curr);
+        }
+        return true;
+    }
+}
+
+// semantics: return true if key is in the set, and false otherwise
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    return containsFrom(tid, key, Hash::hash(key));
+}
+
+// contains, given h = Hash::hash(key). Only reads: it walks past marked nodes instead of unlinking them.
+template <typename K, class Hash, class Range, class Alloc>
+bool AlgorithmChained<K, Hash, Range, Alloc>::containsFrom(const int tid, const K & key, const uint32_t h) {
+    auto guard = recmgr->getGuard(tid, true);
+    Node * curr = nodeOf(buckets[Range::reduce(h, capacity)].load(memory_order_acquire));
+    uint32_t visited = 1;
+    while (curr && curr->key < key) {
+        curr = nodeOf(curr->next.load(memory_order_acquire));
+        ++visited;
+    }
+    TABLE_STAT(stats.addProbe(tid, visited);)
+    return curr && curr->key == key && !isMarked(curr->next.load(memory_order_acquire));
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1], with results[i] = insertIfAbsent(tid, keys[i])
+// The keys are hashed a group at a time and their buckets prefetched (see batch.h).
+template <typename K, class Hash, class Range, class Alloc>
+void AlgorithmChained<K, Hash, Range, Alloc>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&buckets[Range::reduce(h, capacity)], 1); },
+            [&](const K & key, uint32_t h) { return insertIfAbsentFrom(tid, key, h); });
+}
+
+// semantics: erase every key in keys[0..n-1], with results[i] = erase(tid, keys[i])
+template <typename K, class Hash, class Range, class Alloc>
+void AlgorithmChained<K, Hash, Range, Alloc>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&buckets[Range::reduce(h, capacity)], 1); },
+            [&](const K & key, uint32_t h) { return eraseFrom(tid, key, h); });
+}
+
+// semantics: results[i] = contains(tid, keys[i]) for every key in keys[0..n-1]
+template <typename K, class Hash, class Range, class Alloc>
+void AlgorithmChained<K, Hash, Range, Alloc>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t h) { __builtin_prefetch(&buckets[Range::reduce(h, capacity)], 0); },
+            [&](const K & key, uint32_t h) { return containsFrom(tid, key, h); });
+}
+
+// semantics: call fn(tid, key) for every key in the set, splitting the buckets across nthreads OpenMP threads
+// (tid is the OpenMP thread number). Weakly consistent with concurrent updates: each scanning thread holds a record
+// manager guard under one of the scan thread ids after the numThreads operation ids, so the nodes it walks stay
+// allocated. Scans must not overlap each other (they would share those ids).
+template <typename K, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmChained<K, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    #pragma omp parallel num_threads(max(1, min(nthreads, scanThreads)))
+    {
+        const int tid = omp_get_thread_num();
+        auto guard = recmgr->getGuard(numThreads + tid, true);
+        #pragma omp for schedule(static)
+        for (int i = 0; i < capacity; ++i) {
+            for (Node * curr = nodeOf(buckets[i].load(memory_order_acquire)); curr; ) {
+                uintptr_t next = curr->next.load(memory_order_acquire);
+                if (!isMarked(next)) fn(tid, curr->key);
+                curr = nodeOf(next);
+            }
+        }
+    }
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmChained<K, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Hash, class Range, class Alloc>
+int64_t AlgorithmChained<K, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
+}
+
+// number of buckets
+template <typename K, class Hash, class Range, class Alloc>
+uint64_t AlgorithmChained<K, Hash, Range, Alloc>::getCapacity() {
+    return capacity;
+}
+
+// print the chain lengths and (with TABLE_STATS) how many nodes the record manager allocated versus reused
+template <typename K, class Hash, class Range, class Alloc>
+void AlgorithmChained<K, Hash, Range, Alloc>::printDebuggingDetails() {
+    long long keys = 0;
+    long long longest = 0;
+    for (int i = 0; i < capacity; ++i) {
+        long long length = 0;
+        for (Node * curr = nodeOf(buckets[i].load()); curr; curr = nodeOf(curr->next.load())) ++length;
+        keys += length;
+        longest = max(longest, length);
+    }
+    cout<<"buckets               : "<<capacity<<endl;
+    cout<<"nodes in chains       : "<<keys<<" (load factor "<<(keys / (double) capacity)<<", longest chain "<<longest<<")"<<endl;
+#ifdef TABLE_STATS
+    auto info = recmgr->getDebugInfo((Node *) NULL);
+    cout<<"nodes allocated       : "<<info->getTotalAllocated()<<" fresh, "<<info->getTotalFromPool()<<" requested from the pool"<<endl;
+    cout<<"nodes retired         : "<<nodesRetired.getTotal()<<endl;
+#endif
+}
@@ -1,34 +1,65 @@
 #pragma once
 #include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "batch.h"
+#include "bulk_load.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "table_stats.h"
+#include "epoch_reclaim.h"
+#include "resize_policy.h"
 #include <atomic>
 #include <cmath>
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
+#include <thread>
+#include <time.h>
 using namespace std;
 
+template <typename K = uint32_t, class Policy = marked_key_policy<K>, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
 class AlgorithmD {
+public:
+    typedef K key_type;
+
+    // Who does the work of a migration once it has started.
+    enum migration_mode_t {
+        MIGRATE_HELP_ALL,       // any operation that sees a migration helps until it is finished
+        MIGRATE_BUDGET,         // each operation migrates at most MIGRATION_BUDGET chunks, plus the chunks its key needs
+        MIGRATE_BACKGROUND      // a migrator thread does the work (see migrateInBackground); operations only migrate the chunks their key needs
+    };
+
 private:
-    enum {
-        MARKED_MASK = (int) 0x80000000,     // most significant bit of a 32-bit key
-        TOMBSTONE = (int) 0x7FFFFFFF,       // largest value that doesn't use bit MARKED_MASK
-        EMPTY = (int) 0
-    }; // with these definitions, the largest "real" key we allow in the table is 0x7FFFFFFE, and the smallest is 1 !!
+    static constexpr K MARKED_MASK = Policy::MARKED_MASK;   // most significant bit of a key
+    static constexpr K TOMBSTONE = Policy::TOMBSTONE;       // largest value that doesn't use bit MARKED_MASK
+    static constexpr K EMPTY = Policy::EMPTY;
+    // with these definitions, the largest "real" key we allow in the table is Policy::MAX_KEY (0x7FFFFFFE for 32-bit keys), and the smallest is 1 !!
 
-    static const int EXPANSION_FACTOR = 2;
     static const int EXPANSION_SIZE = 2;
     static const int PROBING_AMOUNT = 100;
+    static const int CHUNK_SIZE = 4096;
+    static const int MIGRATION_BUDGET = 1;
+
+    // per-chunk migration state (only used by MIGRATE_BUDGET and MIGRATE_BACKGROUND, which claim chunks out of order)
+    enum { CHUNK_FREE = 0, CHUNK_MIGRATING = 1, CHUNK_DONE = 2 };
 
 
     struct table {
         // data types
         char padding2[PADDING_BYTES];
-        atomic<uint32_t> * data;
-        atomic<uint32_t> * old;
+        atomic<K> * data;
+        atomic<K> * old;
+        table * oldTable;           // the table this one replaces (whose slots are old); retired once they are all migrated
+        void * mapping;             // the snapshot file data lives in, if this table was opened from one (else NULL)
+        size_t mappingBytes;
         counter * tombstoneCount;
         counter * approxSize;
         uint32_t capacity;
         uint32_t oldCapacity;
+        uint32_t totalOldChunks;
+        atomic<uint8_t> * chunkState;
         // Adding addition padding to avoid a thread from spinning and cache missing a bunch, invalidating other's.
         char padding3[PADDING_BYTES];
         atomic<uint32_t> chunksClaimed;
@@ -37,15 +68,30 @@ private:
         char padding5[PADDING_BYTES];
         
         // constructor
-        table(atomic<uint32_t> * _old, uint32_t _oldCapacity, int _numThreads) : 
-        old(_old), oldCapacity(_oldCapacity), capacity(_oldCapacity * EXPANSION_SIZE), chunksClaimed(0), chunksDone(0) {
-            data = new atomic<uint32_t>[capacity]();
+        // initThreads > 1 zeroes the slots with that many OpenMP threads, so their pages are first touched in parallel
+        // (see slot_alloc.h). Tables built during a migration use 1.
+        table(atomic<K> * _old, uint32_t _oldCapacity, uint32_t _capacity, int _numThreads, int initThreads = 1) : 
+        old(_old), oldTable(NULL), mapping(NULL), mappingBytes(0), oldCapacity(_oldCapacity), capacity(_capacity), chunksClaimed(0), chunksDone(0) {
+            totalOldChunks = (oldCapacity + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            chunkState = new atomic<uint8_t>[totalOldChunks]();
+            data = Alloc::template allocate<atomic<K>>(capacity, initThreads);
+            tombstoneCount = new counter(_numThreads);
+            approxSize = new counter(_numThreads);
+        }
+
+        // a table (with no migration in progress) whose slots are those of a mapped snapshot (see open())
+        table(void * _mapping, size_t _mappingBytes, uint32_t _capacity, int _numThreads) :
+        old(NULL), oldTable(NULL), mapping(_mapping), mappingBytes(_mappingBytes), capacity(_capacity), oldCapacity(0), totalOldChunks(0), chunksClaimed(0), chunksDone(0) {
+            chunkState = new atomic<uint8_t>[0];
+            data = (atomic<K> *) ((char *) mapping + SNAPSHOT_HEADER_BYTES);
             tombstoneCount = new counter(_numThreads);
             approxSize = new counter(_numThreads);
         }
 
         ~table() {
-            delete[] data;
+            if (mapping) munmap(mapping, mappingBytes);
+            else Alloc::deallocate(data, capacity);
+            delete[] chunkState;
             delete tombstoneCount;
             delete approxSize;
         }
@@ -53,7 +99,23 @@ private:
     
     bool expandAsNeeded(const int tid, atomic<table *> t, int i);
     void helpExpansion(const int tid, table * t);
-    void startExpansion(const int tid, atomic<table *> t);
+    void helpSome(const int tid, table * t, uint32_t budget);
+    void helpForKey(const int tid, table * t, const K key);
+    bool tryMigrateChunk(const int tid, table * t, uint32_t chunk);
+    void ensureChunkMigrated(const int tid, table * t, uint32_t chunk);
+    void migratorLoop();
+    void finishMigration(table * t);
+    // thread ids past the callers' [0, numThreads): one for bulkLoad, snapshot and scans, one for the migrator thread
+    int maintenanceTid() { return numThreads; }
+    int migratorTid() { return numThreads + 1; }
+    void startExpansion(const int tid, atomic<table *> t, uint32_t newCapacity);
+    void resize(const int tid, table * t);
+    uint32_t nextCapacity(table * t);
+    // the smallest capacity a migration may shrink to: that of the table we started with
+    uint64_t minCapacity() { return (uint64_t) initCapacity * EXPANSION_SIZE; }
+    static snapshot_header describe(const uint64_t capacity);
+    AlgorithmD(const int _numThreads, const int _initCapacity, const int _migrationMode, const bool _startMigrator, table * initialTable);
+    bool migrateKey(const int tid, table * t, const K key);
     void migrate(const int tid, atomic<table *> t, int myChunk);
     
     char padding0[PADDING_BYTES];
@@ -62,16 +124,39 @@ private:
     char padding2[PADDING_BYTES];
     // Padding below from currentTable
     atomic<table *> currentTable;
+    char padding3[PADDING_BYTES];
+    const int migrationMode;
+    atomic<bool> stopMigrator;
+    thread * migrator;
+    char padding4[PADDING_BYTES];
+    epochReclaimer epochs;          // frees a replaced table once no operation can still be using it
     
 public:
-    AlgorithmD(const int _numThreads, const int _capacity);
+    AlgorithmD(const int _numThreads, const int _capacity, const int _migrationMode = MIGRATE_HELP_ALL, const bool _startMigrator = true);
     ~AlgorithmD();
-    bool insertIfAbsent(const int tid, const int & key, bool disableExpansion);
-    bool erase(const int tid, const int & key);
+    bool migrateInBackground();
+    bool snapshot(const char * path);
+    static AlgorithmD * open(const char * path, const int numThreads, const int migrationMode = MIGRATE_HELP_ALL);
+    bool insertIfAbsent(const int tid, const K & key, bool disableExpansion = false);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    void bulkLoad(const K * keys, const size_t n, const int nthreads);
+    bool insertIfAbsentFrom(const int tid, const K & key, const uint32_t keyHash);
+    bool eraseFrom(const int tid, const K & key, const uint32_t keyHash);
+    bool containsFrom(const int tid, const K & key, const uint32_t keyHash);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
     long getSumOfKeys();
-    uint32_t getHash(const int& key, uint32_t capacity);
+    uint32_t getCapacity();
+    size_t getMemoryBytes();
+    uint32_t getHash(const K & key, uint32_t capacity);
+    uint32_t indexOf(const uint32_t keyHash, uint32_t capacity);
     void printDebuggingDetails();
     int numThreads; 
+    TABLE_STAT(tableStats stats;)
 };
 
 /**
@@ -79,233 +164,630 @@ public:
  * 
  * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ * @param _migrationMode one of migration_mode_t. MIGRATE_BACKGROUND starts a migrator thread.
+ * @param _startMigrator with MIGRATE_BACKGROUND, false leaves the migrator thread to the owner, which must call
+ *        migrateInBackground from one thread of its own (e.g. AlgorithmDSharded's single migrator for all its shards)
+ *
+ * The table uses two thread ids of its own after the callers' ones (see maintenanceTid and migratorTid),
+ * so its per-thread counters are sized for _numThreads+2, which must be at most MAX_THREADS.
+ *
+ * Every operation runs inside an epochs guard, so a table replaced by a migration is freed (once every chunk of it
+ * has been migrated) only after the operations that could have loaded it have finished (see epoch_reclaim.h).
  */
-AlgorithmD::AlgorithmD(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), initCapacity(_capacity) {
-    currentTable = new table(0, _capacity, _numThreads);
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmD<K, Policy, Hash, Range, Alloc>::AlgorithmD(const int _numThreads, const int _capacity, const int _migrationMode, const bool _startMigrator)
+// Every later capacity is this one multiplied or divided by 2, so a power-of-two Range stays satisfied.
+: AlgorithmD(_numThreads, Range::roundCapacity(_capacity), _migrationMode, _startMigrator,
+        new table(0, Range::roundCapacity(_capacity), Range::roundCapacity(_capacity) * EXPANSION_SIZE, _numThreads + 2, omp_get_max_threads())) {}
+
+// common constructor: start out with initialTable (owned by this object from now on)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmD<K, Policy, Hash, Range, Alloc>::AlgorithmD(const int _numThreads, const int _initCapacity, const int _migrationMode, const bool _startMigrator, table * initialTable)
+: numThreads(_numThreads), initCapacity(_initCapacity), migrationMode(_migrationMode), stopMigrator(false), migrator(NULL),
+  epochs(_numThreads + 2) {
+    assert(numThreads + 2 <= MAX_THREADS);
+    currentTable = initialTable;
     // Initialize the chunks claimed and chunks done to a state that resembles a normal state.
-    currentTable.load()->chunksClaimed = ceil((float) _capacity / 4096);
-    currentTable.load()->chunksDone = ceil((float) _capacity / 4096);
+    currentTable.load()->chunksClaimed = currentTable.load()->totalOldChunks;
+    currentTable.load()->chunksDone = currentTable.load()->totalOldChunks;
+
+    if (migrationMode == MIGRATE_BACKGROUND && _startMigrator) {
+        migrator = new thread(&AlgorithmD::migratorLoop, this);
+    }
 }
 
 // destructor: clean up any allocated memory, etc.
-AlgorithmD::~AlgorithmD() {
-    delete currentTable;
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmD<K, Policy, Hash, Range, Alloc>::~AlgorithmD() {
+    if (migrator) {
+        stopMigrator = true;
+        migrator->join();
+        delete migrator;
+    }
+    // a table whose migration never finished still owns the table it was replacing
+    table * t = currentTable;
+    if (t->oldTable && t->chunksDone < t->totalOldChunks) delete t->oldTable;
+    delete t;
+}
+
+// the snapshot header for a table of this type with the given capacity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+snapshot_header AlgorithmD<K, Policy, Hash, Range, Alloc>::describe(const uint64_t capacity) {
+    snapshot_header header;
+    header.setNames("AlgorithmD", Hash::name(), Range::name());
+    header.keyBytes = sizeof(K);
+    header.slotBytes = sizeof(atomic<K>);
+    header.capacity = capacity;
+    header.empty = EMPTY;
+    header.tombstone = TOMBSTONE;
+    header.markedMask = MARKED_MASK;
+    return header;
+}
+
+// semantics: finish any migration in progress, then write the current table to path (see snapshot.h), along
+// with its size counters and the table's initial capacity; return true if successful.
+// Concurrent updates may or may not be captured (as for forEachKey).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::snapshot(const char * path) {
+    auto guard = epochs.getGuard(maintenanceTid());
+    table * t = currentTable;
+    finishMigration(t);
+    snapshot_header header = describe(t->capacity);
+    header.insertCount = t->approxSize->getAccurate();
+    header.tombstoneCount = t->tombstoneCount->getAccurate();
+    header.initCapacity = initCapacity;
+    return writeSnapshot<atomic<K>>(path, header, t->capacity,
+            [&](atomic<K> * buffer, const size_t begin, const size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    // a slot is only marked if t is being migrated by a concurrent operation; write it unmarked
+                    buffer[i].store(t->data[begin + i].load(memory_order_relaxed) & ~MARKED_MASK, memory_order_relaxed);
+                }
+            });
+}
+
+// semantics: return a table that serves operations straight from a private mapping of the snapshot at path
+// (pages are read in as they are first probed, and updates never reach the file), or NULL if path cannot be
+// mapped or was written by a table with a different layout, hash or sentinels.
+// The first expansion migrates the keys out of the mapping into an ordinary table.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmD<K, Policy, Hash, Range, Alloc> * AlgorithmD<K, Policy, Hash, Range, Alloc>::open(const char * path, const int numThreads, const int migrationMode) {
+    snapshot_header header;
+    size_t mappedBytes;
+    void * base = mapSnapshot(path, &header, &mappedBytes);
+    if (!base) return NULL;
+    if (!header.matches(describe(header.capacity), path)) {
+        munmap(base, mappedBytes);
+        return NULL;
+    }
+    table * t = new table(base, mappedBytes, header.capacity, numThreads + 2);
+    t->approxSize->add(header.insertCount);
+    t->tombstoneCount->add(header.tombstoneCount);
+    return new AlgorithmD(numThreads, header.initCapacity, migrationMode, true, t);
 }
 
 // This will implicitly check if expanding is true by trying to help.
-bool AlgorithmD::expandAsNeeded(const int tid, atomic<table *> t, int i) {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::expandAsNeeded(const int tid, atomic<table *> t, int i) {
     // return false;
     
-    helpExpansion(tid, t.load());
+    if (migrationMode == MIGRATE_HELP_ALL) helpExpansion(tid, t.load());
     // If it isn't, check the capacity, or how often we have probed.
-    // If we see the approx size is larger than 1/2 of the size, expand.
+    // If we see the approx size (slots used, including tombstones) is larger than 1/2 of the size, expand.
     // If we see we are probing a large amount, get a more accurate check.
     // TODO: Play with these numbers to check how they impact performance.
 
-    if (t.load()->approxSize->get() + t.load()->tombstoneCount->get() > (ceil((float)t.load()->capacity)/EXPANSION_FACTOR)) {
-        startExpansion(tid, t.load());
+    if (resize_policy::tooFull(t.load()->approxSize->get(), t.load()->capacity)) {
+        resize(tid, t.load());
         return true;
     }
     else if (i > PROBING_AMOUNT) {
-        if (t.load()->approxSize->getAccurate() + t.load()->tombstoneCount->getAccurate() > ceil((float)t.load()->capacity/EXPANSION_FACTOR)) {
-            startExpansion(tid, t.load());
+        if (resize_policy::tooFull(t.load()->approxSize->getAccurate(), t.load()->capacity)) {
+            resize(tid, t.load());
             return true;
         }
     }
     return false;
 }
 
-void AlgorithmD::helpExpansion(const int tid, table * t) {
+// Migrate t into a table sized by nextCapacity. t's own migration is finished first, since until then its counts
+// only cover the keys migrated into it so far.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::resize(const int tid, table * t) {
+    helpExpansion(tid, t);
+    startExpansion(tid, t, nextCapacity(t));
+}
+
+// Pick the capacity of the next table from the number of live keys in t (see resize_policy.h).
+// Only called when a migration is about to start, so the accurate (slow) counts are affordable.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmD<K, Policy, Hash, Range, Alloc>::nextCapacity(table * t) {
+    int64_t live = t->approxSize->getAccurate() - t->tombstoneCount->getAccurate();
+    return (uint32_t) resize_policy::nextCapacity(live, t->capacity, minCapacity());
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::helpExpansion(const int tid, table * t) {
+    TABLE_STAT(const bool helping = t->chunksDone < t->totalOldChunks; const uint64_t start = helping ? tableStats::nowNanos() : 0;)
+    // Claim and migrate chunks until there are none left,
+    helpSome(tid, t, t->totalOldChunks);
     
-    uint32_t totalOldChunks = ceil((float) t->oldCapacity / 4096);
-    // While there are chunks to claim,
-    // Claim some chunks
-    while (t->chunksClaimed < totalOldChunks) {
-        int myChunk = t->chunksClaimed++;
+    while (t->chunksDone < t->totalOldChunks) {
+        // Do nothing and just wait for the last thread to finish.
+    }
+    TABLE_STAT(if (helping) { stats.expansionsHelped.inc(tid); stats.helpExpansionNanos.add(tid, tableStats::nowNanos() - start); })
+}
+
+// Migrate at most budget chunks from the shared claim cursor, without waiting for anyone else.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::helpSome(const int tid, table * t, uint32_t budget) {
+    uint32_t claimed = 0;
+    while (claimed < budget && t->chunksClaimed < t->totalOldChunks) {
+        uint32_t myChunk = t->chunksClaimed++;
         // This checks if this work is actually within the bounds of the old data.
-        if (myChunk < totalOldChunks) {
-            migrate(tid, t, myChunk);
-            t->chunksDone++;
+        if (myChunk < t->totalOldChunks) {
+            tryMigrateChunk(tid, t, myChunk);
+            ++claimed;
         }
     }
-    
-    while (t->chunksClaimed < totalOldChunks) {
-        // Do nothing and just wait for the last thread to finish.
+}
+
+// Chunks can also be claimed out of order by helpForKey, so the cursor alone does not give ownership.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::tryMigrateChunk(const int tid, table * t, uint32_t chunk) {
+    uint8_t expected = CHUNK_FREE;
+    if (!t->chunkState[chunk].compare_exchange_strong(expected, CHUNK_MIGRATING)) return false;
+    migrate(tid, t, chunk);
+    t->chunkState[chunk] = CHUNK_DONE;
+    TABLE_STAT(stats.chunksMigrated.inc(tid);)
+    // the last chunk: operations that load t from now on never look at the old table again
+    if (t->chunksDone.fetch_add(1) + 1 == t->totalOldChunks && t->oldTable) {
+        epochs.retire(t->oldTable, (size_t) t->oldCapacity * sizeof(atomic<K>));
     }
+    return true;
 }
 
-void AlgorithmD::startExpansion(const int tid, atomic<table *> t) {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::ensureChunkMigrated(const int tid, table * t, uint32_t chunk) {
+    if (t->chunkState[chunk] == CHUNK_DONE) return;
+    if (tryMigrateChunk(tid, t, chunk)) return;
+    while (t->chunkState[chunk] != CHUNK_DONE) {
+        // Someone else is migrating the chunk we need.
+    }
+}
+
+// Make t safe to use for key while the rest of its migration is still running.
+// A key that is in the old table lies between its old hash and the next EMPTY slot there,
+// so once every chunk covering that range is migrated, no old copy of key can show up in t later.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::helpForKey(const int tid, table * t, const K key) {
+    if (t->chunksDone == t->totalOldChunks) return;
+    if (migrationMode == MIGRATE_BUDGET) helpSome(tid, t, MIGRATION_BUDGET);
+
+    uint32_t index = getHash(key, t->oldCapacity);
+    for (uint32_t i = 0; i < t->oldCapacity; ++i) {
+        if (i == 0 || index % CHUNK_SIZE == 0) ensureChunkMigrated(tid, t, index / CHUNK_SIZE);
+        // Migrated slots are frozen (MARKED), so this read is stable.
+        if ((t->old[index] & ~MARKED_MASK) == EMPTY) return;
+        index = probeNext(index, t->oldCapacity);
+    }
+}
+
+// One pass of the MIGRATE_BACKGROUND migrator: drain the migration in progress, if any. Returns false if there was
+// none. Only one thread may call this at a time (it uses migratorTid).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::migrateInBackground() {
+    auto guard = epochs.getGuard(migratorTid());
+    table * t = currentTable.load();
+    if (t->chunksClaimed >= t->totalOldChunks) return false;
+    helpSome(migratorTid(), t, t->totalOldChunks);
+    return true;
+}
+
+// Body of the MIGRATE_BACKGROUND thread: drain any migration in progress, otherwise nap
+// (outside migrateInBackground's guard, or nothing could be freed meanwhile).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::migratorLoop() {
+    while (!stopMigrator) {
+        if (!migrateInBackground()) {
+            timespec time_to_sleep;
+            time_to_sleep.tv_sec = 0;
+            time_to_sleep.tv_nsec = 50000;
+            nanosleep(&time_to_sleep, NULL);
+        }
+    }
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::startExpansion(const int tid, atomic<table *> t, uint32_t newCapacity) {
     table * passedTable = t.load(); 
 
-    table * newTable = new table(t.load()->data, t.load()->capacity, numThreads);
+    // t can only be migrated once its own migration is finished.
+    helpExpansion(tid, passedTable);
+
+    table * newTable = new table(t.load()->data, t.load()->capacity, newCapacity, numThreads + 2);
+    newTable->oldTable = passedTable;
 
     // Make a new table
     if (!(currentTable.compare_exchange_strong(passedTable, newTable))) {
         delete newTable;
-    };
+    } else {
+        TABLE_STAT(stats.expansionsStarted.inc(tid);)
+    }
 
-    helpExpansion(tid, currentTable);
+    // In the other modes the retried operation only migrates what it needs (see helpForKey).
+    if (migrationMode == MIGRATE_HELP_ALL) helpExpansion(tid, currentTable);
 }
 
-void AlgorithmD::migrate(const int tid, atomic<table *> t, int myChunk) {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::migrate(const int tid, atomic<table *> t, int myChunk) {
 
-    int startingIndex = myChunk * 4096;
+    int startingIndex = myChunk * CHUNK_SIZE;
     int totalInserts = t.load()->oldCapacity - startingIndex;
-    if (totalInserts > 4096) {
-        totalInserts = 4096;
+    if (totalInserts > CHUNK_SIZE) {
+        totalInserts = CHUNK_SIZE;
     }
 
     assert(startingIndex < t.load()->oldCapacity);
-    assert(totalInserts <= 4096);
+    assert(totalInserts <= CHUNK_SIZE);
 
     for (int i = 0; i < totalInserts; i++) {
 
-        uint32_t currKey = t.load()->old[i + startingIndex];
+        K currKey = t.load()->old[i + startingIndex];
         while(!(t.load()->old[i + startingIndex].compare_exchange_strong(currKey, currKey | MARKED_MASK))) {
+            TABLE_STAT(stats.casFailures.inc(tid);)
             currKey = t.load()->old[i + startingIndex];
         }
-        int v = t.load()->old[i + startingIndex] & ~MARKED_MASK;
-        // Do an insertIfAbsent with disableExpansion true to avoid recursion loop
+        K v = t.load()->old[i + startingIndex] & ~MARKED_MASK;
+        // Insert directly into t (not currentTable) without helping, to avoid a recursion loop
         if ((v != TOMBSTONE) && (v != EMPTY)) {
+            migrateKey(tid, t.load(), v);
+        }
+    }
+}
 
-            // Grab the old value
-            // Do an insert in the new table with the value, disablingExpansion
-            insertIfAbsent(tid, v, true);
+// Insert a key that is being migrated into table t. Never helps or expands (that would recurse),
+// and never needs to look for MARKED slots since t cannot be migrated until every chunk is done.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::migrateKey(const int tid, table * t, const K key) {
+    assert(key != TOMBSTONE);
+    assert(key > 0);
+
+    uint32_t h = getHash(key, t->capacity);
+    for (uint32_t i = 0, index = h; i < t->capacity; ++i, index = probeNext(index, t->capacity)) {
+        K value = t->data[index];
+
+        // Keys are unique in the old table, so this means something went wrong during migration...
+        if (value == key) {
+            return false;
+        }
+
+        else if (value == EMPTY) {
+            if (t->data[index].compare_exchange_strong(value, key)){
+                t->approxSize->inc(tid);
+                return true;
+            }
+            TABLE_STAT(stats.casFailures.inc(tid);)
+            if (value == key) {
+                return false;
+            }
         }
     }
+    return false;
 }
 
 // semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
-bool AlgorithmD::insertIfAbsent(const int tid, const int & key, bool disableExpansion = false) {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key, bool disableExpansion) {
+    // Prevent the infinite loop for helping from occuring when migrating.
+    if (disableExpansion) {
+        auto guard = epochs.getGuard(tid);
+        return migrateKey(tid, currentTable.load(), key);
+    }
+    return insertIfAbsentFrom(tid, key, Hash::hash(key));
+}
+
+// same as insertIfAbsent, but with key's hash (before reduction to an index) precomputed
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::insertIfAbsentFrom(const int tid, const K & key, const uint32_t keyHash) {
+    auto guard = epochs.getGuard(tid);  // restarts call back in here, and only the outermost guard counts
     table * t = currentTable.load();
-    uint32_t h = getHash(key, t->capacity); // Generate hash that is indexed to our array.
-    for (uint32_t i = 0; i < t->capacity; ++i) {
-
-        // Prevent the infinite loop for helping from occuring when migrating.
-        if (disableExpansion) {
-            uint32_t index = (h + i) % t->capacity;
-            uint32_t value = t->data[index];
-            
-            assert(key != TOMBSTONE);
-            assert(key > 0);
-
-            // This means something went wrong during migration...
-            if (value == key) {
-            }
+    if (migrationMode != MIGRATE_HELP_ALL) helpForKey(tid, t, key);
+    uint32_t h = indexOf(keyHash, t->capacity); // Generate hash that is indexed to our array.
+    for (uint32_t i = 0, index = h; i < t->capacity; ++i, index = probeNext(index, t->capacity)) {
+        if (expandAsNeeded(tid, t, i)) return insertIfAbsentFrom(tid, key, keyHash);
 
-            else if (value == EMPTY) {
-                if (t->data[index].compare_exchange_strong(value, key)){
-                    t->approxSize->inc(tid);
-                    return true;
-                }
-                else {
-                }
-            }
+        K value = t->data[index];
+        
+        // Expansion happening
+        if (value & MARKED_MASK) {
+            TABLE_STAT(stats.markedRestarts.inc(tid);)
+            return insertIfAbsentFrom(tid, key, keyHash);
         }
-        else {
-            if (expandAsNeeded(tid, t, i)) return insertIfAbsent(tid, key, false);
-
-            uint32_t index = (h + i) % t->capacity;
-            uint32_t value = t->data[index];
-            
-            // Expansion happening
-            if (value & MARKED_MASK) {
-                return insertIfAbsent(tid, key, false);
-            }
 
-            // Key already found
-            else if (value == key) {
-                return false;
+        // Key already found
+        else if (value == key) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
+        }
+
+        else if (value == EMPTY) {
+            // Successful insert!
+            if (t->data[index].compare_exchange_strong(value, key)){
+                t->approxSize->inc(tid); // incrementing as we added a value
+                TABLE_STAT(stats.addProbe(tid, i + 1);)
+                return true;
             }
+            else {
+                value = t->data[index];
 
-            else if (value == EMPTY) {
-                // Successful insert!
-                if (t->data[index].compare_exchange_strong(value, key)){
-                    t->approxSize->inc(tid); // incrementing as we added a value
-                    return true;
+                // Expansion started, go help.
+                if (value & MARKED_MASK) {
+                    TABLE_STAT(stats.markedRestarts.inc(tid);)
+                    return insertIfAbsentFrom(tid, key, keyHash);
+                }   
+                TABLE_STAT(stats.casFailures.inc(tid);)
+    
+                // Another thread inserted the key
+                if (t->data[index] == key) {
+                    TABLE_STAT(stats.addProbe(tid, i + 1);)
+                    return false;
                 }
-                else {
-                    value = t->data[index];
-
-                    // Expansion started, go help.
-                    if (value & MARKED_MASK) {
-                        assert(!disableExpansion);
-                        return insertIfAbsent(tid, value |= MARKED_MASK, false);
-                    }   
-        
-                    // Another thread inserted the key
-                    else if (t->data[index] == key) {
-                        return false;
-                    }
-                }            
-            }
+            }            
         }
     }
+    TABLE_STAT(stats.addProbe(tid, t->capacity);)
     return false; // Return false if there was no space, and the key wasn't found.
 }
 
 // semantics: try to erase key. return true if successful, and false otherwise
-bool AlgorithmD::erase(const int tid, const int & key) {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    return eraseFrom(tid, key, Hash::hash(key));
+}
 
+// same as erase, but with key's hash precomputed
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::eraseFrom(const int tid, const K & key, const uint32_t keyHash) {
+    auto guard = epochs.getGuard(tid);
     table * t = currentTable.load();
+    if (migrationMode != MIGRATE_HELP_ALL) helpForKey(tid, t, key);
 
     // Generate hash that is indexed to our array.
-    uint32_t h = getHash(key, t->capacity);
-    for (uint32_t i = 0; i < t->capacity; i++) {
-        if (expandAsNeeded(tid, t, i)) return erase(tid, key); 
+    uint32_t h = indexOf(keyHash, t->capacity);
+    for (uint32_t i = 0, index = h; i < t->capacity; i++, index = probeNext(index, t->capacity)) {
+        if (expandAsNeeded(tid, t, i)) return eraseFrom(tid, key, keyHash); 
 
-        uint32_t index = (h + i) % t->capacity;
-        uint32_t value = t->data[index];
+        K value = t->data[index];
         
         // Expansion happening
-        if (value & MARKED_MASK) return erase(tid, key);
+        if (value & MARKED_MASK) {
+            TABLE_STAT(stats.markedRestarts.inc(tid);)
+            return eraseFrom(tid, key, keyHash);
+        }
         
         if(t->data[index] == 0) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
             return false;
         }
         else if(t->data[index] == key) {
             // This is returning if the CAS was successful or not.
             if (t->data[index].compare_exchange_strong(value, TOMBSTONE))  {
                 t->tombstoneCount->inc(tid);
+                TABLE_STAT(stats.addProbe(tid, i + 1);)
+                // Deletes never fill the table, so they are what has to notice it emptying out
+                // (once t is complete: while it is being filled, its counts only cover the keys migrated so far).
+                if (t->chunksDone == t->totalOldChunks
+                        && resize_policy::tooEmpty(t->approxSize->get() - t->tombstoneCount->get(), t->capacity, minCapacity())) {
+                    const uint32_t newCapacity = nextCapacity(t);
+                    if (newCapacity < t->capacity) startExpansion(tid, t, newCapacity);
+                }
                 return true;
             }
             else {
                 value = t->data[index];
                 
                 // Expansion started
-                if (value & MARKED_MASK) return erase(tid, key);
+                if (value & MARKED_MASK) {
+                    TABLE_STAT(stats.markedRestarts.inc(tid);)
+                    return eraseFrom(tid, key, keyHash);
+                }
+                TABLE_STAT(stats.casFailures.inc(tid);)
 
                 // Someone else deleted
-                else if (t->data[index] == TOMBSTONE) {
+                if (t->data[index] == TOMBSTONE) {
+                    TABLE_STAT(stats.addProbe(tid, i + 1);)
                     return false;
                 }
             }
         }
     }
+    TABLE_STAT(stats.addProbe(tid, t->capacity);)
     return false; // Return false if there was no space, and the key wasn't found.
 }
 
-// semantics: return the sum of all KEYS in the set
-int64_t AlgorithmD::getSumOfKeys() {
+// semantics: return true if key is in the set, and false otherwise
+// Wait-free: never helps a migration. While t is being filled, no operation can touch key in t until
+// every old chunk covering key's old probe range is migrated (see helpForKey), so if any of those chunks
+// is not done yet, the old table is still authoritative for key.
+// A MARKED slot is frozen, and its value was current at some point after we loaded currentTable.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    return containsFrom(tid, key, Hash::hash(key));
+}
+
+// same as contains, but with key's hash precomputed
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmD<K, Policy, Hash, Range, Alloc>::containsFrom(const int tid, const K & key, const uint32_t keyHash) {
+    auto guard = epochs.getGuard(tid);
     table * t = currentTable.load();
-    int64_t sum = 0;
-	for (int i = 0; i < t->capacity; i++) {
-        if(t->data[i] == TOMBSTONE){
+
+    if (t->chunksDone < t->totalOldChunks) {
+        bool oldIsCurrent = false;
+        bool foundInOld = false;
+        uint32_t index = indexOf(keyHash, t->oldCapacity);
+        for (uint32_t i = 0; i < t->oldCapacity; ++i) {
+            if (t->chunkState[index / CHUNK_SIZE] != CHUNK_DONE) oldIsCurrent = true;
+            K value = t->old[index] & ~MARKED_MASK;
+            if (value == EMPTY) break;
+            if (value == key) foundInOld = true;
+            index = probeNext(index, t->oldCapacity);
+        }
+        if (oldIsCurrent) return foundInOld;
+    }
+
+    uint32_t h = indexOf(keyHash, t->capacity);
+    for (uint32_t i = 0, index = h; i < t->capacity; ++i, index = probeNext(index, t->capacity)) {
+        K value = t->data[index] & ~MARKED_MASK;
+        if (value == key) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return true;
+        }
+        else if (value == EMPTY) {
+            TABLE_STAT(stats.addProbe(tid, i + 1);)
+            return false;
         }
-        else {
-		    sum += t->data[i];
+    }
+    TABLE_STAT(stats.addProbe(tid, t->capacity);)
+    return false; // The key wasn't found anywhere in the table.
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1], with results[i] = insertIfAbsent(tid, keys[i])
+// Slots are prefetched in the table that is current when the batch starts (see batch.h); if a migration
+// replaces it part way through, the remaining prefetches are just wasted.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    auto guard = epochs.getGuard(tid);  // for the prefetches into t; each operation's own guard nests in this one
+    table * t = currentTable.load();
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t keyHash) { __builtin_prefetch(&t->data[indexOf(keyHash, t->capacity)], 1); },
+            [&](const K & key, uint32_t keyHash) { return insertIfAbsentFrom(tid, key, keyHash); });
+}
+
+// semantics: erase every key in keys[0..n-1], with results[i] = erase(tid, keys[i])
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    auto guard = epochs.getGuard(tid);  // for the prefetches into t; each operation's own guard nests in this one
+    table * t = currentTable.load();
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t keyHash) { __builtin_prefetch(&t->data[indexOf(keyHash, t->capacity)], 1); },
+            [&](const K & key, uint32_t keyHash) { return eraseFrom(tid, key, keyHash); });
+}
+
+// semantics: results[i] = contains(tid, keys[i]) for every key in keys[0..n-1]
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    auto guard = epochs.getGuard(tid);  // for the prefetches into t; each operation's own guard nests in this one
+    table * t = currentTable.load();
+    runBatch<Hash>(keys, n, results,
+            [&](uint32_t keyHash) { __builtin_prefetch(&t->data[indexOf(keyHash, t->capacity)], 0); },
+            [&](const K & key, uint32_t keyHash) { return containsFrom(tid, key, keyHash); });
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1] using nthreads threads, with no other operation running.
+// The table is sized once for its live keys plus n (by the usual doubling, so it does not grow again during
+// the load), then the keys are placed by a partitioned pass without CAS (see bulk_load.h).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::bulkLoad(const K * keys, const size_t n, const int nthreads) {
+    auto guard = epochs.getGuard(maintenanceTid());
+    table * t = currentTable.load();
+    finishMigration(t);
+
+    int64_t live = t->approxSize->getAccurate() - t->tombstoneCount->getAccurate();
+    uint64_t newCapacity = t->capacity;
+    while ((uint64_t) live + n > newCapacity / resize_policy::GROW_LOAD && newCapacity * EXPANSION_SIZE <= UINT32_MAX) {
+        newCapacity *= EXPANSION_SIZE;
+    }
+    if (newCapacity != t->capacity) {
+        if (t->approxSize->getAccurate() == 0) {
+            // Nothing to migrate: replace the table with an empty one, zeroed in parallel.
+            table * newTable = new table(0, 0, newCapacity, numThreads + 2, nthreads);
+            currentTable = newTable;
+            // a background migrator may have loaded t (it polls even with no other operation running)
+            epochs.retire(t, (size_t) t->capacity * sizeof(atomic<K>));
+        } else {
+            startExpansion(maintenanceTid(), t, newCapacity);
+            finishMigration(currentTable);
         }
+        t = currentTable.load();
     }
-	return sum;
+
+    // the loading threads' ids are also the deferred inserts' thread ids, so there can be at most numThreads of them
+    int64_t placed = bulkLoadLinearProbing(keys, n, max(1, min(nthreads, numThreads)), t->capacity,
+            [&](const K & key) { return getHash(key, t->capacity); },
+            [&](uint32_t i) -> atomic<K> & { return t->data[i]; },
+            [&](const int tid, const K & key) { return insertIfAbsent(tid, key); });
+    // Deferred keys use the normal insert, which could (in principle) start a migration; that migration counts every key it moves.
+    if (currentTable.load() == t) t->approxSize->add(placed);
+}
+
+// Finish any migration that operations left behind (as maintenanceTid: bulkLoad, snapshot and scans must not overlap).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::finishMigration(table * t) {
+    if (migrationMode == MIGRATE_BACKGROUND) {
+        while (t->chunksDone < t->totalOldChunks) {}
+    } else {
+        helpExpansion(maintenanceTid(), t);
+    }
+}
+
+// semantics: call fn(tid, key) for every key in the set, splitting the (dense) slots across nthreads OpenMP threads
+// (tid is the OpenMP thread number). Weakly consistent with concurrent updates, see scan.h.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    // Finish any migration in progress first, so every key is in t. If another migration starts during the scan,
+    // t's slots are frozen (MARKED) rather than cleared, and the guard keeps t from being freed until the scan is
+    // done, so masking off MARKED_MASK still reads t's keys.
+    auto guard = epochs.getGuard(maintenanceTid());
+    table * t = currentTable.load();
+    finishMigration(t);
+    scanDense<K>(t->data, t->capacity, nthreads, TOMBSTONE, (K) ~MARKED_MASK, fn);
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmD<K, Policy, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int64_t AlgorithmD<K, Policy, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmD<K, Policy, Hash, Range, Alloc>::getCapacity() {
+    return epochs.withoutFreeing([&]() { return currentTable.load()->capacity; });
+}
+
+// bytes held by slot arrays: the current table's, the one it is still being migrated from (if any), and those of
+// replaced tables that are waiting for running operations to finish before they are freed
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+size_t AlgorithmD<K, Policy, Hash, Range, Alloc>::getMemoryBytes() {
+    const size_t bytes = epochs.withoutFreeing([&]() {
+        table * t = currentTable.load();
+        size_t result = (size_t) t->capacity * sizeof(atomic<K>);
+        if (t->oldTable && t->chunksDone < t->totalOldChunks) result += (size_t) t->oldCapacity * sizeof(atomic<K>);
+        return result;
+    });
+    return bytes + epochs.getRetiredBytes();
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmD<K, Policy, Hash, Range, Alloc>::getHash(const K & key, uint32_t capacity) {
+    return indexOf(Hash::hash(key), capacity);
 }
 
-uint32_t AlgorithmD::getHash(const int& key, uint32_t capacity) {
-    return floor(((double ) murmur3(key) / (double) UINT32_MAX) * capacity); 
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint32_t AlgorithmD<K, Policy, Hash, Range, Alloc>::indexOf(const uint32_t keyHash, uint32_t capacity) {
+    return Range::reduce(keyHash, capacity);
 }
 
 // print any debugging details you want at the end of a trial in this function
-void AlgorithmD::printDebuggingDetails() {
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmD<K, Policy, Hash, Range, Alloc>::printDebuggingDetails() {
 
     // cout << "Final Capacity is: " << currentTable.load()->capacity << endl;
     // table * t = currentTable.load();
@@ -0,0 +1,409 @@
+#pragma once
+#include "util.h"
+#include "hash_policy.h"
+#include "epoch_reclaim.h"
+#include "resize_policy.h"
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Resizable concurrent map from 63-bit keys to 64-bit values, using AlgorithmD's chunked cooperative migration.
+ *
+ * Each slot holds {key, value} in 16 bytes, and every write replaces both words at once with cmpxchg16b
+ * (build with -mcx16). A slot's key only goes EMPTY -> k -> TOMBSTONE, and the migration marks a slot by
+ * setting MARKED_MASK in its key, which freezes the value along with it.
+ *
+ * Keys are hashed and reduced to a slot with the same policies as the other tables (murmur3_hash and
+ * multiply_high_range), and a table replaced by a migration is freed through an epochReclaimer, as in AlgorithmD.
+ */
+class AlgorithmDMap {
+private:
+    typedef murmur3_hash<uint64_t> Hash;
+    typedef multiply_high_range Range;
+
+    static const uint64_t MARKED_MASK = 0x8000000000000000ULL;     // most significant bit of a 64-bit key
+    static const uint64_t TOMBSTONE = 0x7FFFFFFFFFFFFFFFULL;       // largest value that doesn't use bit MARKED_MASK
+    static const uint64_t EMPTY = 0;
+    // with these definitions, the largest "real" key we allow in the table is 0x7FFFFFFFFFFFFFFE, and the smallest is 1 !!
+
+    static const int EXPANSION_SIZE = 2;
+    static const int PROBING_AMOUNT = 100;
+    static const int CHUNK_SIZE = 4096;
+
+    struct slot {
+        volatile uint64_t key;
+        volatile uint64_t value;
+    } __attribute__((aligned(16)));
+
+    // what update() does to a key it finds (or does not find)
+    enum op_t {
+        OP_INSERT,      // insert arg if absent, otherwise leave the value alone
+        OP_UPSERT,      // insert arg if absent, otherwise overwrite the value with arg
+        OP_ADD,         // insert arg if absent, otherwise add arg to the value
+        OP_ERASE        // replace the key with TOMBSTONE if present
+    };
+
+    struct table {
+        // data types
+        char padding2[PADDING_BYTES];
+        slot * data;
+        slot * old;
+        table * oldTable;           // the table this one replaces (whose slots are old); retired once they are all migrated
+        counter * tombstoneCount;
+        counter * approxSize;
+        uint32_t capacity;
+        uint32_t oldCapacity;
+        uint32_t totalOldChunks;
+        char padding3[PADDING_BYTES];
+        atomic<uint32_t> chunksClaimed;
+        char padding4[PADDING_BYTES];
+        atomic<uint32_t> chunksDone;
+        char padding5[PADDING_BYTES];
+
+        // constructor
+        table(slot * _old, uint32_t _oldCapacity, uint32_t _capacity, int _numThreads) :
+        old(_old), oldTable(NULL), oldCapacity(_oldCapacity), capacity(_capacity), chunksClaimed(0), chunksDone(0) {
+            totalOldChunks = (oldCapacity + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            data = new slot[capacity]();
+            tombstoneCount = new counter(_numThreads);
+            approxSize = new counter(_numThreads);
+        }
+
+        ~table() {
+            delete[] data;
+            delete tombstoneCount;
+            delete approxSize;
+        }
+    };
+
+    static bool cas16(slot * s, uint64_t expKey, uint64_t expValue, uint64_t newKey, uint64_t newValue);
+    static void readSlot(slot * s, uint64_t & key, uint64_t & value);
+
+    bool expandAsNeeded(const int tid, table * t, uint32_t i);
+    void helpExpansion(const int tid, table * t);
+    void startExpansion(const int tid, table * t, uint32_t newCapacity);
+    uint32_t nextCapacity(table * t);
+    // the smallest capacity a migration may shrink to: that of the table we started with
+    uint64_t minCapacity() { return (uint64_t) initCapacity * EXPANSION_SIZE; }
+    void migrate(const int tid, table * t, uint32_t myChunk);
+    void migrateKey(const int tid, table * t, uint64_t key, uint64_t value);
+    bool update(const int tid, const uint64_t key, const op_t op, const uint64_t arg, uint64_t * oldValue);
+    // the thread id after the callers' ones, used by the whole-map sums
+    int maintenanceTid() { return numThreads; }
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    const int initCapacity;
+    char padding2[PADDING_BYTES];
+    atomic<table *> currentTable;
+    char padding3[PADDING_BYTES];
+    epochReclaimer epochs;          // frees a replaced table once no operation can still be using it
+
+public:
+    AlgorithmDMap(const int _numThreads, const int _capacity);
+    ~AlgorithmDMap();
+    bool insertIfAbsent(const int tid, const uint64_t key, const uint64_t value);
+    bool upsert(const int tid, const uint64_t key, const uint64_t value, uint64_t * oldValue);
+    uint64_t fetchAdd(const int tid, const uint64_t key, const uint64_t delta);
+    bool erase(const int tid, const uint64_t key, uint64_t * erasedValue);
+    bool get(const int tid, const uint64_t key, uint64_t * value);
+    int64_t getSumOfKeys();
+    int64_t getSumOfValues();
+    uint32_t getCapacity();
+    size_t getMemoryBytes();
+    uint32_t getHash(const uint64_t key, uint32_t capacity);
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ *
+ * The sums use one more thread id (maintenanceTid), so _numThreads+1 must be at most MAX_THREADS.
+ */
+AlgorithmDMap::AlgorithmDMap(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), initCapacity(Range::roundCapacity(_capacity)), epochs(_numThreads + 1) {
+    assert(numThreads + 1 <= MAX_THREADS);
+    currentTable = new table(0, initCapacity, initCapacity * EXPANSION_SIZE, _numThreads + 1);
+    // Initialize the chunks claimed and chunks done to a state that resembles a normal state.
+    currentTable.load()->chunksClaimed = currentTable.load()->totalOldChunks;
+    currentTable.load()->chunksDone = currentTable.load()->totalOldChunks;
+}
+
+// destructor: clean up any allocated memory, etc.
+AlgorithmDMap::~AlgorithmDMap() {
+    // a table whose migration never finished still owns the table it was replacing
+    table * t = currentTable;
+    if (t->oldTable && t->chunksDone < t->totalOldChunks) delete t->oldTable;
+    delete t;
+}
+
+bool AlgorithmDMap::cas16(slot * s, uint64_t expKey, uint64_t expValue, uint64_t newKey, uint64_t newValue) {
+    // key is the low word on x86
+    unsigned __int128 expected = ((unsigned __int128) expValue << 64) | expKey;
+    unsigned __int128 desired = ((unsigned __int128) newValue << 64) | newKey;
+    return __sync_bool_compare_and_swap((unsigned __int128 *) s, expected, desired);
+}
+
+// Consistent snapshot of a slot without writing to it. A slot never gets a second real key,
+// so if the key reads the same before and after the value, the value belongs to that key.
+void AlgorithmDMap::readSlot(slot * s, uint64_t & key, uint64_t & value) {
+    while (true) {
+        key = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+        value = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->key, __ATOMIC_ACQUIRE) == key) return;
+    }
+}
+
+// Same policy as AlgorithmD::expandAsNeeded: help any migration, then start one if the table is too full.
+bool AlgorithmDMap::expandAsNeeded(const int tid, table * t, uint32_t i) {
+    helpExpansion(tid, t);
+
+    if (resize_policy::tooFull(t->approxSize->get(), t->capacity)) {
+        startExpansion(tid, t, nextCapacity(t));
+        return true;
+    }
+    else if (i > PROBING_AMOUNT) {
+        if (resize_policy::tooFull(t->approxSize->getAccurate(), t->capacity)) {
+            startExpansion(tid, t, nextCapacity(t));
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same choice as AlgorithmD::nextCapacity (see resize_policy.h). t's migration is always finished by the time
+// this is called (every operation helps it to the end in expandAsNeeded), so its counts are complete.
+uint32_t AlgorithmDMap::nextCapacity(table * t) {
+    int64_t live = t->approxSize->getAccurate() - t->tombstoneCount->getAccurate();
+    return (uint32_t) resize_policy::nextCapacity(live, t->capacity, minCapacity());
+}
+
+void AlgorithmDMap::helpExpansion(const int tid, table * t) {
+    while (t->chunksClaimed < t->totalOldChunks) {
+        uint32_t myChunk = t->chunksClaimed++;
+        if (myChunk < t->totalOldChunks) {
+            migrate(tid, t, myChunk);
+            // the last chunk: operations that load t from now on never look at the old table again
+            if (t->chunksDone.fetch_add(1) + 1 == t->totalOldChunks && t->oldTable) {
+                epochs.retire(t->oldTable, (size_t) t->oldCapacity * sizeof(slot));
+            }
+        }
+    }
+
+    while (t->chunksDone < t->totalOldChunks) {
+        // Do nothing and just wait for the last thread to finish.
+    }
+}
+
+void AlgorithmDMap::startExpansion(const int tid, table * t, uint32_t newCapacity) {
+    table * passedTable = t;
+    table * newTable = new table(t->data, t->capacity, newCapacity, numThreads + 1);
+    newTable->oldTable = passedTable;
+
+    if (!(currentTable.compare_exchange_strong(passedTable, newTable))) {
+        delete newTable;
+    };
+
+    helpExpansion(tid, currentTable);
+}
+
+void AlgorithmDMap::migrate(const int tid, table * t, uint32_t myChunk) {
+    uint32_t startingIndex = myChunk * CHUNK_SIZE;
+    uint32_t endIndex = min(startingIndex + CHUNK_SIZE, t->oldCapacity);
+
+    for (uint32_t i = startingIndex; i < endIndex; i++) {
+        // Mark the key, which freezes the value with it.
+        uint64_t key, value;
+        do {
+            readSlot(&t->old[i], key, value);
+        } while (!cas16(&t->old[i], key, value, key | MARKED_MASK, value));
+
+        if ((key != TOMBSTONE) && (key != EMPTY)) {
+            migrateKey(tid, t, key, value);
+        }
+    }
+}
+
+// Insert a migrated pair into t. Keys are unique in the old table, and no operation uses t until
+// its migration is done, so the first EMPTY slot on the probe sequence is always ours to take.
+void AlgorithmDMap::migrateKey(const int tid, table * t, uint64_t key, uint64_t value) {
+    uint32_t h = getHash(key, t->capacity);
+    for (uint32_t i = 0, index = h; i < t->capacity; ++i, index = probeNext(index, t->capacity)) {
+        if (t->data[index].key == EMPTY && cas16(&t->data[index], EMPTY, 0, key, value)) {
+            t->approxSize->inc(tid);
+            return;
+        }
+    }
+    assert(false);
+}
+
+/**
+ * Shared probe loop for every write. Returns true if key was present (and sets *oldValue to the value it had
+ * when op took effect), and false if it was absent (in which case every op except OP_ERASE inserted arg).
+ */
+bool AlgorithmDMap::update(const int tid, const uint64_t key, const op_t op, const uint64_t arg, uint64_t * oldValue) {
+    assert(key != EMPTY && key < TOMBSTONE);
+
+    auto guard = epochs.getGuard(tid);  // restarts call back in here, and only the outermost guard counts
+    table * t = currentTable.load();
+    uint32_t index = getHash(key, t->capacity); // Generate hash that is indexed to our array.
+    for (uint32_t i = 0; i < t->capacity; ) {
+        if (expandAsNeeded(tid, t, i)) return update(tid, key, op, arg, oldValue);
+
+        uint64_t k, v;
+        readSlot(&t->data[index], k, v);
+
+        // Expansion happening
+        if (k & MARKED_MASK) {
+            return update(tid, key, op, arg, oldValue);
+        }
+
+        else if (k == key) {
+            uint64_t newKey = key;
+            uint64_t newValue = v;
+            switch (op) {
+                case OP_INSERT: break;
+                case OP_UPSERT: newValue = arg; break;
+                case OP_ADD:    newValue = v + arg; break;
+                case OP_ERASE:  newKey = TOMBSTONE; newValue = 0; break;
+            }
+            if (newKey == k && newValue == v) {
+                if (oldValue) *oldValue = v;
+                return true;
+            }
+            if (cas16(&t->data[index], k, v, newKey, newValue)) {
+                if (oldValue) *oldValue = v;
+                if (op == OP_ERASE) {
+                    t->tombstoneCount->inc(tid);
+                    // as in AlgorithmD::eraseFrom: deletes never fill the table, so they have to notice it emptying out
+                    if (resize_policy::tooEmpty(t->approxSize->get() - t->tombstoneCount->get(), t->capacity, minCapacity())) {
+                        const uint32_t newCapacity = nextCapacity(t);
+                        if (newCapacity < t->capacity) startExpansion(tid, t, newCapacity);
+                    }
+                }
+                return true;
+            }
+            // The value changed, the key was erased, or the slot was marked: look at this slot again.
+            continue;
+        }
+
+        else if (k == EMPTY) {
+            if (op == OP_ERASE) return false;
+            // Successful insert!
+            if (cas16(&t->data[index], EMPTY, 0, key, arg)) {
+                t->approxSize->inc(tid);
+                return false;
+            }
+            // Someone else took the slot (maybe with our key): look at it again.
+            continue;
+        }
+
+        ++i;
+        index = probeNext(index, t->capacity);
+    }
+    return false; // There was no space, and the key wasn't found.
+}
+
+// semantics: insert key with value if key is absent. return true if inserted, and false otherwise
+bool AlgorithmDMap::insertIfAbsent(const int tid, const uint64_t key, const uint64_t value) {
+    return !update(tid, key, OP_INSERT, value, NULL);
+}
+
+// semantics: set key's value, inserting key if needed. return true if key was inserted, and false if it was
+// already present (in which case *oldValue, if not NULL, gets the value that was overwritten)
+bool AlgorithmDMap::upsert(const int tid, const uint64_t key, const uint64_t value, uint64_t * oldValue = NULL) {
+    return !update(tid, key, OP_UPSERT, value, oldValue);
+}
+
+// semantics: atomically add delta to key's value and return the previous value.
+// an absent key is inserted with value delta (and 0 is returned), like map[key] += delta
+uint64_t AlgorithmDMap::fetchAdd(const int tid, const uint64_t key, const uint64_t delta) {
+    uint64_t oldValue = 0;
+    if (!update(tid, key, OP_ADD, delta, &oldValue)) return 0;
+    return oldValue;
+}
+
+// semantics: try to erase key. return true if successful (and set *erasedValue, if not NULL), and false otherwise
+bool AlgorithmDMap::erase(const int tid, const uint64_t key, uint64_t * erasedValue = NULL) {
+    return update(tid, key, OP_ERASE, 0, erasedValue);
+}
+
+// semantics: return true and set *value if key is present, and false otherwise
+// A MARKED slot is frozen, and its value was current at some point after we loaded currentTable.
+bool AlgorithmDMap::get(const int tid, const uint64_t key, uint64_t * value) {
+    auto guard = epochs.getGuard(tid);
+    table * t = currentTable.load();
+    helpExpansion(tid, t);
+
+    uint32_t h = getHash(key, t->capacity);
+    for (uint32_t i = 0, index = h; i < t->capacity; ++i, index = probeNext(index, t->capacity)) {
+        uint64_t k, v;
+        readSlot(&t->data[index], k, v);
+        k &= ~MARKED_MASK;
+        if (k == key) {
+            *value = v;
+            return true;
+        }
+        else if (k == EMPTY) {
+            return false;
+        }
+    }
+    return false; // The key wasn't found anywhere in the table.
+}
+
+// semantics: return the sum of all KEYS in the map
+int64_t AlgorithmDMap::getSumOfKeys() {
+    auto guard = epochs.getGuard(maintenanceTid());
+    table * t = currentTable.load();
+    helpExpansion(maintenanceTid(), t);
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        uint64_t k = t->data[i].key & ~MARKED_MASK;
+        if (k != TOMBSTONE) sum += k;
+    }
+    return sum;
+}
+
+// semantics: return the sum of all VALUES in the map (modulo 2^64)
+int64_t AlgorithmDMap::getSumOfValues() {
+    auto guard = epochs.getGuard(maintenanceTid());
+    table * t = currentTable.load();
+    helpExpansion(maintenanceTid(), t);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        uint64_t k = t->data[i].key & ~MARKED_MASK;
+        if (k != TOMBSTONE && k != EMPTY) sum += t->data[i].value;
+    }
+    return (int64_t) sum;
+}
+
+uint32_t AlgorithmDMap::getCapacity() {
+    return epochs.withoutFreeing([&]() { return currentTable.load()->capacity; });
+}
+
+// bytes held by slot arrays: the current table's, the one it is still being migrated from (if any), and those of
+// replaced tables that are waiting for running operations to finish before they are freed
+size_t AlgorithmDMap::getMemoryBytes() {
+    const size_t bytes = epochs.withoutFreeing([&]() {
+        table * t = currentTable.load();
+        size_t result = (size_t) t->capacity * sizeof(slot);
+        if (t->oldTable && t->chunksDone < t->totalOldChunks) result += (size_t) t->oldCapacity * sizeof(slot);
+        return result;
+    });
+    return bytes + epochs.getRetiredBytes();
+}
+
+uint32_t AlgorithmDMap::getHash(const uint64_t key, uint32_t capacity) {
+    return Range::reduce(Hash::hash(key), capacity);
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmDMap::printDebuggingDetails() {
+    // cout << "Final Capacity is: " << currentTable.load()->capacity << endl;
+}
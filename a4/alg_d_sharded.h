@@ -0,0 +1,264 @@
+#pragma once
+#include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "batch.h"
+#include "table_stats.h"
+#include "alg_d.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * AlgorithmD split into 2^shardBits independent shards, routed by the top shardBits bits of a key's hash.
+ *
+ * Every shard is a whole AlgorithmD, with its own current table, size counters and migrations, so a shard that
+ * fills up grows on its own: only operations on keys of that shard ever help (or wait for) its migration, and each
+ * migration copies 1/2^shardBits of the keys. Inside a shard, keys are hashed with shard_hash (see hash_policy.h),
+ * so the bits that picked the shard do not bunch the keys up in one part of the shard's slot array.
+ *
+ * Hash is computed once per operation: the shard comes from its top bits, and the shard's hash is remixed from it.
+ * With MIGRATE_BACKGROUND, one migrator thread serves every shard: it drains whichever shards are migrating, and naps
+ * only when none is (a thread per shard would mean up to 1024 threads polling, which starves the callers).
+ */
+template <typename K = uint32_t, class Policy = marked_key_policy<K>, class Hash = murmur3_hash<K>, class Range = multiply_high_range, class Alloc = heap_alloc>
+class AlgorithmDSharded {
+public:
+    typedef K key_type;
+    typedef shard_hash<K, Hash> ShardHash;
+    typedef AlgorithmD<K, Policy, ShardHash, Range, Alloc> Shard;
+    static const int MAX_SHARD_BITS = 10;
+    static constexpr int MIN_SHARD_CAPACITY = 64;    // so a shard's probes can get long enough to trigger its expansion
+
+private:
+    char padding0[PADDING_BYTES];
+    const int shardBits;
+    const int numShards;
+    Shard ** shards;
+    char padding1[PADDING_BYTES];
+    atomic<bool> stopMigrator;
+    thread * migrator;
+    char padding2[PADDING_BYTES];
+
+    int shardOf(const uint32_t h) {
+        return shardBits ? (int) (h >> (32 - shardBits)) : 0;
+    }
+    void migratorLoop();
+
+public:
+    AlgorithmDSharded(const int _numThreads, const int _capacity, const int _shardBits, const int _migrationMode = Shard::MIGRATE_HELP_ALL);
+    ~AlgorithmDSharded();
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    void bulkLoad(const K * keys, const size_t n, const int nthreads);
+    template <class Fn> void forEachKey(Fn fn, const int nthreads);
+    template <typename T, class Op> T reduce(const T identity, Op op, const int nthreads);
+    int64_t getSumOfKeys();
+    uint64_t getCapacity();
+    size_t getMemoryBytes();
+    int getNumShards();
+    Shard * getShard(const int shard);
+    void printDebuggingDetails();
+    int numThreads;
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the whole table, split evenly across the shards (each gets at least MIN_SHARD_CAPACITY)
+ * @param _shardBits log2 of the number of shards, in [0, MAX_SHARD_BITS]
+ * @param _migrationMode every shard's AlgorithmD::migration_mode_t. MIGRATE_BACKGROUND starts one migrator thread for all the shards.
+ */
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::AlgorithmDSharded(const int _numThreads, const int _capacity, const int _shardBits, const int _migrationMode)
+: shardBits(_shardBits), numShards(1 << _shardBits), stopMigrator(false), migrator(NULL), numThreads(_numThreads) {
+    assert(shardBits >= 0 && shardBits <= MAX_SHARD_BITS);
+    const int shardCapacity = max(MIN_SHARD_CAPACITY, (_capacity + numShards - 1) / numShards);
+    shards = new Shard * [numShards];
+    for (int i = 0; i < numShards; ++i) {
+        shards[i] = new Shard(numThreads, shardCapacity, _migrationMode, false);
+    }
+    if (_migrationMode == Shard::MIGRATE_BACKGROUND) {
+        migrator = new thread(&AlgorithmDSharded::migratorLoop, this);
+    }
+}
+
+// destructor: clean up any allocated memory, etc.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::~AlgorithmDSharded() {
+    if (migrator) {
+        stopMigrator = true;
+        migrator->join();
+        delete migrator;
+    }
+    for (int i = 0; i < numShards; ++i) {
+        delete shards[i];
+    }
+    delete[] shards;
+}
+
+// Body of the MIGRATE_BACKGROUND thread: sweep the shards, draining each migration in progress, and nap after a
+// sweep that found none (see AlgorithmD::migratorLoop).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::migratorLoop() {
+    while (!stopMigrator) {
+        bool migrated = false;
+        for (int i = 0; i < numShards; ++i) {
+            if (shards[i]->migrateInBackground()) migrated = true;
+        }
+        if (!migrated) {
+            timespec time_to_sleep;
+            time_to_sleep.tv_sec = 0;
+            time_to_sleep.tv_nsec = 50000;
+            nanosleep(&time_to_sleep, NULL);
+        }
+    }
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::insertIfAbsent(const int tid, const K & key) {
+    const uint32_t h = Hash::hash(key);
+    return shards[shardOf(h)]->insertIfAbsentFrom(tid, key, ShardHash::remix(h));
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::erase(const int tid, const K & key) {
+    const uint32_t h = Hash::hash(key);
+    return shards[shardOf(h)]->eraseFrom(tid, key, ShardHash::remix(h));
+}
+
+// semantics: return true if key is in the set, and false otherwise
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+bool AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::contains(const int tid, const K & key) {
+    const uint32_t h = Hash::hash(key);
+    return shards[shardOf(h)]->containsFrom(tid, key, ShardHash::remix(h));
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1], with results[i] = insertIfAbsent(tid, keys[i])
+// The keys are hashed a group at a time (see batch.h), but nothing is prefetched: the slots belong to the shards.
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [](uint32_t) {},
+            [&](const K & key, uint32_t h) { return shards[shardOf(h)]->insertIfAbsentFrom(tid, key, ShardHash::remix(h)); });
+}
+
+// semantics: erase every key in keys[0..n-1], with results[i] = erase(tid, keys[i])
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [](uint32_t) {},
+            [&](const K & key, uint32_t h) { return shards[shardOf(h)]->eraseFrom(tid, key, ShardHash::remix(h)); });
+}
+
+// semantics: results[i] = contains(tid, keys[i]) for every key in keys[0..n-1]
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    runBatch<Hash>(keys, n, results,
+            [](uint32_t) {},
+            [&](const K & key, uint32_t h) { return shards[shardOf(h)]->containsFrom(tid, key, ShardHash::remix(h)); });
+}
+
+// semantics: insertIfAbsent every key in keys[0..n-1] using nthreads threads, with no other operation running.
+// The keys are split by shard, then each shard bulk loads its own keys with all nthreads threads (see AlgorithmD::bulkLoad).
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::bulkLoad(const K * keys, const size_t n, const int nthreads) {
+    vector<vector<K>> shardKeys(numShards);
+    for (size_t i = 0; i < n; ++i) {
+        shardKeys[shardOf(Hash::hash(keys[i]))].push_back(keys[i]);
+    }
+    for (int i = 0; i < numShards; ++i) {
+        shards[i]->bulkLoad(shardKeys[i].data(), shardKeys[i].size(), nthreads);
+    }
+}
+
+// semantics: call fn(tid, key) for every key in the set, one shard after another (see AlgorithmD::forEachKey)
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <class Fn>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::forEachKey(Fn fn, const int nthreads) {
+    for (int i = 0; i < numShards; ++i) {
+        shards[i]->forEachKey(fn, nthreads);
+    }
+}
+
+// semantics: fold every key in the set with op (associative and commutative), starting from identity
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+template <typename T, class Op>
+T AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::reduce(const T identity, Op op, const int nthreads) {
+    return reduceKeys([&](auto f, const int n) { forEachKey(f, n); }, identity, op, nthreads);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int64_t AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::getSumOfKeys() {
+    return reduce((int64_t) 0, [](int64_t a, int64_t b) { return a + b; }, omp_get_max_threads());
+}
+
+// total capacity of the shards' current tables
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+uint64_t AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::getCapacity() {
+    uint64_t result = 0;
+    for (int i = 0; i < numShards; ++i) result += shards[i]->getCapacity();
+    return result;
+}
+
+// bytes held by the shards' current slot arrays
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+size_t AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::getMemoryBytes() {
+    size_t result = 0;
+    for (int i = 0; i < numShards; ++i) result += shards[i]->getMemoryBytes();
+    return result;
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+int AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::getNumShards() {
+    return numShards;
+}
+
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+typename AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::Shard * AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::getShard(const int shard) {
+    return shards[shard];
+}
+
+// print how capacity and (with TABLE_STATS) migration pauses are spread over the shards
+template <typename K, class Policy, class Hash, class Range, class Alloc>
+void AlgorithmDSharded<K, Policy, Hash, Range, Alloc>::printDebuggingDetails() {
+    vector<uint32_t> capacities(numShards);
+    for (int i = 0; i < numShards; ++i) capacities[i] = shards[i]->getCapacity();
+    sort(capacities.begin(), capacities.end());
+    cout<<"shards                : "<<numShards<<endl;
+    cout<<"shard capacity        : min "<<capacities[0]<<" median "<<capacities[numShards/2]<<" max "<<capacities[numShards-1]<<endl;
+#ifdef TABLE_STATS
+    // A shard's migration pauses are the time its operations spent in helpExpansion (see table_stats.h).
+    vector<double> pauseMillis(numShards);
+    double totalMillis = 0;
+    for (int i = 0; i < numShards; ++i) {
+        auto totals = shards[i]->stats.getTotals();
+        pauseMillis[i] = totals.helpExpansionNanos / 1000000.;
+        totalMillis += pauseMillis[i];
+        if (numShards <= 64) {
+            cout<<"    shard "<<i<<"\t: capacity "<<shards[i]->getCapacity()<<", expansions "<<totals.expansionsStarted
+                <<", helped "<<totals.expansionsHelped<<", pause millis "<<pauseMillis[i]<<endl;
+        }
+    }
+    sort(pauseMillis.begin(), pauseMillis.end());
+    cout<<"shard pause millis    : min "<<pauseMillis[0]<<" median "<<pauseMillis[numShards/2]<<" max "<<pauseMillis[numShards-1]
+        <<" total "<<totalMillis<<endl;
+#else
+    cout<<"shard pause millis    : build with make STATS=1 to measure"<<endl;
+#endif
+}
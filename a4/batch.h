@@ -0,0 +1,31 @@
+#pragma once
+#include <algorithm>
+#include <stdint.h>
+using namespace std;
+
+/**
+ * Group prefetching driver for the a4 tables' batch APIs.
+ *
+ * Keys are processed in groups of up to BATCH_GROUP_SIZE: first every key in the group is hashed and the slot
+ * it hashes to is prefetched, then each key is probed in turn. By the time a key is probed its first slot has
+ * (usually) arrived, so the cache misses of a whole group overlap instead of being paid one after another.
+ *
+ * Hash is the table's hash policy (see hash_policy.h). prefetch(h) must issue the prefetch for a key with hash h,
+ * and op(key, h) must run the operation starting from hash h and return its result.
+ */
+static const int BATCH_GROUP_SIZE = 64;
+
+template <class Hash, typename K, class PrefetchFn, class OpFn>
+void runBatch(const K * keys, const int n, bool * results, PrefetchFn prefetch, OpFn op) {
+    uint32_t hashes[BATCH_GROUP_SIZE];
+    for (int start = 0; start < n; start += BATCH_GROUP_SIZE) {
+        const int groupSize = min(BATCH_GROUP_SIZE, n - start);
+        for (int i = 0; i < groupSize; ++i) {
+            hashes[i] = Hash::hash(keys[start + i]);
+            prefetch(hashes[i]);
+        }
+        for (int i = 0; i < groupSize; ++i) {
+            results[start + i] = op(keys[start + i], hashes[i]);
+        }
+    }
+}
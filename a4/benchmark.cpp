@@ -8,16 +8,105 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <vector>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "util.h"
+#include "key_policy.h"
+#include "hash_policy.h"
+#include "slot_alloc.h"
+#include "perf_counters.h"
+#include "table_stats.h"
 #include "alg_a.h"
 #include "alg_b.h"
 #include "alg_c.h"
 #include "alg_d.h"
+#include "alg_c_phase.h"
+#include "alg_d_sharded.h"
+#include "alg_chained.h"
+#include "bloom_filter.h"
 
 using namespace std;
 
+// Hash, range-reduction and slot allocation policies for every algorithm, fixed at compile time
+// (see hash_policy.h and slot_alloc.h), e.g. make HASH=crc32c_hash RANGE=pow2_range ALLOC=hugepage_alloc
+#ifndef BENCH_HASH
+#define BENCH_HASH murmur3_hash
+#endif
+#ifndef BENCH_RANGE
+#define BENCH_RANGE multiply_high_range
+#endif
+#ifndef BENCH_ALLOC
+#define BENCH_ALLOC heap_alloc
+#endif
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+template <typename K> using BenchA = AlgorithmA<K, plain_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchB = AlgorithmB<K, marked_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchC = AlgorithmC<K, plain_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchD = AlgorithmD<K, marked_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchDSharded = AlgorithmDSharded<K, marked_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchChained = AlgorithmChained<K, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+template <typename K> using BenchCPhase = AlgorithmCPhase<K, plain_key_policy<K>, BENCH_HASH<K>, BENCH_RANGE, BENCH_ALLOC>;
+
+// AlgorithmD migration mode selected with -mig (ignored by the other algorithms)
+int migrationMode = AlgorithmD<>::MIGRATE_HELP_ALL;
+
+// log2 of the number of shards of AlgorithmDSharded, selected with -shards
+int shardBits = 4;
+
+// count dTLB misses and page faults during the timed part of runExperiment (-perf)
+bool countPerfEvents = false;
+
+// put a blockedBloomFilter in front of the table in runExperiment (-bloom)
+bool useBloomFilter = false;
+
+// contains() draws its keys from [1, lookupRangeSize] (-sL; 0 means -sR). A range larger than -sR makes most lookups miss
+int lookupRangeSize = 0;
+
+// before the timed part of runExperiment, insert each key of the key range with probability 1/2 (-prefill)
+bool prefill = false;
+
+template <class T> struct isBloomFiltered : false_type {};
+template <class Table> struct isBloomFiltered<bloomFiltered<Table>> : true_type {};
+
+#ifdef TABLE_STATS
+// the table's statistics, or NULL for the algorithms that do not keep any
+template <class DataStructureType>
+tableStats * statsOf(DataStructureType * ds) {
+    typedef typename DataStructureType::key_type K;
+    if constexpr (is_same<DataStructureType, BenchC<K>>::value || is_same<DataStructureType, BenchD<K>>::value
+            || is_same<DataStructureType, BenchChained<K>>::value) {
+        return &ds->stats;
+    } else {
+        return NULL;
+    }
+}
+#endif
+
+template <class DataStructureType>
+DataStructureType * createDataStructure(int totalThreads, int tableSize) {
+    if constexpr (isBloomFiltered<DataStructureType>::value) {
+        typedef typename DataStructureType::table_type Table;
+        return new DataStructureType(totalThreads, tableSize, createDataStructure<Table>(totalThreads, tableSize));
+    } else if constexpr (is_same<DataStructureType, BenchD<typename DataStructureType::key_type>>::value) {
+        return new DataStructureType(totalThreads, tableSize, migrationMode);
+    } else if constexpr (is_same<DataStructureType, BenchDSharded<typename DataStructureType::key_type>>::value) {
+        return new DataStructureType(totalThreads, tableSize, shardBits, migrationMode);
+    } else {
+        return new DataStructureType(totalThreads, tableSize);
+    }
+}
+
+// Map a key index in [1, 2^31) to a key of type K. 64-bit keys repeat the index in the high half,
+// so they exercise the high bits and stay below every sentinel.
+template <typename K> K makeKey(uint32_t index);
+template <> uint32_t makeKey<uint32_t>(uint32_t index) { return index; }
+template <> uint64_t makeKey<uint64_t>(uint32_t index) { return ((uint64_t) index << 32) | index; }
+
 template <class DataStructureType>
 struct globals_t {
     PaddedRandom rngs[MAX_THREADS];
@@ -35,17 +124,21 @@ struct globals_t {
     DataStructureType * ds;
     debugCounter numTotalOps;   // already has padding built in at the beginning and end
     debugCounter keyChecksum;
+    latencyHistogram * latencies; // NULL unless per-op latencies are being measured
     int millisToRun;
     int totalThreads;
     int keyRangeSize;
     int tableSize;
     volatile char padding7[PADDING_BYTES];
+    size_t garbage;             // sink for contains() results, so the calls are not optimized out
+    volatile char padding8[PADDING_BYTES];
     
-    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, DataStructureType * _ds) {
+    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, DataStructureType * _ds, bool measureLatency = false) {
         for (int i=0;i<MAX_THREADS;++i) {
             rngs[i].setSeed(i+1); // +1 because we don't want thread 0 to get a seed of 0, since seeds of 0 usually mean all random numbers are zero...
         }
         elapsedMillis = 0;
+        garbage = 0;
         done = false;
         start = false;
         running = 0;
@@ -54,9 +147,11 @@ struct globals_t {
         totalThreads = _totalThreads;
         keyRangeSize = _keyRangeSize;
         tableSize = _tableSize;
+        latencies = measureLatency ? new latencyHistogram(_totalThreads) : NULL;
     }
     ~globals_t() {
         delete ds;
+        if (latencies) delete latencies;
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
@@ -66,11 +161,38 @@ void printUpdatedThroughput(auto g, int64_t elapsedNow) {
     cout<<elapsedNow <<"ms: "<<(opsNow * 1000 / elapsedNow)<<" throughput"<<endl;
 }
 
+void printLatencyPercentiles(latencyHistogram * latencies) {
+    cout<<"latency p50 (ns)      : "<<latencies->getPercentile(0.5)<<endl;
+    cout<<"latency p99 (ns)      : "<<latencies->getPercentile(0.99)<<endl;
+    cout<<"latency p99.9 (ns)    : "<<latencies->getPercentile(0.999)<<endl;
+    cout<<"latency p99.99 (ns)   : "<<latencies->getPercentile(0.9999)<<endl;
+    cout<<"latency max (ns)      : "<<latencies->getMax()<<endl;
+}
+
 template <class DataStructureType>
-void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads) {
+void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent, bool measureLatency, int batchSize) {
     // create globals struct that all threads will access (with padding to prevent false sharing on control logic meta data)
-    auto dataStructure = new DataStructureType(totalThreads, tableSize);
-    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure);
+    ElapsedTimer constructionTimer;
+    constructionTimer.startTimer();
+    auto dataStructure = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    auto constructionMillis = constructionTimer.getElapsedMillis();
+    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure, measureLatency);
+    // must exist before the threads are created, so they inherit the counters
+    perfCounters * perf = countPerfEvents ? new perfCounters() : NULL;
+    const int lookupRange = lookupRangeSize ? lookupRangeSize : keyRangeSize;
+
+    if (prefill) {
+        // about the steady state of equal inserts and deletes, so the timed part starts with a full table
+        ElapsedTimer prefillTimer;
+        prefillTimer.startTimer();
+        PaddedRandom rng(12345);
+        for (int index = 1; index <= keyRangeSize; ++index) {
+            if (rng.nextNatural() & 1) continue;
+            auto key = makeKey<typename DataStructureType::key_type>(index);
+            if (g->ds->insertIfAbsent(0, key)) g->keyChecksum.add(0, key);
+        }
+        cout<<"prefill millis        : "<<prefillTimer.getElapsedMillis()<<endl;
+    }
     
     /**
      * 
@@ -83,6 +205,10 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     for (int tid=0;tid<g->totalThreads;++tid) {
         threads[tid] = new thread([&, tid]() { /* access all variables by reference, except tid, which we copy (since we don't want our tid to be a reference to the changing loop variable) */
                 const int OPS_BETWEEN_TIME_CHECKS = 500; // only check the current time (to see if we should stop) once every X operations, to amortize the overhead of time checking
+                size_t garbage = 0; // will prevent contains() calls from being optimized out
+                const int keysPerOp = max(1, batchSize);
+                auto keys = new typename DataStructureType::key_type[keysPerOp];
+                auto results = new bool[keysPerOp];
 
                 // BARRIER WAIT
                 g->running.fetch_add(1);
@@ -97,27 +223,58 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
 
                     VERBOSE if (cnt&&((cnt % 1000000) == 0)) TPRINT("op# "<<cnt);
                     
-                    // flip a coin to decide: insert or erase?
-                    // generate a random double in [0, 1]
-                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max();
+                    // decide: insert, erase or contains?
+                    // generate a random double in [0, 100]
+                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max() * 100;
                     //cout<<"operationType="<<operationType<<endl;
                     
-                    // generate random key
-                    int key = 1 + (g->rngs[tid].nextNatural() % g->keyRangeSize);
+                    // generate random key(s)
+                    const int range = (operationType < insertPercent + deletePercent) ? g->keyRangeSize : lookupRange;
+                    for (int j=0;j<keysPerOp;++j) {
+                        keys[j] = makeKey<typename DataStructureType::key_type>(1 + (g->rngs[tid].nextNatural() % range));
+                    }
+                    auto key = keys[0];
                     
-                    // insert or delete this key
-                    if (operationType < 0.5) {
-                        auto result = g->ds->insertIfAbsent(tid, key);
-                        if (result) g->keyChecksum.add(tid, key);
+                    std::chrono::time_point<std::chrono::steady_clock> opStart;
+                    if (g->latencies) opStart = std::chrono::steady_clock::now();
+                    
+                    if (batchSize == 0) {
+                        // insert, delete or look up this key
+                        if (operationType < insertPercent) {
+                            auto result = g->ds->insertIfAbsent(tid, key);
+                            if (result) g->keyChecksum.add(tid, key);
+                        } else if (operationType < insertPercent + deletePercent) {
+                            auto result = g->ds->erase(tid, key);
+                            if (result) g->keyChecksum.add(tid, -(long long) key);
+                        } else {
+                            auto result = g->ds->contains(tid, key);
+                            garbage += result; // "use" the return value of contains, so contains isn't optimized out
+                        }
                     } else {
-                        auto result = g->ds->erase(tid, key);
-                        if (result) g->keyChecksum.add(tid, -key);
+                        // insert, delete or look up the whole batch (one operation type per batch)
+                        if (operationType < insertPercent) {
+                            g->ds->insertIfAbsentBatch(tid, keys, batchSize, results);
+                            for (int j=0;j<batchSize;++j) if (results[j]) g->keyChecksum.add(tid, keys[j]);
+                        } else if (operationType < insertPercent + deletePercent) {
+                            g->ds->eraseBatch(tid, keys, batchSize, results);
+                            for (int j=0;j<batchSize;++j) if (results[j]) g->keyChecksum.add(tid, -(long long) keys[j]);
+                        } else {
+                            g->ds->containsBatch(tid, keys, batchSize, results);
+                            for (int j=0;j<batchSize;++j) garbage += results[j];
+                        }
                     }
                     
-                    g->numTotalOps.inc(tid);
+                    if (g->latencies) {
+                        auto opNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - opStart).count();
+                        g->latencies->add(tid, opNanos);
+                    }
+                    g->numTotalOps.add(tid, keysPerOp);
                 }
+                delete[] keys;
+                delete[] results;
                 
                 g->running.fetch_add(-1);
+                __sync_fetch_and_add(&g->garbage, garbage); // "use" the return values of all contains
                 TPRINT("terminated");
         });
     }
@@ -128,6 +285,7 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     
     printf("main thread: starting timer...\n");
     g->timer.startTimer();
+    if (perf) perf->start();
     __asm__ __volatile__ ("" ::: "memory"); // prevent compiler from reordering "start = true;" before the timer start; this is mostly paranoia, since start is volatile, and nothing should be reordered around volatile reads/writes (by the *compiler*)
     
     g->start = true; // release all threads from the barrier, so they can work
@@ -137,6 +295,12 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     // wait for all threads to stop working,
     // and print throughput update every 1s
     
+#ifdef TABLE_STATS
+    // with TABLE_STATS, also print what each second's ops did (their statistics minus the previous second's)
+    auto stats = statsOf(g->ds);
+    tableStatsTotals lastStats;
+    if (stats) lastStats = stats->getTotals();
+#endif
     int64_t lastTime = 0;
     while (g->running > 0) {
         // sleep for 0.1s
@@ -149,6 +313,13 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
         auto elapsedNow = g->timer.getElapsedMillis();
         if (elapsedNow % 1000 < 100) {
             printUpdatedThroughput(g, elapsedNow);
+#ifdef TABLE_STATS
+            if (stats) {
+                auto statsNow = stats->getTotals();
+                (statsNow - lastStats).printLine(elapsedNow);
+                lastStats = statsNow;
+            }
+#endif
         }
         lastTime = elapsedNow;
     }
@@ -166,6 +337,7 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
         threads[tid]->join();
         delete threads[tid];
     }
+    if (perf) perf->stop();
     
     /**
      * 
@@ -196,22 +368,506 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     cout<<"total completed ops   : "<<numTotalOps<<endl;
     cout<<"throughput            : "<<(long long) (numTotalOps * 1000. / g->elapsedMillis)<<endl;
     cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<"construction millis   : "<<constructionMillis<<endl;
+    if (g->latencies) printLatencyPercentiles(g->latencies);
+#ifdef TABLE_STATS
+    if (stats) stats->getTotals().printSummary(numTotalOps);
+#endif
+    if (perf) {
+        perf->print(numTotalOps);
+        delete perf;
+    }
     cout<<endl;
     
     delete g;
 }
 
+/**
+ * Delete-heavy run for algorithms that can shrink (AlgorithmD):
+ *   phase 0: threads insert every key in [1, keyRangeSize] (striped by tid),
+ *   phase 1: threads delete 90% of those keys (every key not divisible by 10),
+ *   phase 2: threads run the usual 50/50 insert/erase mix for millisToRun.
+ * Capacity, slot array memory and throughput are printed every second and at each phase change.
+ */
+template <class DataStructureType>
+void runShrinkExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads) {
+    auto dataStructure = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure);
+    atomic_int phase(0);
+    atomic_int threadsDoneWithPhase(0);
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+                g->running.fetch_add(1);
+                while (!g->start) { TRACE TPRINT("waiting to start"); }
+
+                // phase 0: insert our stripe of the key range
+                for (int index = 1+tid; index <= g->keyRangeSize; index += g->totalThreads) {
+                    auto key = makeKey<typename DataStructureType::key_type>(index);
+                    if (g->ds->insertIfAbsent(tid, key)) g->keyChecksum.add(tid, key);
+                    g->numTotalOps.inc(tid);
+                }
+                if (threadsDoneWithPhase.fetch_add(1) == g->totalThreads-1) phase = 1;
+                while (phase < 1) {}
+
+                // phase 1: delete 90% of our stripe
+                for (int index = 1+tid; index <= g->keyRangeSize; index += g->totalThreads) {
+                    if (index % 10 == 0) continue;
+                    auto key = makeKey<typename DataStructureType::key_type>(index);
+                    if (g->ds->erase(tid, key)) g->keyChecksum.add(tid, -(long long) key);
+                    g->numTotalOps.inc(tid);
+                }
+                if (threadsDoneWithPhase.fetch_add(1) == 2*g->totalThreads-1) phase = 2;
+                while (phase < 2) {}
+
+                // phase 2: random mix until the main thread says stop
+                while (!g->done) {
+                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max();
+                    auto key = makeKey<typename DataStructureType::key_type>(1 + (g->rngs[tid].nextNatural() % g->keyRangeSize));
+                    if (operationType < 0.5) {
+                        if (g->ds->insertIfAbsent(tid, key)) g->keyChecksum.add(tid, key);
+                    } else {
+                        if (g->ds->erase(tid, key)) g->keyChecksum.add(tid, -(long long) key);
+                    }
+                    g->numTotalOps.inc(tid);
+                }
+
+                g->running.fetch_add(-1);
+        });
+    }
+
+    while (g->running < g->totalThreads) {}
+    g->timer.startTimer();
+    __asm__ __volatile__ ("" ::: "memory");
+    g->start = true;
+    __sync_synchronize();
+
+    int lastPhase = -1;
+    int64_t lastPrint = 0;
+    int64_t lastOps = 0;
+    int64_t phase2Start = -1;
+    while (g->running > 0) {
+        timespec time_to_sleep;
+        time_to_sleep.tv_sec = 0;
+        time_to_sleep.tv_nsec = 100000000;
+        nanosleep(&time_to_sleep, NULL);
+
+        auto elapsedNow = g->timer.getElapsedMillis();
+        int phaseNow = phase;
+        if (phaseNow == 2 && phase2Start < 0) phase2Start = elapsedNow;
+        if (phase2Start >= 0 && elapsedNow - phase2Start >= g->millisToRun) g->done = true;
+
+        if (phaseNow != lastPhase || elapsedNow - lastPrint >= 1000) {
+            auto opsNow = g->numTotalOps.getTotal();
+            auto intervalMillis = max((int64_t) 1, elapsedNow - lastPrint);
+            cout<<elapsedNow<<"ms: phase="<<phaseNow
+                <<" capacity="<<g->ds->getCapacity()
+                <<" bytes="<<g->ds->getMemoryBytes()
+                <<" throughput="<<((opsNow - lastOps) * 1000 / intervalMillis)<<endl;
+            lastPhase = phaseNow;
+            lastPrint = elapsedNow;
+            lastOps = opsNow;
+        }
+    }
+    g->elapsedMillis = g->timer.getElapsedMillis();
+
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    ElapsedTimer scanTimer;
+    scanTimer.startTimer();
+    auto dsSumOfKeys = g->ds->getSumOfKeys();
+    auto scanMillis = scanTimer.getElapsedMillis();
+    auto threadsSumOfKeys = g->keyChecksum.getTotal();
+    cout<<"Validation: sum of keys according to the data structure = "<<dsSumOfKeys<<" and sum of keys according to the threads = "<<threadsSumOfKeys<<".";
+    cout<<((threadsSumOfKeys == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+    cout<<endl;
+    if (threadsSumOfKeys != dsSumOfKeys) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    cout<<"final capacity        : "<<g->ds->getCapacity()<<endl;
+    cout<<"final slot bytes      : "<<g->ds->getMemoryBytes()<<endl;
+    cout<<"getSumOfKeys millis   : "<<scanMillis<<endl;
+    cout<<"total completed ops   : "<<g->numTotalOps.getTotal()<<endl;
+    cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<endl;
+
+    delete g;
+}
+
+/**
+ * Load keys 1..numKeys into an empty table twice, with totalThreads threads each time:
+ * once with bulkLoad, and once by calling insertIfAbsent on a striped share of the keys from each thread.
+ * Prints both load times (neither includes building the key array) and validates both tables.
+ */
+template <class DataStructureType>
+void runBulkLoadExperiment(int numKeys, int tableSize, int totalThreads) {
+    typedef typename DataStructureType::key_type K;
+    K * keys = new K[numKeys];
+    int64_t expectedSum = 0;
+    #pragma omp parallel for reduction(+:expectedSum)
+    for (int i = 0; i < numKeys; ++i) {
+        keys[i] = makeKey<K>(1 + i);
+        expectedSum += keys[i];
+    }
+
+    auto validate = [&](DataStructureType * ds, const char * name) {
+        auto dsSumOfKeys = ds->getSumOfKeys();
+        cout<<"Validation ("<<name<<"): sum of keys according to the data structure = "<<dsSumOfKeys<<" and expected sum = "<<expectedSum<<".";
+        cout<<((expectedSum == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+        if (expectedSum != dsSumOfKeys) {
+            cout<<"ERROR: validation failed!"<<endl;
+            exit(-1);
+        }
+    };
+
+    // bulkLoad
+    auto ds = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    ElapsedTimer timer;
+    timer.startTimer();
+    ds->bulkLoad(keys, numKeys, totalThreads);
+    auto bulkMillis = timer.getElapsedMillis();
+    validate(ds, "bulkLoad");
+    delete ds;
+
+    // repeated insertIfAbsent
+    ds = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    thread * threads[MAX_THREADS];
+    timer.startTimer();
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+                for (int i = tid; i < numKeys; i += totalThreads) {
+                    ds->insertIfAbsent(tid, keys[i]);
+                }
+        });
+    }
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+    auto insertMillis = timer.getElapsedMillis();
+    validate(ds, "insertIfAbsent");
+    delete ds;
+    cout<<endl;
+
+    cout<<"keys loaded           : "<<numKeys<<endl;
+    cout<<"bulkLoad millis       : "<<bulkMillis<<endl;
+    cout<<"insertIfAbsent millis : "<<insertMillis<<endl;
+    cout<<"speedup               : "<<(insertMillis / (double) max((int64_t) 1, bulkMillis))<<endl;
+    cout<<endl;
+    delete[] keys;
+}
+
+template <class DataStructureType>
+DataStructureType * openDataStructure(const char * path, int totalThreads) {
+    if constexpr (is_same<DataStructureType, BenchD<typename DataStructureType::key_type>>::value) {
+        return DataStructureType::open(path, totalThreads, migrationMode);
+    } else {
+        return DataStructureType::open(path, totalThreads);
+    }
+}
+
+/**
+ * Compare two ways of getting a table of keys 1..numKeys ready to serve queries:
+ * a bulk reload (bulkLoad into a new table), and opening a snapshot of that table written to path
+ * (after evicting the file from the page cache, so open() starts cold).
+ * Each is timed up to and including its first contains(); then 1M random lookups are timed on each table,
+ * since the mapped table still faults pages in as the lookups touch them. Validates the opened table.
+ */
+template <class DataStructureType>
+void runSnapshotExperiment(int numKeys, int tableSize, int totalThreads, const char * path) {
+    typedef typename DataStructureType::key_type K;
+    const int NUM_LOOKUPS = 1000000;
+    K * keys = new K[numKeys];
+    int64_t expectedSum = 0;
+    #pragma omp parallel for reduction(+:expectedSum)
+    for (int i = 0; i < numKeys; ++i) {
+        keys[i] = makeKey<K>(1 + i);
+        expectedSum += keys[i];
+    }
+    K * lookups = new K[NUM_LOOKUPS];
+    PaddedRandom rng;
+    rng.setSeed(1);
+    for (int i = 0; i < NUM_LOOKUPS; ++i) {
+        lookups[i] = keys[rng.nextNatural() % numKeys];
+    }
+    auto timeLookups = [&](DataStructureType * ds) {
+        ElapsedTimer timer;
+        timer.startTimer();
+        int found = 0;
+        for (int i = 0; i < NUM_LOOKUPS; ++i) {
+            found += ds->contains(0, lookups[i]);
+        }
+        auto millis = timer.getElapsedMillis();
+        if (found != NUM_LOOKUPS) {
+            cout<<"ERROR: only "<<found<<" of "<<NUM_LOOKUPS<<" lookups found their key"<<endl;
+            exit(-1);
+        }
+        return millis;
+    };
+
+    // bulk reload
+    ElapsedTimer timer;
+    timer.startTimer();
+    auto ds = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    ds->bulkLoad(keys, numKeys, totalThreads);
+    ds->contains(0, keys[0]);
+    auto reloadMillis = timer.getElapsedMillis();
+    auto reloadLookupMillis = timeLookups(ds);
+
+    timer.startTimer();
+    if (!ds->snapshot(path)) exit(-1);
+    auto snapshotMillis = timer.getElapsedMillis();
+    delete ds;
+
+    // write the file back and drop it from the page cache, so open() has to read it from disk
+    int fd = ::open(path, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    // open
+    timer.startTimer();
+    ds = openDataStructure<DataStructureType>(path, totalThreads);
+    if (!ds) exit(-1);
+    ds->contains(0, keys[0]);
+    auto openMillis = timer.getElapsedMillis();
+    auto openLookupMillis = timeLookups(ds);
+
+    auto dsSumOfKeys = ds->getSumOfKeys();
+    cout<<"Validation (open): sum of keys according to the data structure = "<<dsSumOfKeys<<" and expected sum = "<<expectedSum<<".";
+    cout<<((expectedSum == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+    if (expectedSum != dsSumOfKeys) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+    delete ds;
+    cout<<endl;
+
+    cout<<"keys loaded           : "<<numKeys<<endl;
+    cout<<"snapshot millis       : "<<snapshotMillis<<endl;
+    cout<<"reload first query ms : "<<reloadMillis<<endl;
+    cout<<"open first query ms   : "<<openMillis<<endl;
+    cout<<"reload 1M lookups ms  : "<<reloadLookupMillis<<endl;
+    cout<<"open 1M lookups ms    : "<<openLookupMillis<<endl;
+    cout<<endl;
+    delete[] keys;
+    delete[] lookups;
+}
+
+/**
+ * Phased run: with totalThreads threads per phase, and the threads joined between phases,
+ *   insert phase: insert keyRangeSize random keys from [1, keyRangeSize],
+ *   erase phase: erase keyRangeSize/2 random keys,
+ *   lookup phase: look up keyRangeSize random keys.
+ * The keys are the same for every run (fixed seed), whatever the thread count. Prints each phase's time and
+ * throughput, and validates the final set and the number of lookups that hit. For AlgorithmCPhase, also prints
+ * a hash of the final slot layout, which is the same for every run (compare runs with different -t).
+ */
+template <class DataStructureType>
+void runPhasedExperiment(int keyRangeSize, int tableSize, int totalThreads) {
+    typedef typename DataStructureType::key_type K;
+    const int numInserts = keyRangeSize;
+    const int numErases = keyRangeSize / 2;
+    const int numLookups = keyRangeSize;
+    K * inserts = new K[numInserts];
+    K * erases = new K[numErases];
+    K * lookups = new K[numLookups];
+    PaddedRandom rng;
+    rng.setSeed(1);
+    for (int i = 0; i < numInserts; ++i) inserts[i] = makeKey<K>(1 + rng.nextNatural() % keyRangeSize);
+    for (int i = 0; i < numErases; ++i) erases[i] = makeKey<K>(1 + rng.nextNatural() % keyRangeSize);
+    for (int i = 0; i < numLookups; ++i) lookups[i] = makeKey<K>(1 + rng.nextNatural() % keyRangeSize);
+
+    // the expected outcome, computed sequentially
+    vector<bool> present(keyRangeSize + 1, false);
+    for (int i = 0; i < numInserts; ++i) present[inserts[i] & 0xFFFFFFFF] = true;
+    for (int i = 0; i < numErases; ++i) present[erases[i] & 0xFFFFFFFF] = false;
+    int64_t expectedSum = 0;
+    for (int k = 1; k <= keyRangeSize; ++k) if (present[k]) expectedSum += makeKey<K>(k);
+    int64_t expectedHits = 0;
+    for (int i = 0; i < numLookups; ++i) expectedHits += present[lookups[i] & 0xFFFFFFFF];
+
+    auto ds = createDataStructure<DataStructureType>(totalThreads, tableSize);
+    atomic<int64_t> hits(0);
+
+    // run op(tid, key) on keys[0..n-1], split into one contiguous block per thread, and print the phase's time
+    auto runPhase = [&](const char * name, const K * keys, const int n, auto op) {
+        ElapsedTimer timer;
+        timer.startTimer();
+        thread * threads[MAX_THREADS];
+        for (int tid=0;tid<totalThreads;++tid) {
+            threads[tid] = new thread([&, tid]() {
+                    const int end = (int64_t) n * (tid + 1) / totalThreads;
+                    for (int i = (int64_t) n * tid / totalThreads; i < end; ++i) op(tid, keys[i]);
+            });
+        }
+        for (int tid=0;tid<totalThreads;++tid) {
+            threads[tid]->join();
+            delete threads[tid];
+        }
+        auto millis = timer.getElapsedMillis();
+        cout<<name<<" millis\t: "<<millis<<" ("<<(int64_t) (n * 1000. / max((int64_t) 1, millis))<<" ops/s)"<<endl;
+    };
+    runPhase("insert phase", inserts, numInserts, [&](const int tid, const K & key) { ds->insertIfAbsent(tid, key); });
+    runPhase("erase phase ", erases, numErases, [&](const int tid, const K & key) { ds->erase(tid, key); });
+    runPhase("lookup phase", lookups, numLookups, [&](const int tid, const K & key) {
+            if (ds->contains(tid, key)) hits.fetch_add(1, memory_order_relaxed); });
+
+    auto dsSumOfKeys = ds->getSumOfKeys();
+    cout<<"Validation: sum of keys according to the data structure = "<<dsSumOfKeys<<" and expected sum = "<<expectedSum
+            <<", lookup hits = "<<hits<<" and expected hits = "<<expectedHits<<".";
+    const bool ok = dsSumOfKeys == expectedSum && hits == expectedHits;
+    cout<<(ok ? " OK." : " FAILED.")<<endl;
+    if (!ok) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+    if constexpr (is_same<DataStructureType, BenchCPhase<K>>::value) {
+        cout<<"layout hash           : "<<ds->getLayoutHash()<<endl;
+    }
+    cout<<endl;
+    delete ds;
+    delete[] inserts;
+    delete[] erases;
+    delete[] lookups;
+}
+
+// runExperiment on the table, or (with -bloom) on the table behind a blockedBloomFilter
+template <class DataStructureType>
+void runExperimentMaybeFiltered(int keyRangeSize, int tableSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent, bool measureLatency, int batchSize) {
+    if (useBloomFilter) {
+        runExperiment<bloomFiltered<DataStructureType>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    } else {
+        runExperiment<DataStructureType>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+}
+
+// run the selected algorithm with key type K. returns main's exit code
+template <typename K>
+int runAlgorithm(const char * alg, bool shrink, int keyRangeSize, int tableSize, int millisToRun, int totalThreads,
+        double insertPercent, double deletePercent, bool measureLatency, int batchSize, int bulkKeys, const char * snapPath, bool phased) {
+    if (phased) {
+        // neither table grows, so it must be able to hold every key
+        if (tableSize <= keyRangeSize) {
+            cout<<"-phased needs -sT larger than -sR"<<endl;
+            return 1;
+        }
+        if (!strcmp(alg, "C")) runPhasedExperiment<BenchC<K>>(keyRangeSize, tableSize, totalThreads);
+        else if (!strcmp(alg, "CP")) runPhasedExperiment<BenchCPhase<K>>(keyRangeSize, tableSize, totalThreads);
+        else {
+            cout<<"-phased is only supported for algorithms C and CP"<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (snapPath) {
+        if (bulkKeys <= 0) {
+            cout<<"-snap needs -bulk to give the number of keys"<<endl;
+            return 1;
+        }
+        if (!strcmp(alg, "C") && tableSize <= bulkKeys) {
+            cout<<"-snap needs -sT larger than the number of keys for algorithm C"<<endl;
+            return 1;
+        }
+        if (!strcmp(alg, "C")) runSnapshotExperiment<BenchC<K>>(bulkKeys, tableSize, totalThreads, snapPath);
+        else if (!strcmp(alg, "D")) runSnapshotExperiment<BenchD<K>>(bulkKeys, tableSize, totalThreads, snapPath);
+        else {
+            cout<<"-snap is only supported for algorithms C and D"<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (bulkKeys > 0) {
+        // A, B and C never grow, so their table must be able to hold every key
+        if (strcmp(alg, "D") && strcmp(alg, "DS") && tableSize <= bulkKeys) {
+            cout<<"-bulk needs -sT larger than the number of keys for algorithms A, B and C"<<endl;
+            return 1;
+        }
+        if (!strcmp(alg, "A")) runBulkLoadExperiment<BenchA<K>>(bulkKeys, tableSize, totalThreads);
+        else if (!strcmp(alg, "B")) runBulkLoadExperiment<BenchB<K>>(bulkKeys, tableSize, totalThreads);
+        else if (!strcmp(alg, "C")) runBulkLoadExperiment<BenchC<K>>(bulkKeys, tableSize, totalThreads);
+        else if (!strcmp(alg, "D")) runBulkLoadExperiment<BenchD<K>>(bulkKeys, tableSize, totalThreads);
+        else if (!strcmp(alg, "DS")) runBulkLoadExperiment<BenchDSharded<K>>(bulkKeys, tableSize, totalThreads);
+        else {
+            cout<<"Bad algorithm name: "<<alg<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (shrink) {
+        if (strcmp(alg, "D")) {
+            cout<<"-shrink is only supported for algorithm D"<<endl;
+            return 1;
+        }
+        runShrinkExperiment<BenchD<K>>(keyRangeSize, tableSize, millisToRun, totalThreads);
+        return 0;
+    }
+    
+    // run experiment for the selected algorithm
+    if (!strcmp(alg, "A")) {
+        runExperimentMaybeFiltered<BenchA<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+	else if (!strcmp(alg, "B")) {
+         runExperimentMaybeFiltered<BenchB<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+	else if (!strcmp(alg, "C")) {
+         runExperimentMaybeFiltered<BenchC<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+	else if (!strcmp(alg, "D")) {
+         runExperimentMaybeFiltered<BenchD<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+	else if (!strcmp(alg, "DS")) {
+         runExperimentMaybeFiltered<BenchDSharded<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+	else if (!strcmp(alg, "CH")) {
+         runExperimentMaybeFiltered<BenchChained<K>>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize);
+    }
+ 	else {
+        cout<<"Bad algorithm name: "<<alg<<endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
     if (argc == 1) {
         cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
         cout<<"Options:"<<endl;
-        cout<<"    -a  [string]   [a]lgorithm name in { A, B, C, D }"<<endl;
+        cout<<"    -a  [string]   [a]lgorithm name in { A, B, C, D, DS, CH } (DS: D split into shards, CH: lock-free chaining with -sT buckets)"<<endl;
         cout<<"    -sT [int]      size of initial hash [T]able"<<endl;
         cout<<"    -m  [int]      [m]illiseconds to run"<<endl;
         cout<<"    -sR [int]      size of the key [R]ange that random keys will be drawn from (i.e., range [1, s])"<<endl;
         cout<<"    -t  [int]      number of [t]hreads that will perform inserts and deletes"<<endl;
+        cout<<"    -i  [double]   percent of operations that will be insert (default 50)"<<endl;
+        cout<<"    -d  [double]   percent of operations that will be delete (default 50); the rest are contains"<<endl;
+        cout<<"    -shrink        insert the whole key range, delete 90% of it, then run for -m ms (algorithm D only)"<<endl;
+        cout<<"    -mig [string]  algorithm D migration mode in { help, budget, background } (default help)"<<endl;
+        cout<<"    -shards [int]  algorithm DS uses 2^shards shards (default 4)"<<endl;
+        cout<<"    -lat           measure per-call latency (per batch with -b) and print percentiles"<<endl;
+        cout<<"    -k  [int]      key width in bits, 32 or 64 (default 32)"<<endl;
+        cout<<"    -b  [int]      use the batch APIs with this many keys per call (default 0: one key per call)"<<endl;
+        cout<<"    -bulk [int]    time loading this many keys with bulkLoad and with insertIfAbsent, then exit"<<endl;
+        cout<<"    -snap [path]   with -bulk: time a bulk reload and opening a snapshot written to path, to the first query (C and D)"<<endl;
+        cout<<"    -phased        run insert, erase and lookup phases of -sR random keys each (C, and CP: phase-concurrent C)"<<endl;
+        cout<<"    -perf          count dTLB misses and page faults per op (needs perf_event_open access)"<<endl;
+        cout<<"    -bloom         put a blocked Bloom filter in front of the table (answers most lookup misses alone)"<<endl;
+        cout<<"    -sL [int]      size of the key range that contains() draws keys from (default -sR; larger means more misses)"<<endl;
+        cout<<"    -prefill       insert half of the key range before timing"<<endl;
         cout<<endl;
         cout<<"Example: "<<argv[0]<<" -a D -m 10000 -sT 1000 -sR 1000000 -t 16"<<endl;
+        cout<<"Read-mostly: "<<argv[0]<<" -a D -m 10000 -sT 1000 -sR 1000000 -t 16 -i 5 -d 5"<<endl;
+        cout<<"Bulk load: "<<argv[0]<<" -a D -sT 1000 -t 16 -bulk 100000000"<<endl;
+        cout<<"Snapshot: "<<argv[0]<<" -a D -sT 1000 -t 16 -bulk 10000000 -snap /tmp/d.snap"<<endl;
+        cout<<"Phased: "<<argv[0]<<" -a CP -sT 20000000 -sR 10000000 -t 16 -phased"<<endl;
+        cout<<"Miss-heavy: "<<argv[0]<<" -a D -m 10000 -sT 1000 -sR 1000000 -sL 20000000 -t 16 -i 5 -d 5 -prefill -bloom"<<endl;
         return 1;
     }
     
@@ -220,6 +876,16 @@ int main(int argc, char** argv) {
     int keyRangeSize = 0;
     int totalThreads = 0;
     char * alg = NULL;
+    double insertPercent = 50;
+    double deletePercent = 50;
+    bool shrink = false;
+    bool measureLatency = false;
+    int keyBits = 32;
+    int batchSize = 0;
+    int bulkKeys = 0;
+    char * snapPath = NULL;
+    bool phased = false;
+    char * mig = (char *) "help";
     
     // read command line args
     for (int i=1;i<argc;++i) {
@@ -231,8 +897,38 @@ int main(int argc, char** argv) {
             totalThreads = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-m") == 0) {
             millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            insertPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            deletePercent = atof(argv[++i]);
         } else if (strcmp(argv[i], "-a") == 0) {
             alg = argv[++i];
+        } else if (strcmp(argv[i], "-shrink") == 0) {
+            shrink = true;
+        } else if (strcmp(argv[i], "-shards") == 0) {
+            shardBits = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-mig") == 0) {
+            mig = argv[++i];
+        } else if (strcmp(argv[i], "-lat") == 0) {
+            measureLatency = true;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            keyBits = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-bulk") == 0) {
+            bulkKeys = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-snap") == 0) {
+            snapPath = argv[++i];
+        } else if (strcmp(argv[i], "-phased") == 0) {
+            phased = true;
+        } else if (strcmp(argv[i], "-perf") == 0) {
+            countPerfEvents = true;
+        } else if (strcmp(argv[i], "-bloom") == 0) {
+            useBloomFilter = true;
+        } else if (strcmp(argv[i], "-sL") == 0) {
+            lookupRangeSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-prefill") == 0) {
+            prefill = true;
         } else {
             cout<<"bad arguments"<<endl;
             exit(1);
@@ -252,12 +948,35 @@ int main(int argc, char** argv) {
     PRINT(keyRangeSize);
     PRINT(tableSize);
     PRINT(totalThreads);
+    PRINT(insertPercent);
+    PRINT(deletePercent);
     PRINT(alg);
+    PRINT(shrink);
+    PRINT(mig);
+    PRINT(shardBits);
+    PRINT(measureLatency);
+    PRINT(keyBits);
+    PRINT(batchSize);
+    PRINT(bulkKeys);
+    cout<<"snapPath="<<(snapPath ? snapPath : "")<<endl;
+    PRINT(phased);
+    cout<<"hashPolicy="<<TO_STRING(BENCH_HASH)<<endl;
+    cout<<"rangePolicy="<<TO_STRING(BENCH_RANGE)<<endl;
+    cout<<"allocPolicy="<<TO_STRING(BENCH_ALLOC)<<endl;
+    PRINT(countPerfEvents);
+    PRINT(useBloomFilter);
+    PRINT(lookupRangeSize);
+    PRINT(prefill);
+#ifdef TABLE_STATS
+    cout<<"tableStats=1"<<endl;
+#else
+    cout<<"tableStats=0"<<endl;
+#endif
     cout<<endl;
     
-    // check for too large thread count
-    if (totalThreads >= MAX_THREADS) {
-        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+    // check for too large thread count (AlgorithmD keeps two thread ids after the workers' for its own use)
+    if (totalThreads + 2 > MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" + 2 > MAX_THREADS="<<MAX_THREADS<<std::endl;
         return 1;
     }
     
@@ -267,23 +986,27 @@ int main(int argc, char** argv) {
         return 1;
     }
     
-    // run experiment for the selected algorithm
-    if (!strcmp(alg, "A")) {
-        runExperiment<AlgorithmA>(keyRangeSize, tableSize, millisToRun, totalThreads);
-    }
-	else if (!strcmp(alg, "B")) {
-         runExperiment<AlgorithmB>(keyRangeSize, tableSize, millisToRun, totalThreads);
-    }
-	else if (!strcmp(alg, "C")) {
-         runExperiment<AlgorithmC>(keyRangeSize, tableSize, millisToRun, totalThreads);
-    }
-	else if (!strcmp(alg, "D")) {
-         runExperiment<AlgorithmD>(keyRangeSize, tableSize, millisToRun, totalThreads);
+    if (shardBits < 0 || shardBits > AlgorithmDSharded<>::MAX_SHARD_BITS) {
+        cout<<"-shards must be in [0, "<<AlgorithmDSharded<>::MAX_SHARD_BITS<<"]"<<endl;
+        return 1;
     }
- 	else {
-        cout<<"Bad algorithm name: "<<alg<<endl;
+    
+    if (!strcmp(mig, "help")) {
+        migrationMode = AlgorithmD<>::MIGRATE_HELP_ALL;
+    } else if (!strcmp(mig, "budget")) {
+        migrationMode = AlgorithmD<>::MIGRATE_BUDGET;
+    } else if (!strcmp(mig, "background")) {
+        migrationMode = AlgorithmD<>::MIGRATE_BACKGROUND;
+    } else {
+        cout<<"Bad migration mode: "<<mig<<endl;
         return 1;
     }
     
-    return 0;
+    if (keyBits == 32) {
+        return runAlgorithm<uint32_t>(alg, shrink, keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize, bulkKeys, snapPath, phased);
+    } else if (keyBits == 64) {
+        return runAlgorithm<uint64_t>(alg, shrink, keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, measureLatency, batchSize, bulkKeys, snapPath, phased);
+    }
+    cout<<"Bad key width: "<<keyBits<<endl;
+    return 1;
 }
@@ -0,0 +1,280 @@
+#pragma once
+#include "util.h"
+#include "epoch_reclaim.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdint.h>
+using namespace std;
+
+/**
+ * Concurrent cache-line-blocked Bloom filter (split-block layout, as in Parquet and Impala).
+ *
+ * A key's 64-bit hash picks one 64-byte block (8 words) with its top 32 bits, and one bit in EACH word of that
+ * block with its low 32 bits (multiplied by a different odd constant per word). So add() sets k = 8 bits with at
+ * most 8 fetch_or's to one cache line, and mayContain() tests them with 8 loads from that line.
+ * Bits are never cleared: a filter only answers "definitely absent" or "maybe present".
+ */
+class blockedBloomFilter {
+public:
+    static const int WORDS_PER_BLOCK = 8;
+    static const int BITS_PER_KEY = 12;     // about 0.3% false positives at the sized-for load
+private:
+    struct block {
+        atomic<uint64_t> words[WORDS_PER_BLOCK];
+        block() {
+            for (int i = 0; i < WORDS_PER_BLOCK; ++i) words[i].store(0, memory_order_relaxed);
+        }
+    } __attribute__((aligned(PADDING_BYTES)));
+
+    block * blocks;
+    uint32_t numBlocks;
+    uint64_t keysSizedFor;
+
+    static uint64_t bitOf(const uint32_t h, const int word) {
+        static const uint32_t SALT[WORDS_PER_BLOCK] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+        return 1ULL << ((h * SALT[word]) >> 26);
+    }
+    block & blockOf(const uint64_t h) {
+        return blocks[((h >> 32) * numBlocks) >> 32];
+    }
+public:
+    // a filter with about 0.3% false positives once it holds expectedKeys keys
+    blockedBloomFilter(const uint64_t expectedKeys) : keysSizedFor(max((uint64_t) 1, expectedKeys)) {
+        numBlocks = (uint32_t) min((uint64_t) UINT32_MAX, max((uint64_t) 1, (keysSizedFor * BITS_PER_KEY + 511) / 512));
+        blocks = new block[numBlocks];
+    }
+    ~blockedBloomFilter() {
+        delete[] blocks;
+    }
+    void add(const uint64_t h) {
+        block & b = blockOf(h);
+        for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+            const uint64_t bit = bitOf((uint32_t) h, i);
+            // skip the write (and the cache line invalidation) if the bit is already set
+            if (!(b.words[i].load(memory_order_relaxed) & bit)) b.words[i].fetch_or(bit, memory_order_release);
+        }
+    }
+    bool mayContain(const uint64_t h) {
+        block & b = blockOf(h);
+        uint64_t result = 1;
+        for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+            result &= (b.words[i].load(memory_order_acquire) & bitOf((uint32_t) h, i)) != 0;
+        }
+        return result;
+    }
+    void prefetch(const uint64_t h) {
+        __builtin_prefetch(&blockOf(h), 0);
+    }
+    uint64_t getKeysSizedFor() { return keysSizedFor; }
+    size_t getMemoryBytes() { return (size_t) numBlocks * sizeof(block); }
+};
+
+/**
+ * Any a4 table with a blockedBloomFilter in front of it, so that contains() of an absent key usually costs one
+ * cache line instead of a probe sequence.
+ *
+ * insertIfAbsent adds the key to the filter BEFORE inserting it into the table, so the filter never gives a false
+ * negative for a key in the table. erase leaves the key's bits set, so deletes (and growth past the size the filter
+ * was built for) slowly raise the false positive rate. When the live keys exceed what the filter was sized for, or
+ * erases since the last rebuild exceed half of it, the next update to notice REGENERATES the filter: it builds a new
+ * filter (sized for twice the live keys) from a scan of the table, then swaps it in. While the new filter is being
+ * built, inserts add their keys to both filters, and the scan only starts after every insert that might have missed
+ * the new filter has finished (each thread announces its inserts with an odd/even counter), so no key is lost.
+ * The rebuilding thread scans alone (worker threads must not start OpenMP teams), and pauses while it does.
+ * Every operation runs inside an epochs guard, so a replaced filter is freed once the operations that could have
+ * loaded it have finished (see epoch_reclaim.h).
+ */
+template <class Table>
+class bloomFiltered {
+public:
+    typedef Table table_type;
+    typedef typename Table::key_type key_type;
+    typedef key_type K;
+private:
+    struct PaddedAnnounce {
+        atomic<uint64_t> v;
+        char padding[PADDING_BYTES - sizeof(atomic<uint64_t>)];
+    };
+
+    char padding0[PADDING_BYTES];
+    Table * table;
+    const int numThreads;
+    char padding1[PADDING_BYTES];
+    atomic<blockedBloomFilter *> filter;
+    atomic<blockedBloomFilter *> nextFilter;    // non-NULL while a rebuild is building it
+    char padding2[PADDING_BYTES];
+    atomic<bool> rebuilding;
+    char padding3[PADDING_BYTES];
+    PaddedAnnounce inserting[MAX_THREADS];      // odd while thread tid is in insertIfAbsent
+    counter inserted;                           // successful inserts (the live keys are inserted - erased)
+    counter erased;                             // successful erases
+    atomic<int64_t> erasedAtRebuild;                  // erased when the current filter was built
+    epochReclaimer epochs;                      // frees a replaced filter once no operation can still be reading it
+    debugCounter lookups;
+    debugCounter filterRejects;                 // lookups the filter answered alone
+    debugCounter falsePositives;                // lookups the filter passed that missed in the table
+    debugCounter rebuilds;
+
+    static uint64_t hashOf(const K & key) {
+        return murmur3fmix64((uint64_t) key);
+    }
+    void rebuildIfNeeded(const int tid);
+    void rebuild(const int tid);
+
+public:
+    bloomFiltered(const int _numThreads, const uint64_t expectedKeys, Table * _table);
+    ~bloomFiltered();
+    bool insertIfAbsent(const int tid, const K & key);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    void insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results);
+    void eraseBatch(const int tid, const K * keys, const int n, bool * results);
+    void containsBatch(const int tid, const K * keys, const int n, bool * results);
+    int64_t getSumOfKeys();
+    Table * getTable();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: wrap _table (which from now on belongs to this object, and must be empty)
+ *
+ * @param _numThreads maximum number of threads that will ever use the table (as for the a4 tables)
+ * @param expectedKeys the number of keys the first filter is sized for (it is rebuilt bigger as needed)
+ */
+template <class Table>
+bloomFiltered<Table>::bloomFiltered(const int _numThreads, const uint64_t expectedKeys, Table * _table)
+: table(_table), numThreads(_numThreads), filter(new blockedBloomFilter(expectedKeys)), nextFilter(NULL), rebuilding(false),
+  inserted(_numThreads), erased(_numThreads), erasedAtRebuild(0), epochs(_numThreads) {
+    for (int i = 0; i < MAX_THREADS; ++i) inserting[i].v.store(0, memory_order_relaxed);
+}
+
+// destructor: clean up any allocated memory, etc.
+template <class Table>
+bloomFiltered<Table>::~bloomFiltered() {
+    delete table;
+    delete filter.load();
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+template <class Table>
+bool bloomFiltered<Table>::insertIfAbsent(const int tid, const K & key) {
+    auto guard = epochs.getGuard(tid);
+    const uint64_t h = hashOf(key);
+    inserting[tid].v.fetch_add(1);      // odd: a rebuild that publishes nextFilter from now on waits for us
+    // nextFilter before filter: a rebuild swaps filter before clearing nextFilter, so we see the new filter in one of them
+    blockedBloomFilter * next = nextFilter.load();
+    filter.load()->add(h);
+    if (next) next->add(h);
+    const bool result = table->insertIfAbsent(tid, key);
+    inserting[tid].v.fetch_add(1, memory_order_release);
+    if (result) {
+        inserted.inc(tid);
+        rebuildIfNeeded(tid);
+    }
+    return result;
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+template <class Table>
+bool bloomFiltered<Table>::erase(const int tid, const K & key) {
+    auto guard = epochs.getGuard(tid);
+    if (!filter.load()->mayContain(hashOf(key))) return false;
+    const bool result = table->erase(tid, key);
+    if (result) {
+        erased.inc(tid);
+        rebuildIfNeeded(tid);
+    }
+    return result;
+}
+
+// semantics: return true if key is in the set, and false otherwise
+template <class Table>
+bool bloomFiltered<Table>::contains(const int tid, const K & key) {
+    auto guard = epochs.getGuard(tid);
+    lookups.inc(tid);
+    if (!filter.load()->mayContain(hashOf(key))) {
+        filterRejects.inc(tid);
+        return false;
+    }
+    const bool result = table->contains(tid, key);
+    if (!result) falsePositives.inc(tid);
+    return result;
+}
+
+template <class Table>
+void bloomFiltered<Table>::insertIfAbsentBatch(const int tid, const K * keys, const int n, bool * results) {
+    for (int i = 0; i < n; ++i) results[i] = insertIfAbsent(tid, keys[i]);
+}
+
+template <class Table>
+void bloomFiltered<Table>::eraseBatch(const int tid, const K * keys, const int n, bool * results) {
+    for (int i = 0; i < n; ++i) results[i] = erase(tid, keys[i]);
+}
+
+// semantics: results[i] = contains(tid, keys[i]); every key's filter block is prefetched before any is tested
+template <class Table>
+void bloomFiltered<Table>::containsBatch(const int tid, const K * keys, const int n, bool * results) {
+    auto guard = epochs.getGuard(tid);
+    blockedBloomFilter * f = filter.load();
+    for (int i = 0; i < n; ++i) f->prefetch(hashOf(keys[i]));
+    for (int i = 0; i < n; ++i) results[i] = contains(tid, keys[i]);
+}
+
+// The counts are approximate (per-thread counts are only folded in every so often), which is all a trigger needs.
+template <class Table>
+void bloomFiltered<Table>::rebuildIfNeeded(const int tid) {
+    const int64_t sizedFor = filter.load()->getKeysSizedFor();
+    const int64_t erasedNow = erased.get();
+    if (inserted.get() - erasedNow <= sizedFor && erasedNow - erasedAtRebuild <= sizedFor / 2) return;
+    bool expected = false;
+    if (rebuilding.load() || !rebuilding.compare_exchange_strong(expected, true)) return;
+    rebuild(tid);
+    rebuilding.store(false);
+}
+
+template <class Table>
+void bloomFiltered<Table>::rebuild(const int tid) {
+    blockedBloomFilter * old = filter.load();
+    const int64_t erasedNow = erased.getAccurate();
+    blockedBloomFilter * next = new blockedBloomFilter(2 * max((int64_t) 1, inserted.getAccurate() - erasedNow));
+    nextFilter.store(next);
+    // wait for every insert that may have read nextFilter before we set it (and so only added its key to old)
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        const uint64_t seen = inserting[i].v.load();
+        if (seen & 1) {
+            while (inserting[i].v.load() == seen) {}
+        }
+    }
+    // every key inserted before now is in the table, and every later insert adds its key to next
+    table->forEachKey([&](const int, const K & key) { next->add(hashOf(key)); }, 1);
+    filter.store(next);
+    nextFilter.store(NULL);
+    erasedAtRebuild = erasedNow;    // only the rebuilding thread writes it
+    epochs.retire(old, old->getMemoryBytes());
+    rebuilds.inc(tid);
+}
+
+// semantics: return the sum of all KEYS in the set
+template <class Table>
+int64_t bloomFiltered<Table>::getSumOfKeys() {
+    return table->getSumOfKeys();
+}
+
+template <class Table>
+Table * bloomFiltered<Table>::getTable() {
+    return table;
+}
+
+template <class Table>
+void bloomFiltered<Table>::printDebuggingDetails() {
+    table->printDebuggingDetails();
+    const double numLookups = max(1LL, lookups.getTotal());
+    const long long misses = filterRejects.getTotal() + falsePositives.getTotal();
+    cout<<"bloom filter bytes    : "<<filter.load()->getMemoryBytes()<<" (sized for "<<filter.load()->getKeysSizedFor()<<" keys)"<<endl;
+    cout<<"retired filter bytes  : "<<epochs.getRetiredBytes()<<endl;
+    cout<<"bloom filter rebuilds : "<<rebuilds.getTotal()<<endl;
+    cout<<"lookups rejected      : "<<(100. * filterRejects.getTotal() / numLookups)<<"%"<<endl;
+    cout<<"false positive rate   : "<<(100. * falsePositives.getTotal() / max(1LL, misses))<<"% of lookup misses"<<endl;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <omp.h>
+using namespace std;
+
+/**
+ * Parallel bulk loading for the a4 linear-probing tables.
+ *
+ * The slot array is split into nthreads contiguous regions, and the keys are partitioned (in parallel) by the
+ * region their home slot falls in. Thread r then places the keys of region r with plain stores: it is the only
+ * thread that handles keys whose home is in region r and the only one that writes slots of region r, so no CAS
+ * or lock is needed, and a duplicate key is always found by the usual probe (every copy of a key goes to the
+ * same thread). A key whose probe would run past the end of its region is deferred, and every deferred key is
+ * inserted afterwards with the table's normal insertIfAbsent.
+ *
+ * home(key) returns the key's home slot (the tables probe forward from it, wrapping at capacity);
+ * slot(i) returns the atomic<K> that holds slot i;
+ * insert(tid, key) is the table's (thread-safe) insertIfAbsent.
+ *
+ * Returns the number of keys placed by the partitioned pass; keys added by insert() are accounted for by insert().
+ * Must not run concurrently with any other operation on the table.
+ */
+template <typename K, class HomeFn, class SlotFn, class InsertFn>
+int64_t bulkLoadLinearProbing(const K * keys, const size_t n, int nthreads, const uint32_t capacity,
+        HomeFn home, SlotFn slot, InsertFn insert) {
+    if (n == 0) return 0;
+    nthreads = max(1, min(nthreads, MAX_THREADS - 1));
+    const int buckets = nthreads;                   // one bucket per region
+    const uint64_t regionSize = ((uint64_t) capacity + buckets - 1) / buckets;
+
+    vector<size_t> offsets((size_t) nthreads * buckets, 0);    // offsets[tid*buckets + b]
+    vector<size_t> bucketStart(buckets + 1, 0);
+    vector<vector<K>> deferred(nthreads);
+    K * partitioned = new K[n];
+    int64_t placed = 0;
+
+    #pragma omp parallel num_threads(nthreads) reduction(+:placed)
+    {
+        const int tid = omp_get_thread_num();
+        const size_t begin = n * tid / nthreads;
+        const size_t end = n * (tid + 1) / nthreads;
+        auto bucketOf = [&](const K & key) { return (int) (home(key) / regionSize); };
+
+        // count our slice of the input by bucket
+        for (size_t i = begin; i < end; ++i) {
+            ++offsets[(size_t) tid*buckets + bucketOf(keys[i])];
+        }
+        #pragma omp barrier
+
+        // exclusive prefix sum in bucket-major order, so the keys of each bucket end up contiguous
+        #pragma omp single
+        {
+            size_t sum = 0;
+            for (int b = 0; b < buckets; ++b) {
+                bucketStart[b] = sum;
+                for (int t = 0; t < nthreads; ++t) {
+                    size_t count = offsets[(size_t) t*buckets + b];
+                    offsets[(size_t) t*buckets + b] = sum;
+                    sum += count;
+                }
+            }
+            bucketStart[buckets] = sum;
+        }
+
+        // scatter our slice into its buckets
+        for (size_t i = begin; i < end; ++i) {
+            partitioned[offsets[(size_t) tid*buckets + bucketOf(keys[i])]++] = keys[i];
+        }
+        #pragma omp barrier
+
+        // place the keys of region tid; only this thread writes slots [lo, hi)
+        const uint64_t lo = tid * regionSize;
+        const uint64_t hi = min((uint64_t) capacity, lo + regionSize);
+        for (size_t i = bucketStart[tid]; i < bucketStart[tid+1]; ++i) {
+            const K key = partitioned[i];
+            uint64_t index = home(key);
+            for (; index < hi; ++index) {
+                K value = slot(index).load(memory_order_relaxed);
+                if (value == key) break;
+                if (value == 0) { // Empty
+                    slot(index).store(key, memory_order_relaxed);
+                    ++placed;
+                    break;
+                }
+            }
+            if (index == hi) deferred[tid].push_back(key);
+        }
+        #pragma omp barrier
+
+        // keys that overflowed their region go through the normal insert
+        for (auto & key : deferred[tid]) {
+            insert(tid, key);
+        }
+    }
+
+    delete[] partitioned;
+    return placed;
+}
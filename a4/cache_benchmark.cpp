@@ -0,0 +1,289 @@
+/**
+ * A Zipfian read-through benchmark for concurrent caches (AlgorithmCCache).
+ *
+ * Every op looks a key up in the cache. On a miss, the thread "reads the backing store" (busy-waits for the miss
+ * penalty and computes the key's value) and puts the value in the cache. A fraction of ops are writes, which put
+ * the key's value directly. A key's value is always valueOf(key), so any other value read from the cache is a bug.
+ */
+
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+#include <cmath>
+#include <time.h>
+
+#include "util.h"
+#include "alg_c_cache.h"
+
+using namespace std;
+
+static uint64_t valueOf(const uint64_t key) {
+    return murmur3fmix64(key);
+}
+
+/**
+ * Zipfian ranks in [0, n) with skew theta (not 1): rank r is drawn with probability proportional to 1/(r+1)^theta.
+ * Computes zeta(n) once (in parallel), then each draw costs a pow (Gray et al., "Quickly generating billion-record
+ * synthetic databases", as in YCSB). Shared by every thread: next() only reads it.
+ */
+class zipfianGenerator {
+private:
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double halfPowTheta;
+public:
+    zipfianGenerator(const uint64_t _n, const double _theta) : n(_n), theta(_theta) {
+        double sum = 0;
+        #pragma omp parallel for reduction(+:sum)
+        for (uint64_t i = 1; i <= n; ++i) sum += 1. / pow((double) i, theta);
+        zetan = sum;
+        const double zeta2 = 1. + pow(0.5, theta);
+        alpha = 1. / (1. - theta);
+        eta = (1. - pow(2. / n, 1. - theta)) / (1. - zeta2 / zetan);
+        halfPowTheta = pow(0.5, theta);
+    }
+    // u is uniform in [0, 1]
+    uint64_t next(const double u) {
+        const double uz = u * zetan;
+        if (uz < 1.) return 0;
+        if (uz < 1. + halfPowTheta) return 1;
+        return min(n - 1, (uint64_t) (n * pow(eta * u - eta + 1., alpha)));
+    }
+};
+
+template <class DataStructureType>
+struct globals_t {
+    PaddedRandom rngs[MAX_THREADS];
+    volatile char padding0[PADDING_BYTES];
+    ElapsedTimer timer;
+    volatile char padding1[PADDING_BYTES];
+    long elapsedMillis;
+    volatile char padding2[PADDING_BYTES];
+    volatile bool done;
+    volatile char padding3[PADDING_BYTES];
+    volatile bool start;        // used for a custom barrier implementation (should threads start yet?)
+    volatile char padding4[PADDING_BYTES];
+    atomic_int running;         // used for a custom barrier implementation (how many threads are waiting?)
+    volatile char padding5[PADDING_BYTES];
+    DataStructureType * ds;
+    zipfianGenerator * zipf;
+    debugCounter numTotalOps;   // already has padding built in at the beginning and end
+    debugCounter wrongValues;   // gets that returned something other than valueOf(key)
+    int millisToRun;
+    int totalThreads;
+    int keyRangeSize;
+    int tableSize;
+    volatile char padding7[PADDING_BYTES];
+
+    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, DataStructureType * _ds, zipfianGenerator * _zipf) {
+        for (int i=0;i<MAX_THREADS;++i) {
+            rngs[i].setSeed(i+1); // +1 because we don't want thread 0 to get a seed of 0, since seeds of 0 usually mean all random numbers are zero...
+        }
+        elapsedMillis = 0;
+        done = false;
+        start = false;
+        running = 0;
+        ds = _ds;
+        zipf = _zipf;
+        millisToRun = _millisToRun;
+        totalThreads = _totalThreads;
+        keyRangeSize = _keyRangeSize;
+        tableSize = _tableSize;
+    }
+    ~globals_t() {
+        delete ds;
+        delete zipf;
+    }
+} __attribute__((aligned(PADDING_BYTES)));
+
+// stand-in for reading the backing store: busy-wait for penaltyNanos
+static void missPenalty(const int penaltyNanos) {
+    if (penaltyNanos <= 0) return;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() < penaltyNanos) {}
+}
+
+template <class DataStructureType>
+void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads, double theta, double writePercent, int penaltyNanos) {
+    auto dataStructure = new DataStructureType(totalThreads, tableSize);
+    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure,
+            new zipfianGenerator(keyRangeSize, theta));
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+                const int OPS_BETWEEN_TIME_CHECKS = 500;
+
+                // BARRIER WAIT
+                g->running.fetch_add(1);
+                while (!g->start) { TRACE TPRINT("waiting to start"); }
+
+                for (int cnt=0; !g->done; ++cnt) {
+                    if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0
+                        && g->timer.getElapsedMillis() >= g->millisToRun) {
+                            g->done = true;
+                            __sync_synchronize();
+                    }
+
+                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max() * 100;
+                    double u = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max();
+                    uint64_t key = 1 + g->zipf->next(u);
+
+                    if (operationType < writePercent) {
+                        g->ds->put(tid, key, valueOf(key));
+                    } else {
+                        uint64_t value;
+                        if (g->ds->get(tid, key, &value)) {
+                            if (value != valueOf(key)) g->wrongValues.inc(tid);
+                        } else {
+                            missPenalty(penaltyNanos);
+                            g->ds->put(tid, key, valueOf(key));
+                        }
+                    }
+
+                    g->numTotalOps.inc(tid);
+                }
+
+                g->running.fetch_add(-1);
+        });
+    }
+
+    while (g->running < g->totalThreads) {
+        TRACE printf("main thread: waiting for threads to START running=%d\n", g->running.load());
+    }
+
+    printf("main thread: starting timer...\n");
+    g->timer.startTimer();
+    __asm__ __volatile__ ("" ::: "memory");
+    g->start = true;
+    __sync_synchronize();
+
+    while (g->running > 0) {
+        timespec time_to_sleep;
+        time_to_sleep.tv_sec = 0;
+        time_to_sleep.tv_nsec = 100000000;
+        nanosleep(&time_to_sleep, NULL);
+    }
+    g->elapsedMillis = g->timer.getElapsedMillis();
+
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    // every entry must hold its key's value, and no key may be in the cache twice
+    long long badEntries = 0;
+    long long duplicates = 0;
+    long long entries = 0;
+    unordered_set<uint64_t> seen;
+    g->ds->forEachEntry([&](uint64_t key, uint64_t value) {
+        ++entries;
+        if (value != valueOf(key)) ++badEntries;
+        if (!seen.insert(key).second) ++duplicates;
+    });
+    auto wrongValues = g->wrongValues.getTotal();
+    cout<<"Validation: "<<entries<<" entries, "<<badEntries<<" with a wrong value, "<<duplicates<<" duplicate keys, "
+        <<wrongValues<<" gets returned a wrong value.";
+    cout<<((badEntries == 0 && duplicates == 0 && wrongValues == 0 && entries == g->ds->getSize()) ? " OK." : " FAILED.")<<endl;
+    cout<<endl;
+
+    if (badEntries || duplicates || wrongValues || entries != g->ds->getSize()) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    auto numTotalOps = g->numTotalOps.getTotal();
+    auto hits = g->ds->getHits();
+    auto misses = g->ds->getMisses();
+    g->ds->printDebuggingDetails();
+    cout<<"hits                  : "<<hits<<endl;
+    cout<<"misses                : "<<misses<<endl;
+    cout<<"hit ratio             : "<<(hits / (double) max(1LL, hits + misses))<<endl;
+    cout<<"total completed ops   : "<<numTotalOps<<endl;
+    cout<<"throughput            : "<<(long long) (numTotalOps * 1000. / g->elapsedMillis)<<endl;
+    cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<endl;
+
+    delete g;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
+        cout<<"Options:"<<endl;
+        cout<<"    -sT [int]      number of cache slots (it holds about 75% as many entries)"<<endl;
+        cout<<"    -m  [int]      [m]illiseconds to run"<<endl;
+        cout<<"    -sR [int]      size of the key [R]ange that Zipfian keys will be drawn from (i.e., range [1, s])"<<endl;
+        cout<<"    -t  [int]      number of [t]hreads"<<endl;
+        cout<<"    -z  [double]   Zipfian skew theta, not 1 (default 0.99; 0 is uniform)"<<endl;
+        cout<<"    -w  [double]   percent of operations that put without reading first (default 0)"<<endl;
+        cout<<"    -p  [int]      miss penalty: nanoseconds a miss spends \"reading the backing store\" (default 0)"<<endl;
+        cout<<endl;
+        cout<<"Example: "<<argv[0]<<" -m 10000 -sT 100000 -sR 10000000 -t 16 -z 0.99 -p 1000"<<endl;
+        return 1;
+    }
+
+    int millisToRun = -1;
+    int tableSize = 0;
+    int keyRangeSize = 0;
+    int totalThreads = 0;
+    double theta = 0.99;
+    double writePercent = 0;
+    int penaltyNanos = 0;
+
+    for (int i=1;i<argc;++i) {
+        if (strcmp(argv[i], "-sT") == 0) {
+            tableSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-sR") == 0) {
+            keyRangeSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            totalThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-z") == 0) {
+            theta = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            writePercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            penaltyNanos = atoi(argv[++i]);
+        } else {
+            cout<<"bad arguments"<<endl;
+            exit(1);
+        }
+    }
+
+    std::cout<<"Cmd:";
+    for (int i=0;i<argc;++i) {
+        std::cout<<" "<<argv[i];
+    }
+    std::cout<<std::endl;
+
+    PRINT(MAX_THREADS);
+    PRINT(millisToRun);
+    PRINT(keyRangeSize);
+    PRINT(tableSize);
+    PRINT(totalThreads);
+    PRINT(theta);
+    PRINT(writePercent);
+    PRINT(penaltyNanos);
+    cout<<endl;
+
+    if (totalThreads >= MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+        return 1;
+    }
+    if (theta == 1 || keyRangeSize < 2) {
+        cout<<"need -z other than 1 and -sR of at least 2"<<endl;
+        return 1;
+    }
+
+    runExperiment<AlgorithmCCache>(keyRangeSize, tableSize, millisToRun, totalThreads, theta, writePercent, penaltyNanos);
+    return 0;
+}
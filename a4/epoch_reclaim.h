@@ -0,0 +1,144 @@
+#pragma once
+#include "util.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Epoch-based reclamation for the few, large objects that a table replaces wholesale (e.g. AlgorithmD's old table
+ * once its migration is done). a6's record manager (DEBRA) suits the many small nodes of AlgorithmChained, but it
+ * frees retired records a block at a time, so an object retired every few seconds would wait for hundreds more.
+ * Here a retired object is freed as soon as every operation that could still hold it has finished.
+ *
+ * Each thread id announces the global epoch while it is inside an operation (see guard) and QUIESCENT otherwise.
+ * retire(p) must be called once p can no longer be reached by an operation that starts now. It tags p with the
+ * current epoch and advances the epoch, so p is safe to free once no thread id announces that epoch or an earlier
+ * one. Freeing is attempted in retire, and when an operation that began before the latest retire ends (only those
+ * can be what is holding a retired object back, so operations that began later skip the check).
+ *
+ * Guards nest: an inner guard for a thread id that is already inside an operation does nothing, so recursive and
+ * batched operations can take one at every entry point. A thread id must not be used by two threads at once.
+ */
+class epochReclaimer {
+private:
+    static const uint64_t QUIESCENT = 0;
+
+    struct PaddedEpoch {
+        atomic<uint64_t> v;
+        char padding[PADDING_BYTES - sizeof(atomic<uint64_t>)];
+    };
+    struct retiredObject {
+        void * p;
+        void (*free)(void *);
+        size_t bytes;
+        uint64_t epoch;         // p was retired in this epoch
+    };
+
+    char padding0[PADDING_BYTES];
+    const int numIds;
+    PaddedEpoch * announced;
+    char padding1[PADDING_BYTES];
+    atomic<uint64_t> epoch;
+    char padding2[PADDING_BYTES];
+    atomic<int> numRetired;     // read by every operation as it ends, written only when something is retired or freed
+    atomic<uint64_t> lastRetired;   // the epoch of the latest retire
+    atomic<size_t> retiredBytes;
+    mutex retiredLock;
+    vector<retiredObject> retired;
+    char padding3[PADDING_BYTES];
+
+    // the oldest epoch any thread id is announcing (UINT64_MAX if none)
+    uint64_t oldestAnnounced() {
+        uint64_t oldest = UINT64_MAX;
+        for (int i = 0; i < numIds; ++i) {
+            const uint64_t e = announced[i].v.load();
+            if (e != QUIESCENT && e < oldest) oldest = e;
+        }
+        return oldest;
+    }
+
+public:
+    // thread ids are [0, _numIds)
+    epochReclaimer(const int _numIds) : numIds(_numIds), epoch(1), numRetired(0), lastRetired(0), retiredBytes(0) {
+        announced = new PaddedEpoch[numIds];
+        for (int i = 0; i < numIds; ++i) announced[i].v.store(QUIESCENT, memory_order_relaxed);
+    }
+    // no operation may be running: everything still retired is freed
+    ~epochReclaimer() {
+        for (auto & r : retired) r.free(r.p);
+        delete[] announced;
+    }
+
+    // returns false (and does nothing) if tid is already inside an operation
+    bool enter(const int tid) {
+        assert(tid >= 0 && tid < numIds);
+        if (announced[tid].v.load(memory_order_relaxed) != QUIESCENT) return false;
+        // seq_cst: the announcement must be visible before this operation loads any pointer it will follow
+        announced[tid].v.store(epoch.load());
+        return true;
+    }
+    void exit(const int tid) {
+        const uint64_t e = announced[tid].v.load(memory_order_relaxed);
+        announced[tid].v.store(QUIESCENT, memory_order_release);
+        if (numRetired.load(memory_order_relaxed) && e <= lastRetired.load(memory_order_relaxed)) reclaim();
+    }
+
+    class guard {
+        epochReclaimer * const er;
+        const int tid;
+        const bool outermost;
+    public:
+        guard(epochReclaimer * _er, const int _tid) : er(_er), tid(_tid), outermost(_er->enter(_tid)) {}
+        ~guard() { if (outermost) er->exit(tid); }
+    };
+    guard getGuard(const int tid) {
+        return guard(this, tid);
+    }
+
+    // hand p (which holds about bytes of memory) over to be deleted once no operation can hold it
+    template <typename T>
+    void retire(T * p, const size_t bytes) {
+        {
+            lock_guard<mutex> lock(retiredLock);
+            const uint64_t e = epoch.fetch_add(1);
+            retired.push_back({p, [](void * q) { delete (T *) q; }, bytes, e});
+            lastRetired = e;
+            retiredBytes += bytes;
+            numRetired = retired.size();
+        }
+        reclaim();
+    }
+
+    // free every retired object that no running operation can hold
+    void reclaim() {
+        lock_guard<mutex> lock(retiredLock);
+        const uint64_t oldest = oldestAnnounced();
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < oldest) {
+                retiredBytes -= retired[i].bytes;
+                retired[i].free(retired[i].p);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+        numRetired = kept;
+    }
+
+    // return fn() with freeing held off, for readers that have no thread id of their own (e.g. a thread printing
+    // the table's size while operations run): any object fn reaches stays allocated until it returns
+    template <class Fn>
+    auto withoutFreeing(Fn fn) {
+        lock_guard<mutex> lock(retiredLock);
+        return fn();
+    }
+
+    // bytes held by retired objects that have not been freed yet
+    size_t getRetiredBytes() {
+        return retiredBytes;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include "util.h"
+#include <stdint.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+using namespace std;
+
+/**
+ * Compile-time hash and range-reduction policies for the a4 tables.
+ *
+ * A hash policy maps a key to 32 bits: Hash::hash(key).
+ * A range-reduction policy maps those 32 bits to a home slot in [0, capacity): Range::reduce(h, capacity).
+ * Tables pass every requested capacity through Range::roundCapacity first, so a policy can insist on (say)
+ * powers of two. Probes then walk forward from the home slot with probeNext, which wraps without a division.
+ * name() identifies a policy in table snapshots (see snapshot.h).
+ */
+
+// murmur3 for 32-bit keys; for 64-bit keys, the top half of murmur3's fmix64 (it depends on every input bit)
+template <typename K>
+struct murmur3_hash;
+
+template <>
+struct murmur3_hash<uint32_t> {
+    static const char * name() { return "murmur3_hash"; }
+    static uint32_t hash(const uint32_t key) { return murmur3(key); }
+};
+
+template <>
+struct murmur3_hash<uint64_t> {
+    static const char * name() { return "murmur3_hash"; }
+    static uint32_t hash(const uint64_t key) { return (uint32_t) (murmur3fmix64(key) >> 32); }
+};
+
+// CRC32C with the SSE4.2 crc32 instruction (a few cycles, but only a linear mix of the key bits)
+#ifdef __SSE4_2__
+template <typename K>
+struct crc32c_hash;
+
+template <>
+struct crc32c_hash<uint32_t> {
+    static const char * name() { return "crc32c_hash"; }
+    static uint32_t hash(const uint32_t key) { return _mm_crc32_u32(0xFFFFFFFF, key); }
+};
+
+template <>
+struct crc32c_hash<uint64_t> {
+    static const char * name() { return "crc32c_hash"; }
+    static uint32_t hash(const uint64_t key) { return (uint32_t) _mm_crc32_u64(0xFFFFFFFF, key); }
+};
+#endif
+
+// Multiply-shift (Dietzfelbinger et al.): the top 32 bits of the low 64 bits of key * (a fixed odd constant).
+// Its high bits are well mixed but its low bits are not, so pair it with multiply_high_range.
+template <typename K>
+struct multiply_shift_hash {
+    static const char * name() { return "multiply_shift_hash"; }
+    static uint32_t hash(const K key) { return (uint32_t) (((uint64_t) key * 0x9E3779B97F4A7C15ULL) >> 32); }
+};
+
+// The hash of the tables inside AlgorithmDSharded (see alg_d_sharded.h): Hash remixed by murmur3's 32-bit finalizer
+// (a bijection), so that no bit of it is tied to the top bits of Hash that picked the shard.
+template <typename K, class Hash>
+struct shard_hash {
+    static const char * name() { return "shard_hash"; }
+    static uint32_t remix(const uint32_t h) { return murmur3fmix32(h); }
+    static uint32_t hash(const K key) { return remix(Hash::hash(key)); }
+};
+
+// Lemire's multiply-high: floor(h * capacity / 2^32), for any capacity. Uses the high bits of h.
+struct multiply_high_range {
+    static const char * name() { return "multiply_high_range"; }
+    static uint32_t reduce(const uint32_t h, const uint32_t capacity) {
+        return (uint32_t) (((uint64_t) h * capacity) >> 32);
+    }
+    static uint32_t roundCapacity(const uint32_t capacity) { return capacity; }
+};
+
+// h & (capacity - 1), with capacity rounded up to a power of two. Uses the low bits of h.
+struct pow2_range {
+    static const char * name() { return "pow2_range"; }
+    static uint32_t reduce(const uint32_t h, const uint32_t capacity) {
+        return h & (capacity - 1);
+    }
+    static uint32_t roundCapacity(const uint32_t capacity) {
+        if (capacity <= 1) return 1;
+        return (uint32_t) 1 << (32 - __builtin_clz(capacity - 1));
+    }
+};
+
+// the slot after index in a linear probe
+static inline uint32_t probeNext(const uint32_t index, const uint32_t capacity) {
+    return (index + 1 == capacity) ? 0 : index + 1;
+}
+
+// the slot before index in a linear probe
+static inline uint32_t probePrev(const uint32_t index, const uint32_t capacity) {
+    return (index == 0) ? capacity - 1 : index - 1;
+}
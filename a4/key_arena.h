@@ -0,0 +1,116 @@
+#pragma once
+#include "util.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+using namespace std;
+
+/**
+ * Per-thread append-only storage for variable-length keys (and a 64-bit value stored with each key).
+ *
+ * A record is named by a 48-bit offset: [8 bits tid][16 bits chunk][24 bits position in the chunk]. Each thread
+ * appends to its own 16 MiB chunks (allocated as needed) without synchronization, and the record is published by
+ * whatever CAS makes its offset visible (e.g., a table slot), so other threads can read it from then on.
+ * Records are never freed or moved before the arena is destroyed. The one exception is unappend(), which lets a
+ * thread take back the record it just appended, as long as it never published it.
+ */
+class keyArena {
+public:
+    static const int TID_BITS = 8;
+    static const int CHUNK_BITS = 16;
+    static const int POSITION_BITS = 24;
+    static const uint64_t OFFSET_BITS = TID_BITS + CHUNK_BITS + POSITION_BITS;
+    static const uint64_t OFFSET_MASK = (1ULL << OFFSET_BITS) - 1;
+    static const uint32_t CHUNK_BYTES = 1U << POSITION_BITS;
+    static const uint32_t MAX_CHUNKS = 1U << CHUNK_BITS;
+    static const uint32_t MAX_KEY_BYTES = 65535;
+    static_assert(MAX_THREADS <= (1 << TID_BITS), "a record offset has room for 256 thread ids");
+
+    struct record {
+        uint64_t value;
+        uint32_t length;
+        uint32_t unused;
+        const char * bytes() const { return (const char *) (this + 1); }
+    };
+
+private:
+    struct threadArena {
+        char ** chunks;         // MAX_CHUNKS pointers (calloc: untouched pages cost nothing)
+        uint32_t chunk;         // chunk being appended to
+        uint32_t position;      // next free byte in it
+        uint64_t bytes;         // bytes appended (for getMemoryBytes)
+        char padding[PADDING_BYTES - sizeof(char **) - 2 * sizeof(uint32_t) - sizeof(uint64_t)];
+    };
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    threadArena * arenas;
+    char padding1[PADDING_BYTES];
+
+    static uint32_t recordBytes(const size_t length) {
+        return (sizeof(record) + length + 7) & ~7U;
+    }
+
+public:
+    keyArena(const int _numThreads) : numThreads(_numThreads) {
+        arenas = new threadArena[numThreads];
+        for (int i = 0; i < numThreads; ++i) {
+            arenas[i].chunks = (char **) calloc(MAX_CHUNKS, sizeof(char *));
+            arenas[i].chunks[0] = (char *) malloc(CHUNK_BYTES);
+            arenas[i].chunk = 0;
+            arenas[i].position = 8;     // offset 0 is never a record, so a slot holding an offset is never 0
+            arenas[i].bytes = 0;
+        }
+    }
+    ~keyArena() {
+        for (int i = 0; i < numThreads; ++i) {
+            for (uint32_t c = 0; c <= arenas[i].chunk; ++c) free(arenas[i].chunks[c]);
+            free(arenas[i].chunks);
+        }
+        delete[] arenas;
+    }
+
+    // copy a record into thread tid's arena and return its offset (not yet visible to other threads)
+    uint64_t append(const int tid, const char * key, const size_t length, const uint64_t value) {
+        assert(length <= MAX_KEY_BYTES);
+        threadArena & a = arenas[tid];
+        const uint32_t size = recordBytes(length);
+        if (a.position + size > CHUNK_BYTES) {
+            assert(a.chunk + 1 < MAX_CHUNKS);
+            a.chunks[++a.chunk] = (char *) malloc(CHUNK_BYTES);
+            a.position = 0;
+        }
+        record * r = (record *) (a.chunks[a.chunk] + a.position);
+        r->value = value;
+        r->length = (uint32_t) length;
+        r->unused = 0;
+        memcpy((char *) r->bytes(), key, length);
+        const uint64_t offset = ((uint64_t) tid << (CHUNK_BITS + POSITION_BITS)) | ((uint64_t) a.chunk << POSITION_BITS) | a.position;
+        a.position += size;
+        a.bytes += size;
+        return offset;
+    }
+
+    // take back the record thread tid appended last, which must never have been published
+    void unappend(const int tid, const uint64_t offset) {
+        threadArena & a = arenas[tid];
+        const uint32_t position = offset & (CHUNK_BYTES - 1);
+        const uint32_t size = a.position - position;
+        assert((offset >> POSITION_BITS & (MAX_CHUNKS - 1)) == a.chunk);
+        a.position = position;
+        a.bytes -= size;
+    }
+
+    const record * at(const uint64_t offset) const {
+        const threadArena & a = arenas[offset >> (CHUNK_BITS + POSITION_BITS)];
+        return (const record *) (a.chunks[(offset >> POSITION_BITS) & (MAX_CHUNKS - 1)] + (offset & (CHUNK_BYTES - 1)));
+    }
+
+    // bytes of records appended (chunks are allocated CHUNK_BYTES at a time)
+    size_t getMemoryBytes() const {
+        size_t result = 0;
+        for (int i = 0; i < numThreads; ++i) result += arenas[i].bytes;
+        return result;
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "util.h"
+#include <stdint.h>
+using namespace std;
+
+/**
+ * Compile-time key width and sentinel encoding for the a4 tables.
+ *
+ * Every table reserves EMPTY (0) and a TOMBSTONE value, and AlgorithmD also reserves MARKED_MASK for migration.
+ * With K = uint32_t these give exactly the 32-bit layouts the tables always had.
+ * How keys are hashed is a separate policy (see hash_policy.h).
+ */
+
+// Used by tables that never mark slots (AlgorithmA, AlgorithmC): TOMBSTONE is all ones (-1 for 32-bit keys).
+template <typename K>
+struct plain_key_policy {
+    typedef K key_type;
+    static constexpr K EMPTY = 0;
+    static constexpr K TOMBSTONE = (K) ~(K) 0;
+    static constexpr K MAX_KEY = TOMBSTONE - 1;
+};
+
+// Used by tables that keep the top bit free (AlgorithmB, AlgorithmD): TOMBSTONE is the largest value without it.
+template <typename K>
+struct marked_key_policy {
+    typedef K key_type;
+    static constexpr K EMPTY = 0;
+    static constexpr K MARKED_MASK = (K) 1 << (sizeof(K)*8 - 1);
+    static constexpr K TOMBSTONE = MARKED_MASK - 1;
+    static constexpr K MAX_KEY = TOMBSTONE - 1;
+};
@@ -0,0 +1,251 @@
+/**
+ * A value-update-heavy benchmark for concurrent key-value maps (AlgorithmDMap).
+ */
+
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <time.h>
+
+#include "util.h"
+#include "alg_d_map.h"
+
+using namespace std;
+
+template <class DataStructureType>
+struct globals_t {
+    PaddedRandom rngs[MAX_THREADS];
+    volatile char padding0[PADDING_BYTES];
+    ElapsedTimer timer;
+    volatile char padding1[PADDING_BYTES];
+    long elapsedMillis;
+    volatile char padding2[PADDING_BYTES];
+    volatile bool done;
+    volatile char padding3[PADDING_BYTES];
+    volatile bool start;        // used for a custom barrier implementation (should threads start yet?)
+    volatile char padding4[PADDING_BYTES];
+    atomic_int running;         // used for a custom barrier implementation (how many threads are waiting?)
+    volatile char padding5[PADDING_BYTES];
+    DataStructureType * ds;
+    debugCounter numTotalOps;   // already has padding built in at the beginning and end
+    debugCounter keyChecksum;
+    debugCounter valueChecksum;
+    int millisToRun;
+    int totalThreads;
+    int keyRangeSize;
+    int tableSize;
+    volatile char padding7[PADDING_BYTES];
+    size_t garbage;             // sink for get() results, so the calls are not optimized out
+    volatile char padding8[PADDING_BYTES];
+
+    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, DataStructureType * _ds) {
+        for (int i=0;i<MAX_THREADS;++i) {
+            rngs[i].setSeed(i+1); // +1 because we don't want thread 0 to get a seed of 0, since seeds of 0 usually mean all random numbers are zero...
+        }
+        elapsedMillis = 0;
+        garbage = 0;
+        done = false;
+        start = false;
+        running = 0;
+        ds = _ds;
+        millisToRun = _millisToRun;
+        totalThreads = _totalThreads;
+        keyRangeSize = _keyRangeSize;
+        tableSize = _tableSize;
+    }
+    ~globals_t() {
+        delete ds;
+    }
+} __attribute__((aligned(PADDING_BYTES)));
+
+template <class DataStructureType>
+void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads,
+        double insertPercent, double deletePercent, double upsertPercent, double addPercent) {
+    auto dataStructure = new DataStructureType(totalThreads, tableSize);
+    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure);
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+                const int OPS_BETWEEN_TIME_CHECKS = 500;
+                size_t garbage = 0;
+
+                // BARRIER WAIT
+                g->running.fetch_add(1);
+                while (!g->start) { TRACE TPRINT("waiting to start"); }
+
+                for (int cnt=0; !g->done; ++cnt) {
+                    if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0
+                        && g->timer.getElapsedMillis() >= g->millisToRun) {
+                            g->done = true;
+                            __sync_synchronize();
+                    }
+
+                    // generate a random double in [0, 100]
+                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max() * 100;
+                    uint64_t key = 1 + (g->rngs[tid].nextNatural() % g->keyRangeSize);
+                    uint64_t value = 1 + (g->rngs[tid].nextNatural() % 1000);
+
+                    if (operationType < insertPercent) {
+                        if (g->ds->insertIfAbsent(tid, key, value)) {
+                            g->keyChecksum.add(tid, key);
+                            g->valueChecksum.add(tid, value);
+                        }
+                    } else if (operationType < insertPercent + deletePercent) {
+                        uint64_t erased;
+                        if (g->ds->erase(tid, key, &erased)) {
+                            g->keyChecksum.add(tid, -key);
+                            g->valueChecksum.add(tid, -erased);
+                        }
+                    } else if (operationType < insertPercent + deletePercent + upsertPercent) {
+                        uint64_t overwritten;
+                        if (g->ds->upsert(tid, key, value, &overwritten)) {
+                            g->keyChecksum.add(tid, key);
+                            g->valueChecksum.add(tid, value);
+                        } else {
+                            g->valueChecksum.add(tid, value - overwritten);
+                        }
+                    } else if (operationType < insertPercent + deletePercent + upsertPercent + addPercent) {
+                        uint64_t previous = g->ds->fetchAdd(tid, key, value);
+                        // a result of 0 means the key was inserted (values are never 0 in this benchmark)
+                        if (previous == 0) g->keyChecksum.add(tid, key);
+                        g->valueChecksum.add(tid, value);
+                    } else {
+                        uint64_t found = 0;
+                        garbage += g->ds->get(tid, key, &found) + found;
+                    }
+
+                    g->numTotalOps.inc(tid);
+                }
+
+                g->running.fetch_add(-1);
+                __sync_fetch_and_add(&g->garbage, garbage);
+        });
+    }
+
+    while (g->running < g->totalThreads) {
+        TRACE printf("main thread: waiting for threads to START running=%d\n", g->running.load());
+    }
+
+    printf("main thread: starting timer...\n");
+    g->timer.startTimer();
+    __asm__ __volatile__ ("" ::: "memory");
+    g->start = true;
+    __sync_synchronize();
+
+    while (g->running > 0) {
+        timespec time_to_sleep;
+        time_to_sleep.tv_sec = 0;
+        time_to_sleep.tv_nsec = 100000000;
+        nanosleep(&time_to_sleep, NULL);
+    }
+    g->elapsedMillis = g->timer.getElapsedMillis();
+
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    auto numTotalOps = g->numTotalOps.getTotal();
+    auto dsSumOfKeys = g->ds->getSumOfKeys();
+    auto threadsSumOfKeys = g->keyChecksum.getTotal();
+    auto dsSumOfValues = g->ds->getSumOfValues();
+    auto threadsSumOfValues = g->valueChecksum.getTotal();
+    cout<<"Validation: sum of keys according to the data structure = "<<dsSumOfKeys<<" and sum of keys according to the threads = "<<threadsSumOfKeys<<".";
+    cout<<((threadsSumOfKeys == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+    cout<<"Validation: sum of values according to the data structure = "<<dsSumOfValues<<" and sum of values according to the threads = "<<threadsSumOfValues<<".";
+    cout<<((threadsSumOfValues == dsSumOfValues) ? " OK." : " FAILED.")<<endl;
+    cout<<endl;
+
+    if (threadsSumOfKeys != dsSumOfKeys || threadsSumOfValues != dsSumOfValues) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    cout<<"final capacity        : "<<g->ds->getCapacity()<<endl;
+    cout<<"final slot bytes      : "<<g->ds->getMemoryBytes()<<endl;
+    cout<<"total completed ops   : "<<numTotalOps<<endl;
+    cout<<"throughput            : "<<(long long) (numTotalOps * 1000. / g->elapsedMillis)<<endl;
+    cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<endl;
+
+    delete g;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
+        cout<<"Options:"<<endl;
+        cout<<"    -sT [int]      size of initial hash [T]able"<<endl;
+        cout<<"    -m  [int]      [m]illiseconds to run"<<endl;
+        cout<<"    -sR [int]      size of the key [R]ange that random keys will be drawn from (i.e., range [1, s])"<<endl;
+        cout<<"    -t  [int]      number of [t]hreads"<<endl;
+        cout<<"    -i  [double]   percent of operations that will be insertIfAbsent"<<endl;
+        cout<<"    -d  [double]   percent of operations that will be erase"<<endl;
+        cout<<"    -u  [double]   percent of operations that will be upsert"<<endl;
+        cout<<"    -f  [double]   percent of operations that will be fetchAdd; the rest are get"<<endl;
+        cout<<endl;
+        cout<<"Example (counter-style updates): "<<argv[0]<<" -m 10000 -sT 1000 -sR 1000000 -t 16 -i 5 -d 5 -f 80"<<endl;
+        return 1;
+    }
+
+    int millisToRun = -1;
+    int tableSize = 0;
+    int keyRangeSize = 0;
+    int totalThreads = 0;
+    double insertPercent = 0;
+    double deletePercent = 0;
+    double upsertPercent = 0;
+    double addPercent = 0;
+
+    for (int i=1;i<argc;++i) {
+        if (strcmp(argv[i], "-sT") == 0) {
+            tableSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-sR") == 0) {
+            keyRangeSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            totalThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            insertPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            deletePercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0) {
+            upsertPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            addPercent = atof(argv[++i]);
+        } else {
+            cout<<"bad arguments"<<endl;
+            exit(1);
+        }
+    }
+
+    std::cout<<"Cmd:";
+    for (int i=0;i<argc;++i) {
+        std::cout<<" "<<argv[i];
+    }
+    std::cout<<std::endl;
+
+    PRINT(MAX_THREADS);
+    PRINT(millisToRun);
+    PRINT(keyRangeSize);
+    PRINT(tableSize);
+    PRINT(totalThreads);
+    PRINT(insertPercent);
+    PRINT(deletePercent);
+    PRINT(upsertPercent);
+    PRINT(addPercent);
+    cout<<endl;
+
+    if (totalThreads >= MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+        return 1;
+    }
+
+    runExperiment<AlgorithmDMap>(keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent, upsertPercent, addPercent);
+    return 0;
+}
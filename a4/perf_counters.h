@@ -0,0 +1,65 @@
+#pragma once
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+using namespace std;
+
+/**
+ * Process-wide hardware/software event counts (dTLB misses and page faults) via perf_event_open.
+ *
+ * Construct it BEFORE creating the worker threads: the counters are inherited by threads created afterwards, and
+ * each thread's counts are folded into ours when it exits, so only read (print) after joining them.
+ * Events the machine or kernel does not provide (e.g., no PMU in a VM, or perf_event_paranoid too high)
+ * are reported as unavailable.
+ */
+class perfCounters {
+private:
+    static const int NUM_EVENTS = 3;
+    int fds[NUM_EVENTS];
+    const char * names[NUM_EVENTS] = { "dTLB-load-misses", "dTLB-store-misses", "page-faults" };
+
+    static int open(const uint32_t type, const uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+public:
+    perfCounters() {
+        fds[0] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        fds[1] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        fds[2] = open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+    }
+    ~perfCounters() {
+        for (int i=0;i<NUM_EVENTS;++i) if (fds[i] >= 0) close(fds[i]);
+    }
+    void start() {
+        for (int i=0;i<NUM_EVENTS;++i) if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void stop() {
+        for (int i=0;i<NUM_EVENTS;++i) if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    // print each event's total and its count per op
+    void print(const int64_t numOps) {
+        for (int i=0;i<NUM_EVENTS;++i) {
+            cout<<names[i];
+            for (int pad = strlen(names[i]); pad < 22; ++pad) cout<<" ";
+            uint64_t count;
+            if (fds[i] < 0 || read(fds[i], &count, sizeof(count)) != sizeof(count)) {
+                cout<<": unavailable"<<endl;
+                continue;
+            }
+            cout<<": "<<count<<" ("<<(count / (double) max((int64_t) 1, numOps))<<" per op)"<<endl;
+        }
+    }
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+using namespace std;
+
+/**
+ * When AlgorithmD (and AlgorithmDMap) start a migration, and how big the table they migrate into is.
+ *
+ * An erase leaves a tombstone in its key's slot, so a slot, once used, stays used until the next migration, which
+ * copies only the live keys. The tables count used slots (every successful insert) and tombstones, so
+ * live = used - tombstones. A migration starts when:
+ *   - an insert or erase finds used > capacity/USED_LOAD (probes are getting long), or
+ *   - an erase leaves live < capacity/SHRINK_LOAD (most of the table is empty).
+ * The new capacity is:
+ *   - twice the old one if live > capacity/GROW_LOAD;
+ *   - if live < capacity/SHRINK_LOAD, the smallest minCapacity * 2^i that holds live at 1/GROW_LOAD, so a table
+ *     emptied by deletes shrinks in one migration (minCapacity is the size the table was created with);
+ *   - otherwise the same, which only purges the tombstones.
+ * A grow leaves live at about capacity/GROW_LOAD and a shrink at most that, so a shrink is only undone once the live
+ * keys double, and a grow once they drop 4x.
+ */
+struct resize_policy {
+    static const int USED_LOAD = 2;
+    static const int GROW_LOAD = 4;
+    static const int SHRINK_LOAD = 16;
+
+    static bool tooFull(const int64_t used, const uint64_t capacity) {
+        return used > (int64_t) (capacity / USED_LOAD);
+    }
+    static bool tooEmpty(const int64_t live, const uint64_t capacity, const uint64_t minCapacity) {
+        return capacity > minCapacity && live < (int64_t) (capacity / SHRINK_LOAD);
+    }
+    static uint64_t nextCapacity(const int64_t live, const uint64_t capacity, const uint64_t minCapacity) {
+        if (live > (int64_t) (capacity / GROW_LOAD)) return capacity * 2;
+        if (!tooEmpty(live, capacity, minCapacity)) return capacity;
+        uint64_t result = minCapacity;
+        while (result < capacity && live > (int64_t) (result / GROW_LOAD)) result *= 2;
+        return result;
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <omp.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+using namespace std;
+
+/**
+ * Parallel scans over the a4 slot arrays.
+ *
+ * The slots [0, capacity) are split into one contiguous block per OpenMP thread, and fn(tid, key) is called for
+ * every slot that holds a key (neither EMPTY nor TOMBSTONE after keyMask is applied), where tid is the OpenMP
+ * thread number, in [0, nthreads).
+ * Slots are read with plain atomic loads while updates may be running, so a scan is weakly consistent: a key that
+ * is in the table for the whole scan is reported exactly once, a key inserted or erased during the scan may or may
+ * not be reported, and no key is reported that was never in the table.
+ */
+
+// Padded layouts: slot(i) returns the atomic<K> that holds slot i.
+template <typename K, class SlotFn, class Fn>
+void scanSlots(const uint64_t capacity, const int nthreads, const K tombstone, const K keyMask, SlotFn slot, Fn fn) {
+    #pragma omp parallel num_threads(max(1, nthreads))
+    {
+        const int tid = omp_get_thread_num();
+        const int numScanners = omp_get_num_threads();
+        const uint64_t end = capacity * (tid + 1) / numScanners;
+        for (uint64_t i = capacity * tid / numScanners; i < end; ++i) {
+            K key = slot(i).load(memory_order_relaxed) & keyMask;
+            if (key != 0 && key != tombstone) fn(tid, key);
+        }
+    }
+}
+
+// Dense layouts (a plain array of atomic<K>). With AVX2, a 32-byte vector of slots is compared against EMPTY and
+// TOMBSTONE at once, so runs of empty and deleted slots cost one compare per vector instead of one branch per slot.
+template <typename K, class Fn>
+void scanDense(const atomic<K> * data, const uint64_t capacity, const int nthreads, const K tombstone, const K keyMask, Fn fn) {
+    static_assert(sizeof(atomic<K>) == sizeof(K), "dense scans need lock-free atomics with the layout of K");
+    #pragma omp parallel num_threads(max(1, nthreads))
+    {
+        const int tid = omp_get_thread_num();
+        const int numScanners = omp_get_num_threads();
+        const uint64_t end = capacity * (tid + 1) / numScanners;
+        uint64_t i = capacity * tid / numScanners;
+#ifdef __AVX2__
+        const int LANES = 32 / sizeof(K);
+        const __m256i vmask = (sizeof(K) == 4) ? _mm256_set1_epi32(keyMask) : _mm256_set1_epi64x(keyMask);
+        const __m256i vtombstone = (sizeof(K) == 4) ? _mm256_set1_epi32(tombstone) : _mm256_set1_epi64x(tombstone);
+        const __m256i vzero = _mm256_setzero_si256();
+        alignas(32) K lanes[LANES];
+        for (; i + LANES <= end; i += LANES) {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) &data[i]), vmask);
+            int live;
+            if constexpr (sizeof(K) == 4) {
+                __m256i dead = _mm256_or_si256(_mm256_cmpeq_epi32(v, vzero), _mm256_cmpeq_epi32(v, vtombstone));
+                live = ~_mm256_movemask_ps(_mm256_castsi256_ps(dead)) & 0xFF;
+            } else {
+                __m256i dead = _mm256_or_si256(_mm256_cmpeq_epi64(v, vzero), _mm256_cmpeq_epi64(v, vtombstone));
+                live = ~_mm256_movemask_pd(_mm256_castsi256_pd(dead)) & 0xF;
+            }
+            if (!live) continue;
+            // report the values we compared, not a second read of the slots
+            _mm256_store_si256((__m256i *) lanes, v);
+            while (live) {
+                fn(tid, lanes[__builtin_ctz(live)]);
+                live &= live - 1;
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            K key = data[i].load(memory_order_relaxed) & keyMask;
+            if (key != 0 && key != tombstone) fn(tid, key);
+        }
+    }
+}
+
+// Fold every key reported by forEachKey(fn, nthreads) with op, which must be associative and commutative.
+// Each thread folds into its own padded partial result, and the partials are combined at the end.
+template <typename T, class ForEachFn, class Op>
+T reduceKeys(ForEachFn forEachKey, const T identity, Op op, const int nthreads) {
+    struct partial {
+        T v;
+        char padding[PADDING_BYTES];
+    };
+    vector<partial> partials(max(1, nthreads));
+    for (auto & p : partials) p.v = identity;
+    forEachKey([&](const int tid, const auto & key) { partials[tid].v = op(partials[tid].v, (T) key); }, nthreads);
+    T result = identity;
+    for (auto & p : partials) result = op(result, p.v);
+    return result;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <new>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <omp.h>
+using namespace std;
+
+/**
+ * Compile-time allocation policies for the a4 slot arrays.
+ *
+ * Alloc::allocate<T>(n, initThreads) returns n value-initialized (zeroed) T's, constructed by initThreads OpenMP
+ * threads in contiguous blocks, so each page is first touched (faulted in) by the thread that constructs its block.
+ * Only pass initThreads > 1 from a thread that is not running operations (so worker threads never start OpenMP teams).
+ * Alloc::deallocate(p, n) destroys and frees an array returned by allocate<T>(n, ...).
+ */
+
+template <typename T>
+static void constructSlots(T * p, const size_t n, const int initThreads) {
+    #pragma omp parallel for num_threads(initThreads) if(initThreads > 1) schedule(static)
+    for (size_t i = 0; i < n; ++i) {
+        new (&p[i]) T();
+    }
+}
+
+template <typename T>
+static void destroySlots(T * p, const size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        p[i].~T();
+    }
+}
+
+// Ordinary heap memory (4 KB pages).
+struct heap_alloc {
+    template <typename T>
+    static T * allocate(const size_t n, const int initThreads) {
+        auto p = (T *) ::operator new[](n * sizeof(T));
+        constructSlots(p, n, initThreads);
+        return p;
+    }
+    template <typename T>
+    static void deallocate(T * p, const size_t n) {
+        destroySlots(p, n);
+        ::operator delete[](p);
+    }
+};
+
+// Anonymous mmap, aligned to 2 MB and marked MADV_HUGEPAGE, so (with transparent huge pages in "madvise" or
+// "always" mode) the array is backed by 2 MB pages and a probe almost never misses in the dTLB.
+// Constructing the slots pre-faults every page, so no page faults are left for the operations to take.
+struct hugepage_alloc {
+    static const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+    static size_t mappedBytes(const size_t bytes) {
+        return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    }
+
+    template <typename T>
+    static T * allocate(const size_t n, const int initThreads) {
+        const size_t bytes = mappedBytes(n * sizeof(T));
+        // over-map by one huge page, then trim both ends so the array starts on a 2 MB boundary
+        char * raw = (char *) mmap(NULL, bytes + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw bad_alloc();
+        char * aligned = (char *) (((uintptr_t) raw + HUGE_PAGE_BYTES - 1) & ~(uintptr_t) (HUGE_PAGE_BYTES - 1));
+        if (aligned > raw) munmap(raw, aligned - raw);
+        if (raw + HUGE_PAGE_BYTES > aligned) munmap(aligned + bytes, raw + HUGE_PAGE_BYTES - aligned);
+        madvise(aligned, bytes, MADV_HUGEPAGE); // only a hint: if it fails we still have 4 KB pages
+        auto p = (T *) aligned;
+        constructSlots(p, n, initThreads);
+        return p;
+    }
+    template <typename T>
+    static void deallocate(T * p, const size_t n) {
+        destroySlots(p, n);
+        munmap(p, mappedBytes(n * sizeof(T)));
+    }
+};
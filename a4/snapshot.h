@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * On-disk snapshots of a4 slot arrays.
+ *
+ * A snapshot file is a SNAPSHOT_HEADER_BYTES header followed by the slot array exactly as it is laid out in memory,
+ * so it can be mmapped and probed in place. The header records everything a table needs to decide whether it can
+ * use the slots as they are: the table type, key and slot widths, capacity, hash and range-reduction policies, and
+ * the sentinel encoding.
+ *
+ * Files are mapped MAP_PRIVATE: lookups read the file's pages straight from the page cache (faulting them in on
+ * first touch), and updates copy the page they write to, so the file itself is never modified.
+ */
+static const size_t SNAPSHOT_HEADER_BYTES = 4096;      // keeps the slots page-aligned in the file and the mapping
+static const char SNAPSHOT_MAGIC[8] = "a4snap1";
+
+struct snapshot_header {
+    char magic[8];
+    char table[32];
+    char hash[32];
+    char range[32];
+    uint32_t keyBytes;
+    uint32_t slotBytes;
+    uint64_t capacity;
+    uint64_t empty;
+    uint64_t tombstone;
+    uint64_t markedMask;        // 0 for tables that never mark slots
+    int64_t insertCount;        // table-specific bookkeeping (AlgorithmD: its approxSize and tombstoneCount)
+    int64_t tombstoneCount;
+    uint64_t initCapacity;
+
+    snapshot_header() {
+        memset(this, 0, sizeof(*this));
+        memcpy(magic, SNAPSHOT_MAGIC, sizeof(magic));
+    }
+    void setNames(const char * _table, const char * _hash, const char * _range) {
+        strncpy(table, _table, sizeof(table) - 1);
+        strncpy(hash, _hash, sizeof(hash) - 1);
+        strncpy(range, _range, sizeof(range) - 1);
+    }
+    // true if a table described by expected can use these slots as they are; otherwise prints why not
+    bool matches(const snapshot_header & expected, const char * path) const {
+        const char * mismatch = NULL;
+        if (strncmp(table, expected.table, sizeof(table))) mismatch = "table type";
+        else if (strncmp(hash, expected.hash, sizeof(hash))) mismatch = "hash policy";
+        else if (strncmp(range, expected.range, sizeof(range))) mismatch = "range-reduction policy";
+        else if (keyBytes != expected.keyBytes || slotBytes != expected.slotBytes) mismatch = "key or slot width";
+        else if (empty != expected.empty || tombstone != expected.tombstone || markedMask != expected.markedMask) mismatch = "sentinel encoding";
+        if (mismatch) fprintf(stderr, "%s: snapshot does not match this table (%s)\n", path, mismatch);
+        return mismatch == NULL;
+    }
+};
+
+/**
+ * Write header and then count slots of type T to path. copy(buffer, begin, n) must fill buffer[0..n-1] with
+ * slots [begin, begin+n), so a table can fix up slots (e.g., clear mark bits) on their way out.
+ * Returns false (after printing why) if the file could not be written.
+ */
+template <typename T, class CopyFn>
+bool writeSnapshot(const char * path, const snapshot_header & header, const size_t count, CopyFn copy) {
+    FILE * f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char headerBytes[SNAPSHOT_HEADER_BYTES] = {0};
+    memcpy(headerBytes, &header, sizeof(header));
+    bool ok = fwrite(headerBytes, 1, SNAPSHOT_HEADER_BYTES, f) == SNAPSHOT_HEADER_BYTES;
+
+    const size_t BLOCK = (1 << 20) / sizeof(T) + 1;
+    T * buffer = (T *) ::operator new(BLOCK * sizeof(T));
+    for (size_t begin = 0; ok && begin < count; begin += BLOCK) {
+        const size_t n = min(BLOCK, count - begin);
+        copy(buffer, begin, n);
+        ok = fwrite(buffer, sizeof(T), n, f) == n;
+    }
+    ::operator delete(buffer);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) perror(path);
+    return ok;
+}
+
+/**
+ * Map the snapshot at path privately (copy-on-write). On success, returns the start of the mapping (the header;
+ * the slots start SNAPSHOT_HEADER_BYTES later), and sets header and mappedBytes (to pass to munmap).
+ * Returns NULL (after printing why) if the file cannot be mapped or its size does not match its header.
+ */
+static void * mapSnapshot(const char * path, snapshot_header * header, size_t * mappedBytes) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < SNAPSHOT_HEADER_BYTES) {
+        fprintf(stderr, "%s: too small to be a snapshot\n", path);
+        close(fd);
+        return NULL;
+    }
+    void * base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (base == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    memcpy(header, base, sizeof(*header));
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))) {
+        fprintf(stderr, "%s: not an a4 snapshot\n", path);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    if ((size_t) st.st_size != SNAPSHOT_HEADER_BYTES + header->capacity * header->slotBytes) {
+        fprintf(stderr, "%s: file size does not match its header\n", path);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    *mappedBytes = st.st_size;
+    return base;
+}
@@ -0,0 +1,322 @@
+/**
+ * An insert & delete benchmark for concurrent sets of byte-string keys (AlgorithmCString), over a synthetic
+ * dictionary of URL-like keys.
+ *
+ * -a S runs AlgorithmCString on the keys themselves. -a DH runs AlgorithmD on each key's hash truncated to 31 bits
+ * (what callers do today without a string table), so distinct URLs with the same 31-bit hash are one key.
+ */
+
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <unordered_set>
+#include <time.h>
+
+#include "util.h"
+#include "alg_d.h"
+#include "alg_c_string.h"
+
+using namespace std;
+
+/**
+ * numKeys distinct URL-like keys, e.g. "https://www.site1234.com/news/2024/item-3f2a?ref=search".
+ * Hosts and path words repeat a lot (so keys share long prefixes), and every key ends with its own index.
+ */
+class urlDictionary {
+private:
+    vector<char> bytes;
+    vector<uint64_t> starts;    // key i is bytes[starts[i], starts[i+1])
+public:
+    urlDictionary(const int numKeys) {
+        static const char * WORDS[] = { "news", "sports", "world", "products", "search", "user", "profile", "images",
+            "static", "api", "v1", "v2", "blog", "2023", "2024", "category", "shop", "cart", "docs", "help", "about",
+            "en-us", "media", "video", "watch", "article", "tag", "archive", "page", "assets", "download", "item" };
+        static const char * TLDS[] = { ".com", ".org", ".net", ".io", ".co.uk" };
+        const int numWords = sizeof(WORDS) / sizeof(WORDS[0]);
+        starts.reserve(numKeys + 1);
+        string url;
+        for (int i = 0; i < numKeys; ++i) {
+            PaddedRandom rng(i + 1);
+            rng.nextNatural();
+            url = "https://www.site";
+            url += to_string(rng.nextNatural() % 20000);
+            url += TLDS[rng.nextNatural() % 5];
+            const int segments = 1 + rng.nextNatural() % 4;
+            for (int s = 0; s < segments; ++s) {
+                url += '/';
+                url += WORDS[rng.nextNatural() % numWords];
+            }
+            char id[32];
+            snprintf(id, sizeof(id), "/item-%x", i);
+            url += id;
+            if (rng.nextNatural() % 2) {
+                url += "?ref=";
+                url += WORDS[rng.nextNatural() % numWords];
+            }
+            starts.push_back(bytes.size());
+            bytes.insert(bytes.end(), url.begin(), url.end());
+        }
+        starts.push_back(bytes.size());
+    }
+    int size() { return (int) starts.size() - 1; }
+    const char * key(const int i) { return bytes.data() + starts[i]; }
+    size_t length(const int i) { return starts[i + 1] - starts[i]; }
+    size_t getTotalBytes() { return bytes.size(); }
+};
+
+// the 31-bit key -a DH uses for a string (never 0)
+static uint32_t truncatedHash(const char * key, const size_t length) {
+    return 1 + (uint32_t) (murmur64a(key, length) >> 33);
+}
+
+// both tables behind one interface: keys are dictionary indexes, and a key's value is index + 1
+struct stringSet {
+    AlgorithmCString * s;
+    AlgorithmD<> * d;
+    urlDictionary * dict;
+    stringSet(const char * alg, int totalThreads, int tableSize, urlDictionary * _dict) : s(NULL), d(NULL), dict(_dict) {
+        if (!strcmp(alg, "S")) s = new AlgorithmCString(totalThreads, tableSize);
+        else d = new AlgorithmD<>(totalThreads, tableSize);
+    }
+    ~stringSet() {
+        delete s;
+        delete d;
+    }
+    // the amount a successful insert adds to (and a successful erase removes from) the checksum
+    uint64_t checksumOf(const int i) {
+        return s ? (uint64_t) i + 1 : truncatedHash(dict->key(i), dict->length(i));
+    }
+    bool insertIfAbsent(const int tid, const int i) {
+        if (s) return s->insertIfAbsent(tid, dict->key(i), dict->length(i), (uint64_t) i + 1);
+        return d->insertIfAbsent(tid, truncatedHash(dict->key(i), dict->length(i)));
+    }
+    bool erase(const int tid, const int i) {
+        if (s) return s->erase(tid, dict->key(i), dict->length(i));
+        return d->erase(tid, truncatedHash(dict->key(i), dict->length(i)));
+    }
+    bool contains(const int tid, const int i) {
+        if (s) return s->contains(tid, dict->key(i), dict->length(i));
+        return d->contains(tid, truncatedHash(dict->key(i), dict->length(i)));
+    }
+    uint64_t getChecksum() {
+        return s ? s->getSumOfValues() : (uint64_t) d->getSumOfKeys();
+    }
+};
+
+struct globals_t {
+    PaddedRandom rngs[MAX_THREADS];
+    volatile char padding0[PADDING_BYTES];
+    ElapsedTimer timer;
+    volatile char padding1[PADDING_BYTES];
+    long elapsedMillis;
+    volatile char padding2[PADDING_BYTES];
+    volatile bool done;
+    volatile char padding3[PADDING_BYTES];
+    volatile bool start;        // used for a custom barrier implementation (should threads start yet?)
+    volatile char padding4[PADDING_BYTES];
+    atomic_int running;         // used for a custom barrier implementation (how many threads are waiting?)
+    volatile char padding5[PADDING_BYTES];
+    stringSet * ds;
+    debugCounter numTotalOps;   // already has padding built in at the beginning and end
+    debugCounter checksum;
+    int millisToRun;
+    int totalThreads;
+    int keyRangeSize;
+    volatile char padding7[PADDING_BYTES];
+    size_t garbage;             // sink for contains() results, so the calls are not optimized out
+    volatile char padding8[PADDING_BYTES];
+
+    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, stringSet * _ds) {
+        for (int i=0;i<MAX_THREADS;++i) {
+            rngs[i].setSeed(i+1); // +1 because we don't want thread 0 to get a seed of 0, since seeds of 0 usually mean all random numbers are zero...
+        }
+        elapsedMillis = 0;
+        garbage = 0;
+        done = false;
+        start = false;
+        running = 0;
+        ds = _ds;
+        millisToRun = _millisToRun;
+        totalThreads = _totalThreads;
+        keyRangeSize = _keyRangeSize;
+    }
+    ~globals_t() {
+        delete ds;
+    }
+} __attribute__((aligned(PADDING_BYTES)));
+
+void runExperiment(const char * alg, int keyRangeSize, int tableSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent) {
+    ElapsedTimer dictTimer;
+    dictTimer.startTimer();
+    auto dict = new urlDictionary(keyRangeSize);
+    cout<<"dictionary            : "<<dict->size()<<" keys, "<<dict->getTotalBytes()<<" bytes ("
+        <<(dict->getTotalBytes() / (double) dict->size())<<" per key), built in "<<dictTimer.getElapsedMillis()<<" ms"<<endl;
+    unordered_set<uint32_t> hashes;
+    for (int i = 0; i < dict->size(); ++i) hashes.insert(truncatedHash(dict->key(i), dict->length(i)));
+    cout<<"31-bit hash collisions: "<<(dict->size() - (long long) hashes.size())<<" keys share a truncated hash with another key"<<endl;
+
+    auto g = new globals_t(millisToRun, totalThreads, keyRangeSize, new stringSet(alg, totalThreads, tableSize, dict));
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+                const int OPS_BETWEEN_TIME_CHECKS = 500;
+                size_t garbage = 0;
+
+                // BARRIER WAIT
+                g->running.fetch_add(1);
+                while (!g->start) { TRACE TPRINT("waiting to start"); }
+
+                for (int cnt=0; !g->done; ++cnt) {
+                    if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0
+                        && g->timer.getElapsedMillis() >= g->millisToRun) {
+                            g->done = true;
+                            __sync_synchronize();
+                    }
+
+                    double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max() * 100;
+                    int i = g->rngs[tid].nextNatural() % g->keyRangeSize;
+
+                    if (operationType < insertPercent) {
+                        if (g->ds->insertIfAbsent(tid, i)) g->checksum.add(tid, g->ds->checksumOf(i));
+                    } else if (operationType < insertPercent + deletePercent) {
+                        if (g->ds->erase(tid, i)) g->checksum.add(tid, -(long long) g->ds->checksumOf(i));
+                    } else {
+                        garbage += g->ds->contains(tid, i);
+                    }
+
+                    g->numTotalOps.inc(tid);
+                }
+
+                g->running.fetch_add(-1);
+                __sync_fetch_and_add(&g->garbage, garbage);
+        });
+    }
+
+    while (g->running < g->totalThreads) {
+        TRACE printf("main thread: waiting for threads to START running=%d\n", g->running.load());
+    }
+
+    printf("main thread: starting timer...\n");
+    g->timer.startTimer();
+    __asm__ __volatile__ ("" ::: "memory");
+    g->start = true;
+    __sync_synchronize();
+
+    while (g->running > 0) {
+        timespec time_to_sleep;
+        time_to_sleep.tv_sec = 0;
+        time_to_sleep.tv_nsec = 100000000;
+        nanosleep(&time_to_sleep, NULL);
+    }
+    g->elapsedMillis = g->timer.getElapsedMillis();
+
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    auto numTotalOps = g->numTotalOps.getTotal();
+    auto dsChecksum = g->ds->getChecksum();
+    auto threadsChecksum = (uint64_t) g->checksum.getTotal();
+    cout<<"Validation: checksum according to the data structure = "<<dsChecksum<<" and checksum according to the threads = "<<threadsChecksum<<".";
+    cout<<((threadsChecksum == dsChecksum) ? " OK." : " FAILED.")<<endl;
+    cout<<endl;
+
+    if (threadsChecksum != dsChecksum) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    if (g->ds->s) {
+        g->ds->s->printDebuggingDetails();
+        cout<<"memory bytes          : "<<g->ds->s->getMemoryBytes()<<endl;
+    } else {
+        cout<<"final capacity        : "<<g->ds->d->getCapacity()<<endl;
+    }
+    cout<<"total completed ops   : "<<numTotalOps<<endl;
+    cout<<"throughput            : "<<(long long) (numTotalOps * 1000. / g->elapsedMillis)<<endl;
+    cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<endl;
+
+    delete g;
+    delete dict;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
+        cout<<"Options:"<<endl;
+        cout<<"    -a  [string]   [a]lgorithm name in { S, DH } (S: string keys, DH: algorithm D on 31-bit key hashes)"<<endl;
+        cout<<"    -sT [int]      size of the hash [T]able (initial size for DH; S never grows, and counts erased keys)"<<endl;
+        cout<<"    -m  [int]      [m]illiseconds to run"<<endl;
+        cout<<"    -sR [int]      number of URL-like keys in the dictionary that keys will be drawn from"<<endl;
+        cout<<"    -t  [int]      number of [t]hreads"<<endl;
+        cout<<"    -i  [double]   percent of operations that will be insert (default 50)"<<endl;
+        cout<<"    -d  [double]   percent of operations that will be delete (default 50); the rest are contains"<<endl;
+        cout<<endl;
+        cout<<"Example: "<<argv[0]<<" -a S -m 10000 -sT 40000000 -sR 1000000 -t 16 -i 5 -d 5"<<endl;
+        return 1;
+    }
+
+    int millisToRun = -1;
+    int tableSize = 0;
+    int keyRangeSize = 0;
+    int totalThreads = 0;
+    char * alg = NULL;
+    double insertPercent = 50;
+    double deletePercent = 50;
+
+    for (int i=1;i<argc;++i) {
+        if (strcmp(argv[i], "-sT") == 0) {
+            tableSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-sR") == 0) {
+            keyRangeSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            totalThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            alg = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            insertPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            deletePercent = atof(argv[++i]);
+        } else {
+            cout<<"bad arguments"<<endl;
+            exit(1);
+        }
+    }
+
+    std::cout<<"Cmd:";
+    for (int i=0;i<argc;++i) {
+        std::cout<<" "<<argv[i];
+    }
+    std::cout<<std::endl;
+
+    PRINT(MAX_THREADS);
+    PRINT(millisToRun);
+    PRINT(keyRangeSize);
+    PRINT(tableSize);
+    PRINT(totalThreads);
+    PRINT(alg);
+    PRINT(insertPercent);
+    PRINT(deletePercent);
+    cout<<endl;
+
+    if (totalThreads >= MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+        return 1;
+    }
+    if (alg == NULL || (strcmp(alg, "S") && strcmp(alg, "DH"))) {
+        cout<<"Must specify algorithm S or DH"<<endl;
+        return 1;
+    }
+
+    runExperiment(alg, keyRangeSize, tableSize, millisToRun, totalThreads, insertPercent, deletePercent);
+    return 0;
+}
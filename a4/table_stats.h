@@ -0,0 +1,118 @@
+#pragma once
+#include "util.h"
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+using namespace std;
+
+/**
+ * Per-thread operation statistics for the a4 tables (AlgorithmC and AlgorithmD), built on debugCounter.
+ *
+ * Compiled in only with -DTABLE_STATS (make STATS=1). Tables record with TABLE_STAT(...), which expands to its
+ * argument when TABLE_STATS is defined and to nothing otherwise, so a normal build has no counters, no extra
+ * stores and no clock reads on any path. Counters are indexed by tid, so recording is a plain add to a
+ * thread-private padded slot.
+ */
+#ifdef TABLE_STATS
+#define TABLE_STAT(...) __VA_ARGS__
+#else
+#define TABLE_STAT(...)
+#endif
+
+// a point-in-time sum of every thread's counters (the per-second series prints the difference of two of these)
+struct tableStatsTotals {
+    static const int PROBE_BUCKETS = 12;
+    long long probeLength[PROBE_BUCKETS];
+    long long casFailures;
+    long long markedRestarts;
+    long long expansionsStarted;
+    long long expansionsHelped;
+    long long chunksMigrated;
+    long long helpExpansionNanos;
+
+    tableStatsTotals operator-(const tableStatsTotals & other) const {
+        tableStatsTotals result = *this;
+        for (int b=0;b<PROBE_BUCKETS;++b) result.probeLength[b] -= other.probeLength[b];
+        result.casFailures -= other.casFailures;
+        result.markedRestarts -= other.markedRestarts;
+        result.expansionsStarted -= other.expansionsStarted;
+        result.expansionsHelped -= other.expansionsHelped;
+        result.chunksMigrated -= other.chunksMigrated;
+        result.helpExpansionNanos -= other.helpExpansionNanos;
+        return result;
+    }
+    long long getProbes() const {
+        long long result = 0;
+        for (int b=0;b<PROBE_BUCKETS;++b) result += probeLength[b];
+        return result;
+    }
+    // largest probe length that lands in bucket b (bucket 0 holds length 1, bucket b > 0 holds (2^(b-1), 2^b])
+    static long long bucketLimit(const int b) {
+        return 1LL << b;
+    }
+
+    // one line, for the per-second series
+    void printLine(const int64_t elapsedMillis) const {
+        cout<<elapsedMillis<<"ms: stats probes="<<getProbes()
+            <<" casFailures="<<casFailures
+            <<" markedRestarts="<<markedRestarts
+            <<" expansionsStarted="<<expansionsStarted
+            <<" expansionsHelped="<<expansionsHelped
+            <<" chunksMigrated="<<chunksMigrated
+            <<" helpExpansionMillis="<<(helpExpansionNanos / 1000000)<<endl;
+    }
+    // the end-of-run summary; numOps gives the per-op rates
+    void printSummary(const int64_t numOps) const {
+        const double ops = max((int64_t) 1, numOps);
+        const long long probes = max(1LL, getProbes());
+        cout<<"probe length histogram (slots examined per probe):"<<endl;
+        for (int b=0;b<PROBE_BUCKETS;++b) {
+            if (probeLength[b] == 0) continue;
+            cout<<"    <= "<<bucketLimit(b)<<(b == PROBE_BUCKETS-1 ? "+" : "")<<"\t: "<<probeLength[b]
+                <<" ("<<(100. * probeLength[b] / probes)<<"%)"<<endl;
+        }
+        cout<<"cas failures          : "<<casFailures<<" ("<<(casFailures / ops)<<" per op)"<<endl;
+        cout<<"marked restarts       : "<<markedRestarts<<" ("<<(markedRestarts / ops)<<" per op)"<<endl;
+        cout<<"expansions started    : "<<expansionsStarted<<endl;
+        cout<<"expansions helped     : "<<expansionsHelped<<endl;
+        cout<<"chunks migrated       : "<<chunksMigrated<<endl;
+        cout<<"help expansion millis : "<<(helpExpansionNanos / 1000000.)<<endl;
+    }
+};
+
+class tableStats {
+public:
+    static const int PROBE_BUCKETS = tableStatsTotals::PROBE_BUCKETS;
+    debugCounter probeLength[PROBE_BUCKETS];
+    debugCounter casFailures;           // CAS on a slot that lost to another thread (and was not a migration freeze)
+    debugCounter markedRestarts;        // operations restarted because they met a MARKED (frozen) slot
+    debugCounter expansionsStarted;     // new tables installed
+    debugCounter expansionsHelped;      // calls to helpExpansion that found a migration to help with
+    debugCounter chunksMigrated;
+    debugCounter helpExpansionNanos;    // time spent in those calls
+
+    static int bucketOf(const uint32_t length) {
+        if (length <= 1) return 0;
+        return min(PROBE_BUCKETS - 1, 32 - __builtin_clz(length - 1));
+    }
+    // record a probe that examined length slots
+    void addProbe(const int tid, const uint32_t length) {
+        probeLength[bucketOf(length)].inc(tid);
+    }
+    static uint64_t nowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // weakly consistent with concurrent updates (each counter is read once, without synchronization)
+    tableStatsTotals getTotals() {
+        tableStatsTotals result;
+        for (int b=0;b<PROBE_BUCKETS;++b) result.probeLength[b] = probeLength[b].getTotal();
+        result.casFailures = casFailures.getTotal();
+        result.markedRestarts = markedRestarts.getTotal();
+        result.expansionsStarted = expansionsStarted.getTotal();
+        result.expansionsHelped = expansionsHelped.getTotal();
+        result.chunksMigrated = chunksMigrated.getTotal();
+        result.helpExpansionNanos = helpExpansionNanos.getTotal();
+        return result;
+    }
+};
@@ -4,6 +4,7 @@
 #include <chrono>
 #include <atomic>
 #include <sstream>
+#include <cstring>
 using namespace std;
 
 #ifndef MAX_THREADS
@@ -60,6 +61,11 @@ public:
             globalCounter.fetch_add(val);
             subcounters[tid].v = 0;
         }
+        return val;
+    }
+    // add amount directly to the global count (e.g., a bulk operation's total)
+    void add(int64_t amount) {
+        globalCounter.fetch_add(amount);
     }
     int64_t get() {
         return globalCounter;
@@ -155,6 +161,60 @@ public:
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
+// Per-thread log-linear latency histogram (16 sub-buckets per power of two, so ~6% resolution).
+class latencyHistogram {
+private:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1<<SUB_BUCKET_BITS;
+    static const int NUM_BUCKETS = 64*SUB_BUCKETS;
+    struct perThread {
+        uint64_t counts[NUM_BUCKETS];
+        uint64_t max;
+    } __attribute__((aligned(PADDING_BYTES)));
+    perThread * data;
+    const int numThreads;
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return ns;
+        int shift = 63 - __builtin_clzll(ns) - SUB_BUCKET_BITS;
+        return (shift+1)*SUB_BUCKETS + ((ns >> shift) & (SUB_BUCKETS-1));
+    }
+    // largest value that lands in bucket b
+    static uint64_t valueOf(int b) {
+        if (b < SUB_BUCKETS) return b;
+        int shift = b/SUB_BUCKETS - 1;
+        return ((uint64_t) (SUB_BUCKETS + b%SUB_BUCKETS + 1) << shift) - 1;
+    }
+public:
+    latencyHistogram(const int _numThreads) : numThreads(_numThreads) {
+        data = new perThread[numThreads]();
+    }
+    ~latencyHistogram() {
+        delete[] data;
+    }
+    void add(const int tid, const uint64_t ns) {
+        ++data[tid].counts[bucketOf(ns)];
+        if (ns > data[tid].max) data[tid].max = ns;
+    }
+    uint64_t getMax() {
+        uint64_t result = 0;
+        for (int tid=0;tid<numThreads;++tid) result = std::max(result, data[tid].max);
+        return result;
+    }
+    // p in [0, 1]; returns an upper bound on the p-th percentile, in ns (only call once threads are done)
+    uint64_t getPercentile(const double p) {
+        uint64_t total = 0;
+        for (int tid=0;tid<numThreads;++tid) for (int b=0;b<NUM_BUCKETS;++b) total += data[tid].counts[b];
+        uint64_t target = (uint64_t) (p * total);
+        uint64_t seen = 0;
+        for (int b=0;b<NUM_BUCKETS;++b) {
+            for (int tid=0;tid<numThreads;++tid) seen += data[tid].counts[b];
+            if (seen > target) return std::min(valueOf(b), getMax());
+        }
+        return getMax();
+    }
+};
+
 uint32_t murmur3(uint32_t key) {
     constexpr uint32_t seed = 0x1a8b714c;
     constexpr uint32_t c1 = 0xCC9E2D51;
@@ -180,5 +240,58 @@ uint32_t murmur3(uint32_t key) {
     return h;
 }
 
+// murmur3's 32-bit finalizer (fmix32): a full-avalanche bijection on 32 bits
+uint32_t murmur3fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// murmur3's 64-bit finalizer (fmix64): a full-avalanche mixer for 64-bit keys
+uint64_t murmur3fmix64(uint64_t key) {
+    uint64_t k = key;
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash64A (Austin Appleby) of len bytes: 8 bytes per step, then the tail, then a finalizer
+uint64_t murmur64a(const void * bytes, const size_t len, const uint64_t seed = 0) {
+    const uint64_t m = 0xC6A4A7935BD1E995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const unsigned char * p = (const unsigned char *) bytes;
+    const unsigned char * end = p + (len & ~(size_t) 7);
+    for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len & 7) {
+        case 7: h ^= (uint64_t) p[6] << 48; // fall through
+        case 6: h ^= (uint64_t) p[5] << 40; // fall through
+        case 5: h ^= (uint64_t) p[4] << 32; // fall through
+        case 4: h ^= (uint64_t) p[3] << 24; // fall through
+        case 3: h ^= (uint64_t) p[2] << 16; // fall through
+        case 2: h ^= (uint64_t) p[1] << 8;  // fall through
+        case 1: h ^= (uint64_t) p[0];
+                h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
 #endif /* UTIL_H */
 
@@ -84,7 +84,7 @@ bool DoublyLinkedList::contains(const int tid, const int & key) {
         if (key == currentNode->data) {
             return true;
         }
-        currentNode = (Node *) kcas.readPtr(tid, &currentNode->next);
+        currentNode = (Node *) kcas.KCAS_SEARCH_READ_PTR(tid, &currentNode->next);
     };
     return false;
 }
@@ -106,8 +106,8 @@ bool DoublyLinkedList::insertIfAbsent(const int tid, const int & key) {
     setupNode(tid, newNode, prevNode, currentNode, key);
     
     auto descPtr = kcas.getDescriptor(tid);
-    descPtr->addValAddr(&prevNode->mark, false, false);
-    descPtr->addValAddr(&currentNode->mark, false, false);
+    descPtr->addReadValAddr(&prevNode->mark, false);
+    descPtr->addReadValAddr(&currentNode->mark, false);
     descPtr->addPtrAddr(&prevNode->next, (casword_t) currentNode,(casword_t) newNode);
     descPtr->addPtrAddr(&currentNode->prev, (casword_t) prevNode, (casword_t) newNode);
 
@@ -134,9 +134,9 @@ bool DoublyLinkedList::erase(const int tid, const int & key) {
             Node * nextNode = (Node *) kcas.readPtr(tid, &currentNode->next);
             
             auto descPtr = kcas.getDescriptor(tid);
-            descPtr->addValAddr(&prevNode->mark, false, false);
+            descPtr->addReadValAddr(&prevNode->mark, false);
             descPtr->addValAddr(&currentNode->mark, false, true); // Marked so nothing can happen with inserts!
-            descPtr->addPtrAddr(&nextNode->mark, false, false);;
+            descPtr->addReadValAddr(&nextNode->mark, false);
             descPtr->addPtrAddr(&prevNode->next, (casword_t) currentNode, (casword_t) nextNode);
             descPtr->addPtrAddr(&nextNode->prev, (casword_t) currentNode, (casword_t) prevNode);
 
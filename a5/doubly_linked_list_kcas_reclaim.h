@@ -93,7 +93,7 @@ DoublyLinkedListReclaim::~DoublyLinkedListReclaim() {
 bool DoublyLinkedListReclaim::contains(const int tid, const int & key) {
     assert(key > minKey - 1 && key >= minKey && key <= maxKey && key < maxKey + 1);
 
-    recmgr->getGuard(tid);
+    auto guard = recmgr->getGuard(tid, true);
 
     // Loop from the left of the list until we find the value. 
     Node * currentNode = head;
@@ -101,8 +101,8 @@ bool DoublyLinkedListReclaim::contains(const int tid, const int & key) {
         if (key == currentNode->data) {
             return true;
         }
-        if ((bool) kcas.readVal(tid, &currentNode->next) != NULL) {
-            currentNode = (Node *) kcas.readPtr(tid, &currentNode->next);
+        if ((bool) kcas.KCAS_SEARCH_READ_VAL(tid, &currentNode->next) != NULL) {
+            currentNode = (Node *) kcas.KCAS_SEARCH_READ_PTR(tid, &currentNode->next);
         }
         else {
             return false;
@@ -114,7 +114,7 @@ bool DoublyLinkedListReclaim::contains(const int tid, const int & key) {
 bool DoublyLinkedListReclaim::insertIfAbsent(const int tid, const int & key) {
     assert(key > minKey - 1 && key >= minKey && key <= maxKey && key < maxKey + 1);
 
-    recmgr->getGuard(tid);
+    auto guard = recmgr->getGuard(tid);
     // Loop from the left of the list until we find the value. 
     Node * currentNode = head;
     while (key >= currentNode->data && (key < tail->data)) {
@@ -129,8 +129,8 @@ bool DoublyLinkedListReclaim::insertIfAbsent(const int tid, const int & key) {
     setupNode(tid, newNode, prevNode, currentNode, key);
     
     auto descPtr = kcas.getDescriptor(tid);
-    descPtr->addValAddr(&prevNode->mark, false, false);
-    descPtr->addValAddr(&currentNode->mark, false, false);
+    descPtr->addReadValAddr(&prevNode->mark, false);
+    descPtr->addReadValAddr(&currentNode->mark, false);
     descPtr->addPtrAddr(&prevNode->next, (casword_t) currentNode,(casword_t) newNode);
     descPtr->addPtrAddr(&currentNode->prev, (casword_t) prevNode, (casword_t) newNode);
 
@@ -147,7 +147,7 @@ bool DoublyLinkedListReclaim::insertIfAbsent(const int tid, const int & key) {
 bool DoublyLinkedListReclaim::erase(const int tid, const int & key) {
     assert(key > minKey - 1 && key >= minKey && key <= maxKey && key < maxKey + 1);
 
-    recmgr->getGuard(tid);
+    auto guard = recmgr->getGuard(tid);
     // Loop from the left of the list until we find the value. 
     Node * currentNode = head;
     while (key >= currentNode->data && (key < tail->data)) {
@@ -157,9 +157,9 @@ bool DoublyLinkedListReclaim::erase(const int tid, const int & key) {
             Node * nextNode = (Node *) kcas.readPtr(tid, &currentNode->next);
             
             auto descPtr = kcas.getDescriptor(tid);
-            descPtr->addValAddr(&prevNode->mark, false, false);
+            descPtr->addReadValAddr(&prevNode->mark, false);
             descPtr->addValAddr(&currentNode->mark, false, true); // Marked so nothing can happen with inserts!
-            descPtr->addPtrAddr(&nextNode->mark, false, false);;
+            descPtr->addReadValAddr(&nextNode->mark, false);
             descPtr->addPtrAddr(&prevNode->next, (casword_t) currentNode, (casword_t) nextNode);
             descPtr->addPtrAddr(&nextNode->prev, (casword_t) currentNode, (casword_t) prevNode);
 
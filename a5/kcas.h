@@ -4,8 +4,15 @@
 #include <stdint.h>
 #include <sstream>
 #include <cstring>
+#include <array>
+#include <utility>
 using namespace std;
 
+/**
+ * Compile with -DKCAS_GENERIC to use the original, K-independent code paths (bubble sort, loops over the entries,
+ * whole-descriptor snapshots) instead of the ones specialized for MAX_K below. kcas_benchmark compares the two.
+ */
+
 /**
  * Note: this algorithm supports a limited number of threads (print LAST_TID to see how many).
  * It should be several thousand, at least.
@@ -149,6 +156,16 @@ typedef intptr_t seqbits_t;
 
 #define KCAS_LEFTSHIFT 2
 
+// what read-only searches (contains) use: with -DKCAS_NONHELPING_READS, reads that take the logical value of a kcas
+// they find instead of helping it. updates always use readPtr/readVal, which help
+#ifdef KCAS_NONHELPING_READS
+    #define KCAS_SEARCH_READ_PTR readPtrNoHelp
+    #define KCAS_SEARCH_READ_VAL readValNoHelp
+#else
+    #define KCAS_SEARCH_READ_PTR readPtr
+    #define KCAS_SEARCH_READ_VAL readVal
+#endif
+
 struct rdcssdesc_t {
     volatile seqbits_t seqBits;
     casword_t volatile * addr1;
@@ -166,6 +183,26 @@ struct kcasentry_t { // just part of kcasdesc_t, not a standalone descriptor
     casword_t newval;
 };
 
+/**
+ * A read entry (added with addReadValAddr/addReadPtrAddr) only checks that its address still holds oldval: it is
+ * never locked or written. It is marked by setting the low bit of addr (addresses are word aligned), so it sorts
+ * with the other entries and costs no extra space in the descriptor.
+ *
+ * Read entries keep the engine lock-free. A read that finds an undecided kcas in its word does not help it through
+ * phase 1 (that kcas may need a word we hold), and instead resolves the conflict by tagptr (see validateRead): the
+ * kcas with the larger tagptr wins and the other is decided as failed. So among kcases that conflict through
+ * reads, the one with the largest tagptr is never failed by another, and some kcas always completes.
+ */
+#define KCAS_READ_ENTRY 0x1
+
+static inline bool kcasentry_isRead(const kcasentry_t & entry) {
+    return ((uintptr_t) entry.addr) & KCAS_READ_ENTRY;
+}
+
+static inline casword_t volatile * kcasentry_readAddr(const kcasentry_t & entry) {
+    return (casword_t volatile *) (((uintptr_t) entry.addr) & ~(uintptr_t) KCAS_READ_ENTRY);
+}
+
 template <int MAX_K>
 class kcasdesc_t {
 public:
@@ -175,6 +212,11 @@ public:
     const static int size = sizeof(seqBits)+sizeof(numEntries)+sizeof(entries);
     volatile char padding[128+((64-size%64)%64)]; // add padding to prevent false sharing
     
+    // bytes of the descriptor that hold its first n entries (what a snapshot needs to copy)
+    static int sizeWith(const casword_t n) {
+        return sizeof(seqBits)+sizeof(numEntries)+n*sizeof(kcasentry_t);
+    }
+    
     void addValAddr(casword_t * addr, casword_t oldval, casword_t newval) {
         entries[numEntries].addr = addr;
         entries[numEntries].oldval = oldval << KCAS_LEFTSHIFT;
@@ -190,6 +232,21 @@ public:
         ++numEntries;
         assert(numEntries <= MAX_K);
     }
+
+    // the kcas succeeds only if addr holds expected when it takes effect (addr must not also be written by it).
+    // validation assumes addr never returns to expected after changing (e.g., a mark that is only ever set), or
+    // cannot change at all while the kcas holds its write entries (e.g., a child pointer of a node it marks)
+    void addReadValAddr(casword_t * addr, casword_t expected) {
+        addReadPtrAddr(addr, expected << KCAS_LEFTSHIFT);
+    }
+
+    void addReadPtrAddr(casword_t * addr, casword_t expected) {
+        entries[numEntries].addr = (casword_t volatile *) (((uintptr_t) addr) | KCAS_READ_ENTRY);
+        entries[numEntries].oldval = expected;
+        entries[numEntries].newval = expected;
+        ++numEntries;
+        assert(numEntries <= MAX_K);
+    }
 };
 
 template <int MAX_K>
@@ -220,6 +277,8 @@ public:
     void writeInitVal(const int tid, casword_t volatile * addr, casword_t const newval);
     casword_t readPtr(const int tid, casword_t volatile * addr);
     casword_t readVal(const int tid, casword_t volatile * addr);
+    casword_t readPtrNoHelp(const int tid, casword_t volatile * addr);
+    casword_t readValNoHelp(const int tid, casword_t volatile * addr);
     bool execute(const int tid, kcasptr_t ptr);
     kcasptr_t getDescriptor(const int tid);
 private:
@@ -229,6 +288,10 @@ private:
     casword_t rdcss(const int tid, rdcssptr_t ptr, rdcsstagptr_t tagptr);
     void rdcssHelp(rdcsstagptr_t tagptr, rdcssptr_t snapshot, bool helpingOther);
     void rdcssHelpOther(rdcsstagptr_t tagptr);
+    bool lockEntry(const int tid, kcastagptr_t tagptr, kcasptr_t ptr, kcasentry_t * entry);
+    template <int I> bool lockEntries(const int tid, kcastagptr_t tagptr, kcasptr_t ptr, kcasptr_t snapshot, const int first);
+    template <int I> void unlockEntries(kcastagptr_t tagptr, kcasptr_t snapshot, const bool succeeded);
+    bool validateRead(const int tid, kcastagptr_t tagptr, kcasentry_t * entry);
 };
 
 static bool isRdcss(casword_t val) {
@@ -296,13 +359,108 @@ KCASLockFree<MAX_K>::KCASLockFree() {
 template <int MAX_K>
 void KCASLockFree<MAX_K>::helpOther(const int tid, kcastagptr_t tagptr) {
     kcasdesc_t<MAX_K> newSnapshot;
+#ifdef KCAS_GENERIC
     const int sz = kcasdesc_t<MAX_K>::size;
+#else
+    // copy only the entries in use. numEntries may be torn if the descriptor is being reused, but then the
+    // sequence number check in DESC_SNAPSHOT fails, so clamping it is enough to keep the copy in bounds
+    const casword_t n = *(casword_t volatile *) &TAGPTR_UNPACK_PTR(kcasDescriptors, tagptr)->numEntries;
+    const int sz = kcasdesc_t<MAX_K>::sizeWith(n < MAX_K ? n : MAX_K);
+#endif
     //cout<<"size of kcas descriptor is "<<sizeof(kcasdesc_t<MAX_K>)<<" and sz="<<sz<<endl;
     if (DESC_SNAPSHOT(kcasdesc_t<MAX_K>, kcasDescriptors, &newSnapshot, tagptr, sz)) {
         help(tid, tagptr, &newSnapshot, true);
     }
 }
 
+// phase 1 for one entry: "lock" entry->addr for this kcas with an rdcss (helping any other kcas in the way).
+// returns false if the address held a value other than entry->oldval
+template <int MAX_K>
+bool KCASLockFree<MAX_K>::lockEntry(const int tid, kcastagptr_t tagptr, kcasptr_t ptr, kcasentry_t * entry) {
+    if (kcasentry_isRead(*entry)) return true; // validated once the writes are locked
+    while (true) {
+        // prepare rdcss descriptor and run rdcss
+        rdcssdesc_t *rdcssptr = DESC_NEW(rdcssDescriptors, RDCSS_SEQBITS_NEW, tid);
+        rdcssptr->addr1 = (casword_t*) &ptr->seqBits;
+        rdcssptr->old1 = tagptr; // pass the sequence number (as part of tagptr)
+        rdcssptr->old2 = entry->oldval;
+        rdcssptr->addr2 = entry->addr; // p stopped here (step 2)
+        rdcssptr->new2 = (casword_t) tagptr;
+        DESC_INITIALIZED(rdcssDescriptors, tid);
+        
+        casword_t val;
+        val = rdcss(tid, rdcssptr, TAGPTR_NEW(tid, rdcssptr->seqBits, RDCSS_TAGBIT));
+        
+        // check for failure of rdcss and handle it
+        if (isKcas(val)) {
+            // if rdcss failed because of a /different/ kcas, we help it
+            if (val != (casword_t) tagptr) {
+                helpOther(tid, (kcastagptr_t) val);
+                continue;
+            }
+        } else {
+            if (val != entry->oldval) return false;
+        }
+        return true;
+    }
+}
+
+// phase 1 for entries I, I+1, ... of snapshot (skipping those before first), unrolled at compile time
+template <int MAX_K>
+template <int I>
+bool KCASLockFree<MAX_K>::lockEntries(const int tid, kcastagptr_t tagptr, kcasptr_t ptr, kcasptr_t snapshot, const int first) {
+    if constexpr (I < MAX_K) {
+        if (I >= (int) snapshot->numEntries) return true;
+        if (I >= first && !lockEntry(tid, tagptr, ptr, &snapshot->entries[I])) return false;
+        return lockEntries<I+1>(tid, tagptr, ptr, snapshot, first);
+    } else {
+        return true;
+    }
+}
+
+// phase 2 for entries I, I+1, ... of snapshot, unrolled at compile time
+template <int MAX_K>
+template <int I>
+void KCASLockFree<MAX_K>::unlockEntries(kcastagptr_t tagptr, kcasptr_t snapshot, const bool succeeded) {
+    if constexpr (I < MAX_K) {
+        if (I >= (int) snapshot->numEntries) return;
+        if (!kcasentry_isRead(snapshot->entries[I])) {
+            casword_t newval = succeeded ? snapshot->entries[I].newval : snapshot->entries[I].oldval;
+            BOOL_CAS(snapshot->entries[I].addr, (casword_t) tagptr, newval);
+        }
+        unlockEntries<I+1>(tagptr, snapshot, succeeded);
+    }
+}
+
+// after phase 1 locked every write entry: does the read entry's address (logically) still hold its expected value?
+// a word locked by a kcas that has already decided is helped (that is just its phase 2). one that is still undecided
+// may be waiting on a word we hold, so running its phase 1 could lead straight back to us. instead, the kcas with
+// the larger tagptr wins: if the other one's tagptr is below ours, we decide it (as failed) and help it unlock,
+// and if it is above ours, we fail. of two kcases that each read a word the other writes, exactly one proceeds
+// (see KCAS_READ_ENTRY). given the assumption on read entries (see addReadPtrAddr), a read that validates also
+// held its expected value when our last write entry was locked, which is where a successful kcas takes effect.
+template <int MAX_K>
+bool KCASLockFree<MAX_K>::validateRead(const int tid, kcastagptr_t tagptr, kcasentry_t * entry) {
+    casword_t volatile * addr = kcasentry_readAddr(*entry);
+    while (true) {
+        casword_t val = rdcssRead(tid, addr);
+        if (!isKcas(val)) return val == entry->oldval;
+        assert(val != (casword_t) tagptr); // an address is never both read and written by one kcas
+        kcasdesc_t<MAX_K> * other = TAGPTR_UNPACK_PTR(kcasDescriptors, val);
+        bool successBit;
+        int state = DESC_READ_FIELD(successBit, other->seqBits, val, KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE);
+        if (successBit && state == KCAS_STATE_UNDECIDED) {
+            if (val > (casword_t) tagptr) return false;
+            // fails only if the other kcas decided (or finished) meanwhile; either way it is no longer undecided
+            SEQBITS_CAS_FIELD(successBit
+            , other->seqBits, val
+            , KCAS_STATE_UNDECIDED, KCAS_STATE_FAILED
+            , KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE);
+        }
+        helpOther(tid, (kcastagptr_t) val);
+    }
+}
+
 template <int MAX_K>
 bool KCASLockFree<MAX_K>::help(const int tid, kcastagptr_t tagptr, kcasptr_t snapshot, bool helpingOther) {
     // phase 1: "locking" addresses for this kcas
@@ -318,33 +476,20 @@ bool KCASLockFree<MAX_K>::help(const int tid, kcastagptr_t tagptr, kcasptr_t sna
     }
     
     if (state == KCAS_STATE_UNDECIDED) {
+#ifdef KCAS_GENERIC
         newstate = KCAS_STATE_SUCCEEDED;
         for (int i = helpingOther; i < snapshot->numEntries; i++) {
-retry_entry:
-            // prepare rdcss descriptor and run rdcss
-            rdcssdesc_t *rdcssptr = DESC_NEW(rdcssDescriptors, RDCSS_SEQBITS_NEW, tid);
-            rdcssptr->addr1 = (casword_t*) &ptr->seqBits;
-            rdcssptr->old1 = tagptr; // pass the sequence number (as part of tagptr)
-            rdcssptr->old2 = snapshot->entries[i].oldval;
-            rdcssptr->addr2 = snapshot->entries[i].addr; // p stopped here (step 2)
-            rdcssptr->new2 = (casword_t) tagptr;
-            DESC_INITIALIZED(rdcssDescriptors, tid);
-            
-            casword_t val;
-            val = rdcss(tid, rdcssptr, TAGPTR_NEW(tid, rdcssptr->seqBits, RDCSS_TAGBIT));
-            
-            // check for failure of rdcss and handle it
-            if (isKcas(val)) {
-                // if rdcss failed because of a /different/ kcas, we help it
-                if (val != (casword_t) tagptr) {
-                    helpOther(tid, (kcastagptr_t) val);
-                    goto retry_entry;
-                }
-            } else {
-                if (val != snapshot->entries[i].oldval) {
-                    newstate = KCAS_STATE_FAILED;
-                    break;
-                }
+            if (!lockEntry(tid, tagptr, ptr, &snapshot->entries[i])) {
+                newstate = KCAS_STATE_FAILED;
+                break;
+            }
+        }
+#else
+        newstate = lockEntries<0>(tid, tagptr, ptr, snapshot, helpingOther) ? KCAS_STATE_SUCCEEDED : KCAS_STATE_FAILED;
+#endif
+        for (int i = 0; newstate == KCAS_STATE_SUCCEEDED && i < (int) snapshot->numEntries; i++) {
+            if (kcasentry_isRead(snapshot->entries[i]) && !validateRead(tid, tagptr, &snapshot->entries[i])) {
+                newstate = KCAS_STATE_FAILED;
             }
         }
         SEQBITS_CAS_FIELD(successBit
@@ -358,17 +503,91 @@ retry_entry:
 
     bool succeeded = (state == KCAS_STATE_SUCCEEDED);
 
+#ifdef KCAS_GENERIC
     for (int i = 0; i < snapshot->numEntries; i++) {
+        if (kcasentry_isRead(snapshot->entries[i])) continue;
         casword_t newval = succeeded ? snapshot->entries[i].newval : snapshot->entries[i].oldval;
         BOOL_CAS(snapshot->entries[i].addr, (casword_t) tagptr, newval);
     }
+#else
+    unlockEntries<0>(tagptr, snapshot, succeeded);
+#endif
 
     return succeeded;
 }
 
-// TODO: replace crappy bubblesort with something fast for large MAX_K (maybe even use insertion sort for small MAX_K)
+/**
+ * Sorting networks for the entries of a kcas descriptor, built at compile time: Batcher's merge exchange
+ * (Knuth, TAOCP vol. 3, 5.2.2, Algorithm M), which works for any number of inputs n. A network with C comparators
+ * runs as C straight-line compare-exchanges with no loop or data-dependent control flow beyond the swaps.
+ */
+struct kcasComparator {
+    uint8_t a, b;
+};
+
+template <int N>
+struct kcasSortNetwork {
+    // visit(a, b) for each comparator of the network, in order
+    template <class Visit>
+    static constexpr void generate(Visit visit) {
+        int t = 0;
+        while ((1 << t) < N) ++t;
+        for (int p = (t ? 1 << (t-1) : 0); p > 0; p >>= 1) {
+            int q = 1 << (t-1), r = 0, d = p;
+            while (true) {
+                for (int i = 0; i < N - d; ++i) {
+                    if ((i & p) == r) visit(i, i + d);
+                }
+                if (q == p) break;
+                d = q - p;
+                q >>= 1;
+                r = p;
+            }
+        }
+    }
+    static constexpr int countComparators() {
+        int count = 0;
+        generate([&](int, int) { ++count; });
+        return count;
+    }
+    static constexpr int SIZE = countComparators();
+    static constexpr array<kcasComparator, SIZE> makeComparators() {
+        array<kcasComparator, SIZE> result {};
+        int i = 0;
+        generate([&](int a, int b) { result[i].a = a; result[i].b = b; ++i; });
+        return result;
+    }
+    static constexpr array<kcasComparator, SIZE> comparators = makeComparators();
+};
+
+static inline void kcasentry_compareExchange(kcasentry_t & x, kcasentry_t & y) {
+    if (x.addr > y.addr) {
+        kcasentry_t temp = x;
+        x = y;
+        y = temp;
+    }
+}
+
+template <int N, size_t... I>
+static inline void kcasentry_sortNetwork(kcasentry_t * entries, index_sequence<I...>) {
+    (kcasentry_compareExchange(entries[kcasSortNetwork<N>::comparators[I].a], entries[kcasSortNetwork<N>::comparators[I].b]), ...);
+}
+
+// sort the first n entries with the network for exactly n inputs (for each n <= N, chosen at compile time)
+template <int N>
+static inline void kcasentry_sort(kcasentry_t * entries, const int n) {
+    if constexpr (N >= 2) {
+        if (n == N) {
+            kcasentry_sortNetwork<N>(entries, make_index_sequence<kcasSortNetwork<N>::SIZE>());
+        } else {
+            kcasentry_sort<N-1>(entries, n);
+        }
+    }
+}
+
 template <int MAX_K>
 static void kcasdesc_sort(kcasptr_t ptr) {
+#ifdef KCAS_GENERIC
     kcasentry_t temp;
     for (int i = 0; i < ptr->numEntries; i++) {
         for (int j = 0; j < ptr->numEntries - i - 1; j++) {
@@ -379,6 +598,9 @@ static void kcasdesc_sort(kcasptr_t ptr) {
             }
         }
     }
+#else
+    kcasentry_sort<MAX_K>(ptr->entries, ptr->numEntries);
+#endif
 }
 
 template <int MAX_K>
@@ -410,6 +632,49 @@ casword_t KCASLockFree<MAX_K>::readVal(const int tid, casword_t volatile * addr)
     return ((casword_t) readPtr(tid, addr))>>KCAS_LEFTSHIFT;
 }
 
+// like readPtr, but never helps. a word that holds a descriptor gets its logical value from the descriptor: an
+// rdcss is always replacing old2 with a kcas that has not decided yet (or will put old2 back), so the value is
+// old2, and a kcas entry's value is newval if the kcas has succeeded and oldval otherwise. the fields are read
+// optimistically and kept only if the descriptor's sequence number still matches the tagptr afterwards. the kcas
+// state is read after the word, and both values were current at some point in between, which is where the read
+// takes effect
+template <int MAX_K>
+casword_t KCASLockFree<MAX_K>::readPtrNoHelp(const int tid, casword_t volatile * addr) {
+    while (true) {
+        casword_t r = *addr;
+        if (isRdcss(r)) {
+            rdcssdesc_t * rdcssptr = TAGPTR_UNPACK_PTR(rdcssDescriptors, r);
+            const casword_t val = rdcssptr->old2;
+            __asm__ __volatile__ ("":::"memory");
+            if (UNPACK_SEQ(rdcssptr->seqBits) == UNPACK_SEQ(r)) return val;
+            continue; // the descriptor was reused, so the rdcss is over
+        }
+        if (!isKcas(r)) return r;
+
+        kcasptr_t ptr = TAGPTR_UNPACK_PTR(kcasDescriptors, r);
+        const seqbits_t seqBits = ptr->seqBits;
+        if (UNPACK_SEQ(seqBits) != UNPACK_SEQ(r)) continue;
+        const bool succeeded = (SEQBITS_UNPACK_FIELD(seqBits, KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE) == KCAS_STATE_SUCCEEDED);
+        const casword_t n = ptr->numEntries;
+        bool found = false;
+        casword_t val = 0;
+        for (int i = 0; i < (int) (n < MAX_K ? n : MAX_K); i++) {
+            if (ptr->entries[i].addr == addr) {
+                val = succeeded ? ptr->entries[i].newval : ptr->entries[i].oldval;
+                found = true;
+                break;
+            }
+        }
+        __asm__ __volatile__ ("":::"memory");
+        if (found && UNPACK_SEQ(ptr->seqBits) == UNPACK_SEQ(r)) return val;
+    }
+}
+
+template <int MAX_K>
+casword_t KCASLockFree<MAX_K>::readValNoHelp(const int tid, casword_t volatile * addr) {
+    return ((casword_t) readPtrNoHelp(tid, addr))>>KCAS_LEFTSHIFT;
+}
+
 template <int MAX_K>
 void KCASLockFree<MAX_K>::writeInitPtr(const int tid, casword_t volatile * addr, casword_t const newval) {
     *addr = newval;
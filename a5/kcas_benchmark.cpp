@@ -0,0 +1,204 @@
+/**
+ * A KCAS microbenchmark: threads repeatedly increment K random words with one K-CAS, for each K in [1, maxK].
+ *
+ * Each K runs with its own KCASLockFree<K>, so the specialized code paths (sorting networks, unrolled phases and
+ * partial snapshots, see kcas.h) are the ones for exactly that K. Build with -DKCAS_GENERIC (make
+ * kcas_benchmark_generic) to run the same sweep on the original generic code paths.
+ *
+ * Every successful K-CAS adds K to the sum of the words, which is checked at the end of each K.
+ */
+
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include "defines.h"
+#include "util.h"
+
+#include "kcas.h"
+
+using namespace std;
+
+#define MAX_SWEEP_K 16
+
+// one word per cache line, so the K entries of a K-CAS are K different lines
+struct paddedWord {
+    casword_t volatile v;
+    volatile char padding[PADDING_BYTES - sizeof(casword_t)];
+};
+
+struct kResult {
+    long long ops;
+    long long successes;
+    int64_t elapsedMillis;
+};
+
+template <int K>
+kResult runK(const int numWords, const int millisToRun, const int totalThreads) {
+    auto kcas = new KCASLockFree<K>();
+    auto words = new paddedWord[numWords];
+    for (int i=0;i<numWords;++i) kcas->writeInitVal(0, &words[i].v, 0);
+
+    PaddedRandom rngs[MAX_THREADS];
+    for (int i=0;i<MAX_THREADS;++i) rngs[i].setSeed(i+1);
+    debugCounter numTotalOps;
+    debugCounter numSuccesses;
+    ElapsedTimer timer;
+    volatile bool done = false;
+    volatile bool start = false;
+    atomic_int running(0);
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+            const int OPS_BETWEEN_TIME_CHECKS = 500;
+            int indices[K];
+
+            // BARRIER WAIT
+            running.fetch_add(1);
+            while (!start) { TRACE TPRINT("waiting to start"<<endl); }
+
+            for (int cnt=0; !done; ++cnt) {
+                if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0
+                        && timer.getElapsedMillis() >= millisToRun)
+                    done = true;
+
+                // K distinct words
+                for (int i=0;i<K;++i) {
+                    bool duplicate;
+                    do {
+                        indices[i] = rngs[tid].nextNatural() % numWords;
+                        duplicate = false;
+                        for (int j=0;j<i;++j) duplicate |= (indices[j] == indices[i]);
+                    } while (duplicate);
+                }
+
+                auto desc = kcas->getDescriptor(tid);
+                for (int i=0;i<K;++i) {
+                    casword_t volatile * addr = &words[indices[i]].v;
+                    casword_t old = kcas->readVal(tid, addr);
+                    desc->addValAddr((casword_t *) addr, old, old+1);
+                }
+                if (kcas->execute(tid, desc)) numSuccesses.inc(tid);
+                numTotalOps.inc(tid);
+            }
+
+            running.fetch_add(-1);
+        });
+    }
+
+    while (running < totalThreads) {}
+    timer.startTimer();
+    __sync_synchronize();
+    start = true;
+    while (running > 0) {}
+
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    kResult result;
+    result.elapsedMillis = timer.getElapsedMillis();
+    result.ops = numTotalOps.getTotal();
+    result.successes = numSuccesses.getTotal();
+
+    long long sum = 0;
+    for (int i=0;i<numWords;++i) sum += kcas->readVal(0, &words[i].v);
+    cout<<"K="<<K<<" Validation: sum of words = "<<sum<<" and K * successful kcas = "<<(K * result.successes)<<".";
+    cout<<((sum == K * result.successes) ? " OK." : " FAILED.")<<endl;
+    if (sum != K * result.successes) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    delete[] words;
+    delete kcas;
+    return result;
+}
+
+// run K = 1, 2, ..., maxK (each with its own KCASLockFree<K>)
+template <int K>
+void sweep(const int maxK, const int numWords, const int millisToRun, const int totalThreads, kResult * results) {
+    if constexpr (K <= MAX_SWEEP_K) {
+        if (K > maxK) return;
+        results[K] = runK<K>(numWords, millisToRun, totalThreads);
+        sweep<K+1>(maxK, numWords, millisToRun, totalThreads, results);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
+        cout<<"Options:"<<endl;
+        cout<<"    -t [int]     milliseconds to run for each K"<<endl;
+        cout<<"    -s [int]     number of words that K-CASes pick their K words from"<<endl;
+        cout<<"    -n [int]     number of threads"<<endl;
+        cout<<"    -k [int]     largest K to run (K = 1, 2, ..., k; at most "<<MAX_SWEEP_K<<")"<<endl;
+        cout<<endl;
+        cout<<"Example: "<<argv[0]<<" -t 1000 -s 1000000 -n 16 -k 16"<<endl;
+        return 1;
+    }
+
+    int millisToRun = -1;
+    int numWords = 0;
+    int totalThreads = 0;
+    int maxK = MAX_SWEEP_K;
+
+    for (int i=1;i<argc;++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            numWords = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            totalThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            maxK = atoi(argv[++i]);
+        } else {
+            cout<<"bad arguments"<<endl;
+            exit(1);
+        }
+    }
+
+    std::cout<<"Cmd:";
+    for (int i=0;i<argc;++i) {
+        std::cout<<" "<<argv[i];
+    }
+    std::cout<<std::endl;
+
+#ifdef KCAS_GENERIC
+    const char * engine = "generic";
+#else
+    const char * engine = "specialized";
+#endif
+    PRINT(engine);
+    PRINT(MAX_THREADS);
+    PRINT(totalThreads);
+    PRINT(numWords);
+    PRINT(maxK);
+    PRINT(millisToRun);
+    cout<<endl;
+
+    if (totalThreads >= MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+        return 1;
+    }
+    if (maxK < 1 || maxK > MAX_SWEEP_K || numWords < maxK) {
+        cout<<"need 1 <= -k <= "<<MAX_SWEEP_K<<" and -s >= -k"<<endl;
+        return 1;
+    }
+
+    kResult results[MAX_SWEEP_K+1];
+    sweep<1>(maxK, numWords, millisToRun, totalThreads, results);
+
+    cout<<endl;
+    cout<<"K\tthroughput\tsuccess%"<<endl;
+    for (int k=1;k<=maxK;++k) {
+        cout<<k<<"\t"<<(long long) (results[k].ops * 1000. / results[k].elapsedMillis)
+            <<"\t"<<(100. * results[k].successes / max(1LL, results[k].ops))<<endl;
+    }
+    return 0;
+}
@@ -198,6 +198,10 @@ void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double i
      */
     
     g->ds->printDebuggingDetails();
+#if !defined(KCAS_KPLUS1) && !defined(KCAS_LOCKED)
+    kcas::instance.printContentionStats();
+    cout<<endl;
+#endif
     
     auto numTotalOps = g->numTotalOps.getTotal();
     auto dsSumOfKeys = g->ds->getSumOfKeys();
@@ -271,6 +275,23 @@ int main(int argc, char** argv) {
     std::cout<<std::endl;
     
     // print configuration for debugging
+#ifdef KCAS_KPLUS1
+    const char * kcasEngine = "kplus1";
+#elif defined(KCAS_LOCKED)
+    const char * kcasEngine = "locked";
+#else
+    const char * kcasEngine = "reuse";
+#endif
+    PRINT(kcasEngine);
+#ifdef KCAS_NONHELPING_READS
+    const char * kcasReads = "nonhelping";
+#else
+    const char * kcasReads = "helping";
+#endif
+    PRINT(kcasReads);
+#ifdef KCAS_LOCKED
+    PRINT(KCAS_LOCK_TABLE_BITS);
+#endif
     PRINT(MAX_THREADS);
     PRINT(totalThreads);
     PRINT(keyRangeSize);
@@ -10,10 +10,27 @@ using namespace std;
 #define SHIFT_BITS 2
 #define CASWORD_CAST(x) ((CASWORD_BITS_TYPE) (x))
 
+// with -DKCAS_NONHELPING_READS, reading a casword takes the logical value of a kcas it finds instead of helping it.
+// updates still help the kcases in their way, in execute
+#ifdef KCAS_NONHELPING_READS
+    #define CASWORD_READ_PTR readPtrNoHelp
+    #define CASWORD_READ_VAL readValNoHelp
+#else
+    #define CASWORD_READ_PTR readPtr
+    #define CASWORD_READ_VAL readVal
+#endif
+
 template <typename T>
 casword<T>::casword(){
-    T a;
-    bits =  bits = CASWORD_CAST(a);
+    bits = CASWORD_CAST(T());
+}
+
+// with KCASKPlus1, a word that still points into a descriptor holds a reference to it, which dies with the word
+template <typename T>
+casword<T>::~casword(){
+#ifdef KCAS_KPLUS1
+    kcas::instance.releaseWord(&bits);
+#endif
 }
 
 template <typename T>
@@ -33,10 +50,10 @@ T casword<T>::setInitVal(T other) {
 template <typename T>
 casword<T>::operator T() {
     if(is_pointer<T>::value){
-	return (T)kcas::instance.readPtr(&bits);
+	return (T)kcas::instance.CASWORD_READ_PTR(&bits);
     }
     else {
-	return (T)kcas::instance.readVal(&bits);
+	return (T)kcas::instance.CASWORD_READ_VAL(&bits);
     }
 }
 
@@ -49,10 +66,10 @@ T casword<T>::operator->() {
 template <typename T>
 T casword<T>::getValue(){
     if(is_pointer<T>::value){
-	return (T)kcas::instance.readPtr(&bits);
+	return (T)kcas::instance.CASWORD_READ_PTR(&bits);
     }
     else {
-	return (T)kcas::instance.readVal(&bits);
+	return (T)kcas::instance.CASWORD_READ_VAL(&bits);
     }
 }
 
@@ -70,3 +87,17 @@ void casword<T>::addToDescriptor(T oldVal, T newVal){
 	descriptor->addValAddr(&bits, c_oldVal, c_newVal);
     }
 }
+
+template <typename T>
+void casword<T>::addReadToDescriptor(T expected){
+    auto descriptor = kcas::instance.getDescriptor();
+    auto c_expected = (casword_t)expected;
+    assert((c_expected & 0xE000000000000000) == 0);
+
+    if(is_pointer<T>::value){
+	descriptor->addReadPtrAddr(&bits, c_expected);
+    }
+    else {
+	descriptor->addReadValAddr(&bits, c_expected);
+    }
+}
@@ -10,6 +10,8 @@ private:
 public:
     casword();
 
+    ~casword();
+
     T setInitVal(T other);
 
     operator T();
@@ -19,12 +21,23 @@ public:
     T getValue();
 
     void addToDescriptor(T oldVal, T newVal);
+
+    void addReadToDescriptor(T expected);
 };
 
-#include "kcas_reuse_impl.h"
+#ifdef KCAS_KPLUS1
+    #include "kcas_kplus1_impl.h"
+    typedef KCASKPlus1<MAX_KCAS> kcas_engine_t;
+#elif defined(KCAS_LOCKED)
+    #include "kcas_locked_impl.h"
+    typedef KCASLocked<MAX_KCAS> kcas_engine_t;
+#else
+    #include "kcas_reuse_impl.h"
+    typedef KCASLockFree<MAX_KCAS> kcas_engine_t;
+#endif
 
 namespace kcas {
-    KCASLockFree<MAX_KCAS> instance;
+    kcas_engine_t instance;
 
     void writeInitPtr(casword_t volatile * addr, casword_t const newval) {
         return instance.writeInitPtr(addr, newval);
@@ -42,6 +55,15 @@ namespace kcas {
         return instance.readVal(addr);
     }
 
+    // reads that return the logical value of a word without helping a kcas found in it
+    casword_t readPtrNoHelp(casword_t volatile * addr) {
+        return instance.readPtrNoHelp(addr);
+    }
+
+    casword_t readValNoHelp(casword_t volatile * addr) {
+        return instance.readValNoHelp(addr);
+    }
+
     bool execute() {
         return instance.execute();
     }
@@ -64,6 +86,17 @@ namespace kcas {
         instance.add(caswordptr, oldVal, newVal, args...);
     }
 
+    // read-only entries: the kcas also requires *caswordptr == expected, but does not lock or write it
+    template<typename T>
+    void addRead(casword<T> * caswordptr, T expected) {
+        return instance.addRead(caswordptr, expected);
+    }
+
+    template<typename T, typename... Args>
+    void addRead(casword<T> * caswordptr, T expected, Args... args) {
+        instance.addRead(caswordptr, expected, args...);
+    }
+
 };
 
 #include "casword.h"
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include "kcas_tid.h"
+
+/**
+ * Contention managers for KCASLockFree. When a thread finds another kcas in a word it needs (while locking its own
+ * entries, or while reading), the engine asks its contention manager whether to help that kcas now. If the manager
+ * says no, it has watched the word change (the other kcas got further on its own), and the caller just re-reads it.
+ *
+ * Compile with -DKCAS_CM=<one of the classes below> to choose one (the default is kcas_cm_help):
+ *   kcas_cm_help      help right away (the original behaviour)
+ *   kcas_cm_backoff   wait for the word to change before helping, for a number of spins that doubles each time
+ *                     waiting was not enough (up to KCAS_CM_MAX_SPINS) and halves after each successful kcas
+ *   kcas_cm_adaptive  wait (up to KCAS_CM_MAX_SPINS) only while waiting has recently been resolving conflicts,
+ *                     and help right away otherwise. it still waits on one conflict in KCAS_CM_SAMPLE, to notice
+ *                     when waiting starts to pay off again
+ *
+ * Each manager keeps per-thread counters, printed by printStats.
+ */
+
+#define KCAS_CM_MIN_SPINS 16
+#define KCAS_CM_MAX_SPINS 1024
+#define KCAS_CM_SAMPLE 16
+#define KCAS_CM_SCORE_ONE 1024          // fixed point 1.0 for kcas_cm_adaptive's success rate
+#define KCAS_CM_SCORE_THRESHOLD 256     // wait while at least 1/4 of recent waits resolved the conflict
+#define KCAS_CM_CHUNK_BITS 3
+#define KCAS_CM_CHUNK (1<<KCAS_CM_CHUNK_BITS)
+#define KCAS_CM_CHUNKS ((KCAS_MAX_THREADS+KCAS_CM_CHUNK-1)/KCAS_CM_CHUNK)
+
+#ifndef KCAS_CM
+#define KCAS_CM kcas_cm_help
+#endif
+
+class kcas_cm_base {
+protected:
+    struct threadCounters {
+        long long conflicts;    // times we found another kcas in a word we needed
+        long long helps;        // ... and helped it
+        long long waits;        // ... and it moved on while we waited
+        long long waitSpins;    // spins spent waiting
+        long long succeeded;    // our own kcases
+        long long failed;
+        int spins;              // kcas_cm_backoff: current wait
+        int score;              // kcas_cm_adaptive: recent rate of waits that resolved the conflict
+        volatile char padding[PADDING_BYTES - 6*sizeof(long long) - 2*sizeof(int)];
+    };
+
+private:
+    // like KCASLockFree's descriptors, the counters are allocated in chunks of KCAS_CM_CHUNK threads the first time
+    // a tid in the chunk needs them, so the manager does not add KCAS_MAX_THREADS cache lines to every engine
+    threadCounters * chunks[KCAS_CM_CHUNKS];
+
+    threadCounters * allocate(const int chunkIx) {
+        threadCounters * chunk = (threadCounters *) aligned_alloc(PADDING_BYTES, KCAS_CM_CHUNK*sizeof(threadCounters));
+        memset((void *) chunk, 0, KCAS_CM_CHUNK*sizeof(threadCounters));
+        for (int i=0;i<KCAS_CM_CHUNK;++i) {
+            chunk[i].spins = KCAS_CM_MIN_SPINS;
+            chunk[i].score = KCAS_CM_SCORE_ONE;
+        }
+        if (!__sync_bool_compare_and_swap(&chunks[chunkIx], NULL, chunk)) {
+            free(chunk);
+        }
+        return chunks[chunkIx];
+    }
+
+protected:
+    // tid's counters (only tid writes them)
+    threadCounters & counters(const int tid) {
+        assert(tid >= 0 && tid < KCAS_MAX_THREADS);
+        threadCounters * chunk = chunks[tid>>KCAS_CM_CHUNK_BITS];
+        if (__builtin_expect(chunk == NULL, 0)) chunk = allocate(tid>>KCAS_CM_CHUNK_BITS);
+        return chunk[tid&(KCAS_CM_CHUNK-1)];
+    }
+
+    // spin until *addr no longer holds seen, for at most maxSpins. returns true if it changed
+    bool waitForChange(const int tid, casword_t volatile * addr, const casword_t seen, const int maxSpins) {
+        threadCounters & c = counters(tid);
+        for (int i = 0; i < maxSpins; ++i) {
+            _mm_pause();
+            if (*addr != seen) {
+                c.waitSpins += i+1;
+                ++c.waits;
+                return true;
+            }
+        }
+        c.waitSpins += maxSpins;
+        return false;
+    }
+
+public:
+    kcas_cm_base() {
+        for (int i=0;i<KCAS_CM_CHUNKS;++i) chunks[i] = NULL;
+    }
+    ~kcas_cm_base() {
+        for (int i=0;i<KCAS_CM_CHUNKS;++i) free(chunks[i]);
+    }
+
+    void onExecute(const int tid, const bool succeeded) {
+        if (succeeded) ++counters(tid).succeeded;
+        else ++counters(tid).failed;
+    }
+
+    void printStats(const char * name) {
+        long long totals[6] = {};
+        for (int i=0;i<KCAS_CM_CHUNKS;++i) {
+            if (chunks[i] == NULL) continue;
+            for (int j=0;j<KCAS_CM_CHUNK;++j) {
+                const threadCounters & c = chunks[i][j];
+                totals[0] += c.conflicts;
+                totals[1] += c.helps;
+                totals[2] += c.waits;
+                totals[3] += c.waitSpins;
+                totals[4] += c.succeeded;
+                totals[5] += c.failed;
+            }
+        }
+        std::cout<<"kcas contention manager="<<name<<std::endl;
+        std::cout<<"    kcas succeeded="<<totals[4]<<" failed="<<totals[5]<<std::endl;
+        std::cout<<"    conflicts="<<totals[0]<<" helped="<<totals[1]<<" resolved by waiting="<<totals[2]
+                 <<" wait spins="<<totals[3]<<std::endl;
+    }
+};
+
+class kcas_cm_help : public kcas_cm_base {
+public:
+    static constexpr const char * NAME = "help";
+
+    bool shouldHelp(const int tid, casword_t volatile * addr, const casword_t seen) {
+        threadCounters & c = counters(tid);
+        ++c.conflicts;
+        ++c.helps;
+        return true;
+    }
+};
+
+class kcas_cm_backoff : public kcas_cm_base {
+public:
+    static constexpr const char * NAME = "backoff";
+
+    bool shouldHelp(const int tid, casword_t volatile * addr, const casword_t seen) {
+        threadCounters & c = counters(tid);
+        ++c.conflicts;
+        if (waitForChange(tid, addr, seen, c.spins)) return false;
+        if (c.spins < KCAS_CM_MAX_SPINS) c.spins *= 2;
+        ++c.helps;
+        return true;
+    }
+
+    void onExecute(const int tid, const bool succeeded) {
+        kcas_cm_base::onExecute(tid, succeeded);
+        threadCounters & c = counters(tid);
+        if (succeeded && c.spins > KCAS_CM_MIN_SPINS) c.spins /= 2;
+    }
+};
+
+class kcas_cm_adaptive : public kcas_cm_base {
+public:
+    static constexpr const char * NAME = "adaptive";
+
+    bool shouldHelp(const int tid, casword_t volatile * addr, const casword_t seen) {
+        threadCounters & c = counters(tid);
+        ++c.conflicts;
+        if (c.score < KCAS_CM_SCORE_THRESHOLD && (c.conflicts % KCAS_CM_SAMPLE) != 0) {
+            ++c.helps;
+            return true;
+        }
+        // exponentially weighted: each new outcome counts for 1/8
+        if (waitForChange(tid, addr, seen, KCAS_CM_MAX_SPINS)) {
+            c.score += (KCAS_CM_SCORE_ONE - c.score) >> 3;
+            return false;
+        }
+        c.score -= c.score >> 3;
+        ++c.helps;
+        return true;
+    }
+};
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <cassert>
+#include <stdint.h>
+#include <cstring>
+#include "kcas_tid.h"
+#include "../recordmgr/record_manager.h"
+using namespace std;
+
+/**
+ * A second kcas engine, after Guerraoui, Kogan, Marathe and Zablotchi, "Efficient Multi-word Compare and Swap"
+ * (DISC 2020). Compile with -DKCAS_KPLUS1 to use it instead of KCASLockFree (see kcas.h).
+ *
+ * Each entry of a descriptor doubles as a "word descriptor": a kcas installs a tagged pointer to its entry in each
+ * address with one CAS, then decides with one CAS on its status, and is done. A word keeps pointing to the entry
+ * of the last kcas that installed itself there, and its logical value is that entry's newval if the kcas
+ * succeeded and its oldval otherwise (until a later kcas replaces it). So an uncontended kcas costs k+1 CASes,
+ * against 3k+1 for KCASLockFree (an RDCSS install and completion plus a phase-2 CAS per entry).
+ *
+ * Descriptors come from a record manager (DEBRA). A descriptor holds one reference for its owner and one for each
+ * address pointing to one of its entries; whoever replaces such a pointer drops that reference, and whoever drops
+ * the last one retires the descriptor. Helpers only install an entry after taking a reference on its descriptor,
+ * which fails once the count has reached zero, so a retired descriptor is never installed again. A word that is
+ * freed with its node drops its reference too (casword's destructor).
+ *
+ * Installing, helping and deciding happen inside a guard. Since words never go back to plain values, a pointer to
+ * an entry can only reappear in a word after its descriptor is reused, which the guard rules out. That is what
+ * makes the single CAS per entry safe. readPtr does not take a guard for a word whose kcas has decided: the
+ * descriptor pool never frees memory while the engine exists, so it reads the entry and then checks that neither
+ * the descriptor's sequence number (bumped whenever it is reused) nor the word changed in the meantime.
+ *
+ * Read entries are validated after every write entry is installed, and resolve a conflict with another active kcas
+ * by descriptor address rather than by helping it (see validateRead), so the engine stays lock-free with them.
+ */
+
+#define BOOL_CAS __sync_bool_compare_and_swap
+#define VAL_CAS __sync_val_compare_and_swap
+
+#define kcasptr_t kplus1desc_t<MAX_KCAS>*
+
+#define KPLUS1_TAGBIT 0x2
+
+#define KPLUS1_STATUS_ACTIVE 0
+#define KPLUS1_STATUS_SUCCEEDED 1
+#define KPLUS1_STATUS_FAILED 2
+
+#define KCAS_LEFTSHIFT 2
+
+// marks a read entry (in the low bit of its addr), as in KCASLockFree
+#define KCAS_READ_ENTRY 0x1
+
+template <int MAX_K> struct kplus1desc_t;
+
+template <int MAX_K>
+struct kplus1entry_t { // just part of kplus1desc_t, not a standalone descriptor
+    casword_t volatile * addr;
+    casword_t oldval;
+    casword_t newval;
+    kplus1desc_t<MAX_K> * parent;
+
+    bool isRead() const {
+        return ((uintptr_t) addr) & KCAS_READ_ENTRY;
+    }
+    casword_t volatile * readAddr() const {
+        return (casword_t volatile *) (((uintptr_t) addr) & ~(uintptr_t) KCAS_READ_ENTRY);
+    }
+};
+
+template <int MAX_K>
+struct kplus1desc_t {
+    volatile int status;
+    volatile int refs;
+    volatile casword_t seq;
+    casword_t numEntries;
+    kplus1entry_t<MAX_K> entries[MAX_K];
+    const static int size = sizeof(status)+sizeof(refs)+sizeof(seq)+sizeof(numEntries)+sizeof(entries);
+    volatile char padding[64+((64-size%64)%64)]; // add padding to prevent false sharing
+
+    void addValAddr(casword_t volatile * addr, casword_t oldval, casword_t newval) {
+        addPtrAddr(addr, oldval << KCAS_LEFTSHIFT, newval << KCAS_LEFTSHIFT);
+    }
+
+    void addPtrAddr(casword_t volatile * addr, casword_t oldval, casword_t newval) {
+        entries[numEntries].addr = addr;
+        entries[numEntries].oldval = oldval;
+        entries[numEntries].newval = newval;
+        entries[numEntries].parent = this;
+        ++numEntries;
+        assert(numEntries <= MAX_K);
+    }
+
+    // see kcasdesc_t::addReadPtrAddr (kcas_reuse_impl.h)
+    void addReadValAddr(casword_t volatile * addr, casword_t expected) {
+        addReadPtrAddr(addr, expected << KCAS_LEFTSHIFT);
+    }
+
+    void addReadPtrAddr(casword_t volatile * addr, casword_t expected) {
+        addPtrAddr((casword_t volatile *) (((uintptr_t) addr) | KCAS_READ_ENTRY), expected, expected);
+    }
+};
+
+static bool isKplus1Entry(casword_t val) {
+    return (val & KPLUS1_TAGBIT);
+}
+
+template <int MAX_K>
+class KCASKPlus1 {
+private:
+    typedef record_manager<reclaimer_debra<>, allocator_new<>, pool_perthread_and_shared<>, kplus1desc_t<MAX_K>> RecordManager;
+
+    struct threadData {
+        kplus1desc_t<MAX_K> * current;  // being filled in by start/add, or NULL
+        volatile char padding[PADDING_BYTES - sizeof(kplus1desc_t<MAX_K> *)];
+    };
+
+    volatile char padding0[PADDING_BYTES];
+    RecordManager * recmgr;
+    volatile char padding1[PADDING_BYTES];
+    threadData threads[MAX_THREADS];
+    volatile char padding2[PADDING_BYTES];
+
+public:
+    KCASKPlus1();
+    ~KCASKPlus1();
+    void writeInitPtr(casword_t volatile * addr, casword_t const newval);
+    void writeInitVal(casword_t volatile * addr, casword_t const newval);
+    casword_t readPtr(casword_t volatile * addr);
+    casword_t readVal(casword_t volatile * addr);
+    casword_t readPtrNoHelp(casword_t volatile * addr);
+    casword_t readValNoHelp(casword_t volatile * addr);
+    bool execute();
+
+    kcasptr_t getDescriptor();
+    void start();
+    void deinitThread();
+    void releaseWord(casword_t volatile * addr);
+    template<typename T>
+    void add(casword<T> * caswordptr, T oldVal, T newVal);
+    template<typename T, typename... Args>
+    void add(casword<T> * caswordptr, T oldVal, T newVal, Args... args);
+    template<typename T>
+    void addRead(casword<T> * caswordptr, T expected);
+    template<typename T, typename... Args>
+    void addRead(casword<T> * caswordptr, T expected, Args... args);
+private:
+    static int tid();
+    casword_t readInternal(casword_t volatile * addr, kplus1desc_t<MAX_K> * self, casword_t * content);
+    bool help(kplus1desc_t<MAX_K> * desc);
+    bool validateRead(kplus1desc_t<MAX_K> * desc, kplus1entry_t<MAX_K> * entry);
+    bool acquire(kplus1desc_t<MAX_K> * desc);
+    void release(kplus1desc_t<MAX_K> * desc);
+};
+
+template <int MAX_K>
+KCASKPlus1<MAX_K>::KCASKPlus1() {
+    recmgr = new RecordManager(MAX_THREADS);
+    for (int i=0;i<MAX_THREADS;++i) threads[i].current = NULL;
+}
+
+// descriptors still installed in words are left to the data structure's lifetime (they die with the process)
+template <int MAX_K>
+KCASKPlus1<MAX_K>::~KCASKPlus1() {
+    delete recmgr;
+}
+
+template <int MAX_K>
+int KCASKPlus1<MAX_K>::tid() {
+    const int result = kcas_tid.getId();
+    assert(result >= 0 && result < MAX_THREADS);
+    return result;
+}
+
+// take a reference to desc so one of its entries can be installed. fails once desc has dropped its last reference
+// (then it has been decided, and every entry that was installed has been replaced)
+template <int MAX_K>
+bool KCASKPlus1<MAX_K>::acquire(kplus1desc_t<MAX_K> * desc) {
+    int refs = desc->refs;
+    while (refs > 0) {
+        int seen = VAL_CAS(&desc->refs, refs, refs+1);
+        if (seen == refs) return true;
+        refs = seen;
+    }
+    return false;
+}
+
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::release(kplus1desc_t<MAX_K> * desc) {
+    if (__sync_fetch_and_add(&desc->refs, -1) == 1) {
+        recmgr->retire(tid(), desc);
+    }
+}
+
+// addr is being freed (see casword's destructor): drop the reference it holds on the descriptor it points into, if
+// any. this is what lets descriptors installed in the words of unlinked nodes be reclaimed
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::releaseWord(casword_t volatile * addr) {
+    casword_t val = *addr;
+    if (!isKplus1Entry(val)) return;
+    auto guard = recmgr->getGuard(tid());
+    release(((kplus1entry_t<MAX_K> *) (val & ~(casword_t) KPLUS1_TAGBIT))->parent);
+}
+
+// the logical value of *addr (helping any other kcas that is still installing itself there). *content is set to
+// the word the value was taken from, for a CAS that replaces it. must be called inside a guard
+template <int MAX_K>
+casword_t KCASKPlus1<MAX_K>::readInternal(casword_t volatile * addr, kplus1desc_t<MAX_K> * self, casword_t * content) {
+    while (true) {
+        casword_t val = *addr;
+        *content = val;
+        if (!isKplus1Entry(val)) return val;
+        kplus1entry_t<MAX_K> * entry = (kplus1entry_t<MAX_K> *) (val & ~(casword_t) KPLUS1_TAGBIT);
+        kplus1desc_t<MAX_K> * parent = entry->parent;
+        int status = parent->status;
+        if (parent != self && status == KPLUS1_STATUS_ACTIVE) {
+            help(parent);
+            continue;
+        }
+        return (status == KPLUS1_STATUS_SUCCEEDED) ? entry->newval : entry->oldval;
+    }
+}
+
+// does the read entry's address (logically) still hold its expected value? a word owned by a kcas that has not
+// decided yet is not helped; the kcas with the larger descriptor address wins instead (see
+// KCASLockFree::validateRead): if the other descriptor is below ours, we decide it as failed (so the word holds its
+// entry's oldval), and if it is above, we fail. must be called inside a guard (so the other descriptor is not reused)
+template <int MAX_K>
+bool KCASKPlus1<MAX_K>::validateRead(kplus1desc_t<MAX_K> * desc, kplus1entry_t<MAX_K> * entry) {
+    casword_t val = *entry->readAddr();
+    if (!isKplus1Entry(val)) return val == entry->oldval;
+    kplus1entry_t<MAX_K> * other = (kplus1entry_t<MAX_K> *) (val & ~(casword_t) KPLUS1_TAGBIT);
+    assert(other->parent != desc); // an address is never both read and written by one kcas
+    if (other->parent->status == KPLUS1_STATUS_ACTIVE) {
+        if (other->parent > desc) return false;
+        BOOL_CAS(&other->parent->status, KPLUS1_STATUS_ACTIVE, KPLUS1_STATUS_FAILED);
+    }
+    int status = other->parent->status;
+    return entry->oldval == ((status == KPLUS1_STATUS_SUCCEEDED) ? other->newval : other->oldval);
+}
+
+// install desc's entries in address order, then decide. run by the owner and by any thread that finds one of its
+// entries in a word while it is still active. must be called inside a guard
+template <int MAX_K>
+bool KCASKPlus1<MAX_K>::help(kplus1desc_t<MAX_K> * desc) {
+    bool success = true;
+    for (int i = 0; success && i < (int) desc->numEntries; i++) {
+        kplus1entry_t<MAX_K> * entry = &desc->entries[i];
+        if (entry->isRead()) continue;
+        const casword_t installed = ((casword_t) entry) | KPLUS1_TAGBIT;
+        while (true) {
+            casword_t content;
+            casword_t value = readInternal(entry->addr, desc, &content);
+            if (content == installed) break;
+            if (value != entry->oldval) {
+                success = false;
+                break;
+            }
+            if (desc->status != KPLUS1_STATUS_ACTIVE || !acquire(desc)) break;
+            if (BOOL_CAS(entry->addr, content, installed)) {
+                // the entry we replaced no longer holds a reference to its descriptor
+                if (isKplus1Entry(content)) release(((kplus1entry_t<MAX_K> *) (content & ~(casword_t) KPLUS1_TAGBIT))->parent);
+                break;
+            }
+            release(desc);
+        }
+        if (desc->status != KPLUS1_STATUS_ACTIVE) break;
+    }
+    for (int i = 0; success && i < (int) desc->numEntries; i++) {
+        if (desc->entries[i].isRead() && !validateRead(desc, &desc->entries[i])) success = false;
+    }
+    BOOL_CAS(&desc->status, KPLUS1_STATUS_ACTIVE, success ? KPLUS1_STATUS_SUCCEEDED : KPLUS1_STATUS_FAILED);
+    return desc->status == KPLUS1_STATUS_SUCCEEDED;
+}
+
+template <int MAX_K>
+static void kplus1desc_sort(kplus1desc_t<MAX_K> * ptr) {
+    for (int i = 1; i < (int) ptr->numEntries; i++) {
+        kplus1entry_t<MAX_K> temp = ptr->entries[i];
+        int j = i;
+        for (; j > 0 && ptr->entries[j-1].addr > temp.addr; --j) ptr->entries[j] = ptr->entries[j-1];
+        ptr->entries[j] = temp;
+    }
+}
+
+template <int MAX_K>
+bool KCASKPlus1<MAX_K>::execute() {
+    const int t = tid();
+    kplus1desc_t<MAX_K> * desc = threads[t].current;
+    assert(desc);
+    threads[t].current = NULL;
+    // sort entries in the kcas descriptor to guarantee progress
+    kplus1desc_sort<MAX_K>(desc);
+
+    auto guard = recmgr->getGuard(t);
+    bool result = help(desc);
+    release(desc); // the owner's reference
+    return result;
+}
+
+template <int MAX_K>
+casword_t KCASKPlus1<MAX_K>::readPtr(casword_t volatile * addr) {
+    casword_t val = *addr;
+    if (!isKplus1Entry(val)) return val;
+
+    // the word points to an entry. if its kcas has decided, the value is in the entry, which is still there if the
+    // descriptor was not reused (same sequence number) and the word still points to it after we read it
+    kplus1entry_t<MAX_K> * entry = (kplus1entry_t<MAX_K> *) (val & ~(casword_t) KPLUS1_TAGBIT);
+    kplus1desc_t<MAX_K> * parent = entry->parent;
+    const casword_t seq = parent->seq;
+    SOFTWARE_BARRIER;
+    const int status = parent->status;
+    const casword_t result = (status == KPLUS1_STATUS_SUCCEEDED) ? entry->newval : entry->oldval;
+    SOFTWARE_BARRIER;
+    if (status != KPLUS1_STATUS_ACTIVE && parent->seq == seq && *addr == val) return result;
+
+    // otherwise, re-read it inside a guard (helping the kcas if it is still active)
+    auto guard = recmgr->getGuard(tid(), true);
+    casword_t content;
+    return readInternal(addr, NULL, &content);
+}
+
+template <int MAX_K>
+casword_t KCASKPlus1<MAX_K>::readVal(casword_t volatile * addr) {
+    return ((casword_t) readPtr(addr))>>KCAS_LEFTSHIFT;
+}
+
+// like readPtr's unguarded path, but a kcas that is still active is not helped: its entry's oldval is the word's
+// logical value (it has not decided when we read its status). retries instead of taking a guard
+template <int MAX_K>
+casword_t KCASKPlus1<MAX_K>::readPtrNoHelp(casword_t volatile * addr) {
+    while (true) {
+        casword_t val = *addr;
+        if (!isKplus1Entry(val)) return val;
+        kplus1entry_t<MAX_K> * entry = (kplus1entry_t<MAX_K> *) (val & ~(casword_t) KPLUS1_TAGBIT);
+        kplus1desc_t<MAX_K> * parent = entry->parent;
+        const casword_t seq = parent->seq;
+        SOFTWARE_BARRIER;
+        const int status = parent->status;
+        const casword_t result = (status == KPLUS1_STATUS_SUCCEEDED) ? entry->newval : entry->oldval;
+        SOFTWARE_BARRIER;
+        if (parent->seq == seq && *addr == val) return result;
+    }
+}
+
+template <int MAX_K>
+casword_t KCASKPlus1<MAX_K>::readValNoHelp(casword_t volatile * addr) {
+    return ((casword_t) readPtrNoHelp(addr))>>KCAS_LEFTSHIFT;
+}
+
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::writeInitPtr(casword_t volatile * addr, casword_t const newval) {
+    *addr = newval;
+}
+
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::writeInitVal(casword_t volatile * addr, casword_t const newval) {
+    writeInitPtr(addr, newval<<KCAS_LEFTSHIFT);
+}
+
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::start() {
+    const int t = tid();
+    // reuse a descriptor that was started but never executed (it was never visible to other threads)
+    kplus1desc_t<MAX_K> * desc = threads[t].current;
+    if (desc == NULL) desc = threads[t].current = recmgr->template allocate<kplus1desc_t<MAX_K>>(t);
+    // a stale reader (see readPtr) that sees the new sequence number must also see the new status
+    desc->status = KPLUS1_STATUS_ACTIVE;
+    desc->refs = 1;
+    desc->numEntries = 0;
+    SOFTWARE_BARRIER;
+    desc->seq = desc->seq + 1;
+}
+
+template <int MAX_K>
+kcasptr_t KCASKPlus1<MAX_K>::getDescriptor() {
+    return threads[tid()].current;
+}
+
+template <int MAX_K>
+void KCASKPlus1<MAX_K>::deinitThread() {
+    kcas_tid.explicitRelease();
+}
+
+template<int MAX_K>
+template<typename T>
+void KCASKPlus1<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal) {
+    caswordptr->addToDescriptor(oldVal, newVal);
+}
+template<int MAX_K>
+template<typename T, typename... Args>
+void KCASKPlus1<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal, Args... args) {
+    caswordptr->addToDescriptor(oldVal, newVal);
+    add(args...);
+}
+template<int MAX_K>
+template<typename T>
+void KCASKPlus1<MAX_K>::addRead(casword<T> * caswordptr, T expected) {
+    caswordptr->addReadToDescriptor(expected);
+}
+template<int MAX_K>
+template<typename T, typename... Args>
+void KCASKPlus1<MAX_K>::addRead(casword<T> * caswordptr, T expected, Args... args) {
+    caswordptr->addReadToDescriptor(expected);
+    addRead(args...);
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <cassert>
+#include <stdint.h>
+#include <cstring>
+#include <sched.h>
+#include "kcas_tid.h"
+#include "../recordmgr/plaf.h"
+using namespace std;
+
+/**
+ * A blocking kcas engine. Compile with -DKCAS_LOCKED to use it instead of KCASLockFree (see kcas.h).
+ *
+ * Every address maps (by hashing) to one lock in a lock table. A kcas locks the locks of its write entries in lock
+ * table order (so kcases cannot deadlock), checks the expected values, commits, writes its new values in place and
+ * unlocks. There are no descriptors in the words and no helping: a word always holds a plain value.
+ *
+ * Reads never wait for a lock. A lock word holds a version number, and while it is locked, the tid of its owner.
+ * A reader reads the lock word, then the address, then the lock word again. If the lock was free both times (with
+ * the same version), the value it read is current. If the lock is held both times by the same kcas, the reader
+ * takes the address's logical value from the owner's descriptor: the old value until the owner has committed, and
+ * the new value after (the owner may still be writing it). Unlocking bumps the version, so a descriptor that was
+ * reused in the meantime is never mistaken for the one that held the lock.
+ *
+ * Read entries are not locked. They are checked once all write locks are held, and checked again (their lock
+ * words, as a double collect) just before committing. A read entry whose lock is held by another kcas is resolved
+ * by tid: if the owner's tid is above ours, we fail. If it is below ours, we wait for the owner to unlock, but only
+ * once it holds all its locks (it may be waiting for one of ours before that, so then we fail too). An owner that is
+ * checking its reads never waits for a higher tid, so waits cannot form a cycle, and of two kcases that each read a
+ * word the other writes, the one with the higher tid is never failed by the other once both are checking.
+ *
+ * The lock table has 2^KCAS_LOCK_TABLE_BITS locks (one per cache line) unless the constructor is told otherwise.
+ * Different addresses can share a lock; that only costs concurrency.
+ */
+
+#define BOOL_CAS __sync_bool_compare_and_swap
+#define VAL_CAS __sync_val_compare_and_swap
+
+#define kcasptr_t lockdesc_t<MAX_KCAS>*
+
+#ifndef KCAS_LOCK_TABLE_BITS
+#define KCAS_LOCK_TABLE_BITS 12
+#endif
+
+#define KCAS_LOCK_SPINS_BEFORE_YIELD 1024
+
+#define LOCKED_PHASE_LOCKING 0
+#define LOCKED_PHASE_VALIDATING 2    // holds all its write locks (and takes no more)
+#define LOCKED_PHASE_COMMITTED 1
+
+// a lock word: locked bit, then the owner's tid (while locked), then the version
+#define LOCKWORD_LOCKED 0x1
+#define LOCKWORD_OFFSET_TID 1
+#define LOCKWORD_MASK_TID 0x7FFF
+#define LOCKWORD_OFFSET_VERSION 16
+
+#define KCAS_LEFTSHIFT 2
+
+// marks a read entry (in the low bit of its addr), as in KCASLockFree
+#define KCAS_READ_ENTRY 0x1
+
+struct lockentry_t { // just part of lockdesc_t
+    casword_t volatile * addr;
+    casword_t oldval;
+    casword_t newval;
+    uint32_t lock;      // index of addr's lock (set by execute)
+
+    bool isRead() const {
+        return ((uintptr_t) addr) & KCAS_READ_ENTRY;
+    }
+    casword_t volatile * readAddr() const {
+        return (casword_t volatile *) (((uintptr_t) addr) & ~(uintptr_t) KCAS_READ_ENTRY);
+    }
+};
+
+template <int MAX_K>
+struct lockdesc_t {
+    volatile int phase;
+    casword_t numEntries;
+    lockentry_t entries[MAX_K];
+    const static int size = sizeof(phase)+sizeof(numEntries)+sizeof(entries);
+    volatile char padding[64+((64-size%64)%64)]; // add padding to prevent false sharing
+
+    void addValAddr(casword_t volatile * addr, casword_t oldval, casword_t newval) {
+        addPtrAddr(addr, oldval << KCAS_LEFTSHIFT, newval << KCAS_LEFTSHIFT);
+    }
+
+    void addPtrAddr(casword_t volatile * addr, casword_t oldval, casword_t newval) {
+        entries[numEntries].addr = addr;
+        entries[numEntries].oldval = oldval;
+        entries[numEntries].newval = newval;
+        ++numEntries;
+        assert(numEntries <= MAX_K);
+    }
+
+    // see kcasdesc_t::addReadPtrAddr (kcas_reuse_impl.h)
+    void addReadValAddr(casword_t volatile * addr, casword_t expected) {
+        addReadPtrAddr(addr, expected << KCAS_LEFTSHIFT);
+    }
+
+    void addReadPtrAddr(casword_t volatile * addr, casword_t expected) {
+        addPtrAddr((casword_t volatile *) (((uintptr_t) addr) | KCAS_READ_ENTRY), expected, expected);
+    }
+};
+
+template <int MAX_K>
+class KCASLocked {
+private:
+    struct lock_t {
+        casword_t volatile word;
+        volatile char padding[PADDING_BYTES - sizeof(casword_t)];
+    };
+
+    volatile char padding0[PADDING_BYTES];
+    const int lockTableBits;
+    lock_t * locks;
+    volatile char padding1[PADDING_BYTES];
+    lockdesc_t<MAX_K> descs[MAX_THREADS];
+    volatile char padding2[PADDING_BYTES];
+
+public:
+    KCASLocked(const int _lockTableBits = KCAS_LOCK_TABLE_BITS);
+    ~KCASLocked();
+    void writeInitPtr(casword_t volatile * addr, casword_t const newval);
+    void writeInitVal(casword_t volatile * addr, casword_t const newval);
+    casword_t readPtr(casword_t volatile * addr);
+    casword_t readVal(casword_t volatile * addr);
+    casword_t readPtrNoHelp(casword_t volatile * addr);
+    casword_t readValNoHelp(casword_t volatile * addr);
+    bool execute();
+
+    kcasptr_t getDescriptor();
+    void start();
+    void deinitThread();
+    int getLockTableSize();
+    template<typename T>
+    void add(casword<T> * caswordptr, T oldVal, T newVal);
+    template<typename T, typename... Args>
+    void add(casword<T> * caswordptr, T oldVal, T newVal, Args... args);
+    template<typename T>
+    void addRead(casword<T> * caswordptr, T expected);
+    template<typename T, typename... Args>
+    void addRead(casword<T> * caswordptr, T expected, Args... args);
+private:
+    static int tid();
+    uint32_t lockIndex(casword_t volatile * addr);
+    void lock(casword_t volatile * lockword, const int t);
+};
+
+static bool isLockwordLocked(casword_t word) {
+    return word & LOCKWORD_LOCKED;
+}
+
+static int lockwordOwner(casword_t word) {
+    return (word >> LOCKWORD_OFFSET_TID) & LOCKWORD_MASK_TID;
+}
+
+/**
+ * constructor
+ *
+ * @param _lockTableBits the lock table has 2^_lockTableBits locks
+ */
+template <int MAX_K>
+KCASLocked<MAX_K>::KCASLocked(const int _lockTableBits)
+: lockTableBits(_lockTableBits) {
+    assert(lockTableBits > 0 && lockTableBits <= 30);
+    assert(MAX_THREADS <= LOCKWORD_MASK_TID);
+    locks = new lock_t[1 << lockTableBits];
+    for (int i=0;i<(1 << lockTableBits);++i) locks[i].word = 0;
+    for (int i=0;i<MAX_THREADS;++i) descs[i].numEntries = 0;
+}
+
+template <int MAX_K>
+KCASLocked<MAX_K>::~KCASLocked() {
+    delete[] locks;
+}
+
+template <int MAX_K>
+int KCASLocked<MAX_K>::tid() {
+    const int result = kcas_tid.getId();
+    assert(result >= 0 && result < MAX_THREADS);
+    return result;
+}
+
+template <int MAX_K>
+int KCASLocked<MAX_K>::getLockTableSize() {
+    return 1 << lockTableBits;
+}
+
+// fibonacci hashing of the word's address (words are 8-byte aligned, so the low 3 bits carry nothing)
+template <int MAX_K>
+uint32_t KCASLocked<MAX_K>::lockIndex(casword_t volatile * addr) {
+    return (uint32_t) (((((uintptr_t) addr) >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - lockTableBits));
+}
+
+// spin until the lock is free, then take it for thread t. yield now and then, in case the owner was descheduled
+template <int MAX_K>
+void KCASLocked<MAX_K>::lock(casword_t volatile * lockword, const int t) {
+    const casword_t owner = LOCKWORD_LOCKED | ((casword_t) t << LOCKWORD_OFFSET_TID);
+    for (int spins = 1; ; ++spins) {
+        casword_t word = *lockword;
+        if (!isLockwordLocked(word) && BOOL_CAS(lockword, word, word | owner)) return;
+        if ((spins % KCAS_LOCK_SPINS_BEFORE_YIELD) == 0) sched_yield();
+    }
+}
+
+template <int MAX_K>
+static void lockdesc_sort(lockdesc_t<MAX_K> * ptr) {
+    for (int i = 1; i < (int) ptr->numEntries; i++) {
+        lockentry_t temp = ptr->entries[i];
+        int j = i;
+        for (; j > 0 && ptr->entries[j-1].lock > temp.lock; --j) ptr->entries[j] = ptr->entries[j-1];
+        ptr->entries[j] = temp;
+    }
+}
+
+template <int MAX_K>
+bool KCASLocked<MAX_K>::execute() {
+    const int t = tid();
+    lockdesc_t<MAX_K> * desc = &descs[t];
+    const int n = (int) desc->numEntries;
+    assert(desc->phase == LOCKED_PHASE_LOCKING);
+
+    // sort entries by lock, so locks are taken in one global order (and each lock once)
+    for (int i = 0; i < n; i++) desc->entries[i].lock = lockIndex(desc->entries[i].readAddr());
+    lockdesc_sort<MAX_K>(desc);
+
+    // lock the write entries' locks. the lock CAS also publishes the entries to readers
+    bool locked[MAX_K];
+    for (int i = 0; i < n; i++) {
+        lockentry_t * entry = &desc->entries[i];
+        locked[i] = false;
+        if (entry->isRead()) continue;
+        bool held = false;
+        for (int j = 0; j < i; j++) held |= (locked[j] && desc->entries[j].lock == entry->lock);
+        if (held) continue;
+        lock(&locks[entry->lock].word, t);
+        locked[i] = true;
+    }
+    desc->phase = LOCKED_PHASE_VALIDATING;
+
+    // check expected values. write entries cannot change now; read entries are collected twice
+    bool success = true;
+    casword_t seen[MAX_K];
+    for (int i = 0; success && i < n; i++) {
+        lockentry_t * entry = &desc->entries[i];
+        if (!entry->isRead()) {
+            success = (*entry->addr == entry->oldval);
+            continue;
+        }
+        seen[i] = locks[entry->lock].word;
+        for (int spins = 1; success && isLockwordLocked(seen[i]) && lockwordOwner(seen[i]) != t; ++spins) { // see above
+            const int owner = lockwordOwner(seen[i]);
+            if (owner > t || descs[owner].phase == LOCKED_PHASE_LOCKING) success = false;
+            if ((spins % KCAS_LOCK_SPINS_BEFORE_YIELD) == 0) sched_yield();
+            seen[i] = locks[entry->lock].word;
+        }
+        SOFTWARE_BARRIER;
+        if (*entry->readAddr() != entry->oldval) success = false;
+    }
+    SOFTWARE_BARRIER;
+    for (int i = 0; success && i < n; i++) {
+        if (desc->entries[i].isRead() && locks[desc->entries[i].lock].word != seen[i]) success = false;
+    }
+
+    if (success) {
+        desc->phase = LOCKED_PHASE_COMMITTED; // linearization point (of a successful kcas)
+        for (int i = 0; i < n; i++) {
+            if (!desc->entries[i].isRead()) *desc->entries[i].addr = desc->entries[i].newval;
+        }
+    }
+
+    // unlock, bumping each version
+    SOFTWARE_BARRIER;
+    for (int i = 0; i < n; i++) {
+        if (!locked[i]) continue;
+        casword_t volatile * lockword = &locks[desc->entries[i].lock].word;
+        *lockword = ((*lockword >> LOCKWORD_OFFSET_VERSION) + 1) << LOCKWORD_OFFSET_VERSION;
+    }
+    desc->numEntries = 0;
+    return success;
+}
+
+template <int MAX_K>
+casword_t KCASLocked<MAX_K>::readPtr(casword_t volatile * addr) {
+    casword_t volatile * lockword = &locks[lockIndex(addr)].word;
+    while (true) {
+        const casword_t before = *lockword;
+        SOFTWARE_BARRIER;
+        casword_t val = *addr;
+        if (isLockwordLocked(before)) {
+            // the owner's descriptor belongs to the kcas holding the lock if the lock word is unchanged below
+            lockdesc_t<MAX_K> * owner = &descs[lockwordOwner(before)];
+            const int phase = owner->phase;
+            int n = (int) owner->numEntries;
+            if (n > MAX_K) n = MAX_K;
+            for (int i = 0; i < n; i++) {
+                if (owner->entries[i].addr == addr) {
+                    val = (phase == LOCKED_PHASE_COMMITTED) ? owner->entries[i].newval : owner->entries[i].oldval;
+                    break;
+                }
+            }
+        }
+        SOFTWARE_BARRIER;
+        if (*lockword == before) return val;
+    }
+}
+
+template <int MAX_K>
+casword_t KCASLocked<MAX_K>::readVal(casword_t volatile * addr) {
+    return ((casword_t) readPtr(addr))>>KCAS_LEFTSHIFT;
+}
+
+// reads never help here anyway
+template <int MAX_K>
+casword_t KCASLocked<MAX_K>::readPtrNoHelp(casword_t volatile * addr) {
+    return readPtr(addr);
+}
+
+template <int MAX_K>
+casword_t KCASLocked<MAX_K>::readValNoHelp(casword_t volatile * addr) {
+    return readVal(addr);
+}
+
+template <int MAX_K>
+void KCASLocked<MAX_K>::writeInitPtr(casword_t volatile * addr, casword_t const newval) {
+    *addr = newval;
+}
+
+template <int MAX_K>
+void KCASLocked<MAX_K>::writeInitVal(casword_t volatile * addr, casword_t const newval) {
+    writeInitPtr(addr, newval<<KCAS_LEFTSHIFT);
+}
+
+// the descriptor is only read by other threads while we hold a lock, and we hold none between kcases
+template <int MAX_K>
+void KCASLocked<MAX_K>::start() {
+    lockdesc_t<MAX_K> * desc = &descs[tid()];
+    desc->phase = LOCKED_PHASE_LOCKING;
+    desc->numEntries = 0;
+}
+
+template <int MAX_K>
+kcasptr_t KCASLocked<MAX_K>::getDescriptor() {
+    return &descs[tid()];
+}
+
+template <int MAX_K>
+void KCASLocked<MAX_K>::deinitThread() {
+    kcas_tid.explicitRelease();
+}
+
+template<int MAX_K>
+template<typename T>
+void KCASLocked<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal) {
+    caswordptr->addToDescriptor(oldVal, newVal);
+}
+template<int MAX_K>
+template<typename T, typename... Args>
+void KCASLocked<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal, Args... args) {
+    caswordptr->addToDescriptor(oldVal, newVal);
+    add(args...);
+}
+template<int MAX_K>
+template<typename T>
+void KCASLocked<MAX_K>::addRead(casword<T> * caswordptr, T expected) {
+    caswordptr->addReadToDescriptor(expected);
+}
+template<int MAX_K>
+template<typename T, typename... Args>
+void KCASLocked<MAX_K>::addRead(casword<T> * caswordptr, T expected, Args... args) {
+    caswordptr->addReadToDescriptor(expected);
+    addRead(args...);
+}
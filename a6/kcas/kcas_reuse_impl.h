@@ -5,14 +5,22 @@
 #include <sstream>
 #include <cstring>
 #include <immintrin.h>
+#include <array>
+#include <utility>
 
 using namespace std;
 
 
+/**
+ * Compile with -DKCAS_GENERIC to use the original, K-independent code paths (bubble sort, loops over the entries,
+ * whole-descriptor snapshots) instead of the ones specialized for MAX_K below (see a5/kcas_benchmark.cpp).
+ */
+
 /**
  * Note: this algorithm supports a limited number of threads (print LAST_TID to see how many).
  * It should be several thousand, at least.
  * The alg can be tweaked to support more.
+ * Thread ids come from kcas_tid.h, which hands out at most KCAS_MAX_THREADS of them (checked below).
  */
 
 #define BOOL_CAS __sync_bool_compare_and_swap
@@ -126,11 +134,6 @@ typedef intptr_t seqbits_t;
 #define DESC_INITIALIZED(descArray, tid) \
     (descArray)[(tid)].seqBits += (1<<OFFSET_SEQ);
 
-#define DESC_INIT_ALL(descArray, macro_seqBitsNew) { \
-    for (int i=0;i<(LAST_TID-1);++i) { \
-        (descArray)[i].seqBits = macro_seqBitsNew(0); \
-    } \
-}
 
 /**
  *
@@ -152,50 +155,66 @@ typedef intptr_t seqbits_t;
 #define KCAS_LEFTSHIFT 2
 
 
-#define KCAS_MAX_THREADS 500
-
+#include "kcas_tid.h"
+#include "kcas_contention.h"
 
-void * volatile thread_ids[KCAS_MAX_THREADS] = {};
+/**
+ * Per-thread descriptors, indexed by tid (as the DESC_ and TAGPTR_ macros expect), allocated in cache-aligned
+ * chunks of KCAS_DESC_CHUNK descriptors the first time a tid in the chunk starts a kcas. So storage follows the
+ * number of registered threads (see kcas_tid.h) instead of covering every tid a tagptr could hold.
+ *
+ * Chunks are never freed before the table, since a helper may still be reading a descriptor through a stale tagptr
+ * (its sequence number check then fails), and a recycled tid simply reuses its descriptors.
+ *
+ * The chunk directory covers every tid a tagptr can hold (up to LAST_TID), not just KCAS_MAX_THREADS: a thread
+ * reading a word it no longer protects can find garbage that looks like a tagptr. A tid whose chunk was never
+ * allocated maps to a shared, never used descriptor, which is what the fixed size arrays held for such tids.
+ */
+#define KCAS_DESC_CHUNK_BITS 3
+#define KCAS_DESC_CHUNK (1<<KCAS_DESC_CHUNK_BITS)
+#define KCAS_DESC_CHUNKS ((LAST_TID+KCAS_DESC_CHUNK)/KCAS_DESC_CHUNK)
+static_assert(KCAS_MAX_THREADS < LAST_TID, "tagptrs cannot name every kcas thread id");
 
-class TIDGenerator {
+template <typename T>
+class kcasDescTable {
+private:
+    T * chunks[KCAS_DESC_CHUNKS]; // a chunk is published (by CAS) before any tagptr can name a tid in it
+    const seqbits_t initSeqBits;
+    volatile int numChunks;
+    T unused __attribute__ ((aligned(64))); // stands in for the descriptors of tids in unallocated chunks
 public:
-    int myslot = -1;
-    TIDGenerator() {
-	int i;
-        while (true) {
-	    i = 0;
-            while (thread_ids[i]){ ++i; }
-
-	    assert(i < KCAS_MAX_THREADS);
-	    if (__sync_bool_compare_and_swap(&thread_ids[i], 0, this)) {
-		myslot = i;
-		break;
-	    }
-
-        }
+    kcasDescTable(const seqbits_t _initSeqBits) : initSeqBits(_initSeqBits), numChunks(0) {
+        for (int i=0;i<KCAS_DESC_CHUNKS;++i) chunks[i] = NULL;
+        memset((void *) &unused, 0, sizeof(unused));
+        unused.seqBits = initSeqBits;
     }
-
-    ~TIDGenerator() {
-        thread_ids[myslot] = 0;
+    ~kcasDescTable() {
+        for (int i=0;i<KCAS_DESC_CHUNKS;++i) free(chunks[i]);
     }
-
-    operator int() {
-        return myslot;
+    T & operator[](const int tid) {
+        assert(tid >= 0 && tid <= LAST_TID);
+        T * chunk = chunks[tid>>KCAS_DESC_CHUNK_BITS];
+        if (__builtin_expect(chunk == NULL, 0)) return unused;
+        return chunk[tid&(KCAS_DESC_CHUNK-1)];
     }
-
-    int getId(){
-	return myslot;
+    // make sure tid's descriptor exists (called by tid before it uses the descriptor)
+    void ensure(const int tid) {
+        assert(tid >= 0 && tid < KCAS_MAX_THREADS);
+        if (chunks[tid>>KCAS_DESC_CHUNK_BITS]) return;
+        T * chunk = (T *) aligned_alloc(PADDING_BYTES, KCAS_DESC_CHUNK*sizeof(T));
+        memset((void *) chunk, 0, KCAS_DESC_CHUNK*sizeof(T));
+        for (int i=0;i<KCAS_DESC_CHUNK;++i) chunk[i].seqBits = initSeqBits;
+        if (BOOL_CAS(&chunks[tid>>KCAS_DESC_CHUNK_BITS], NULL, chunk)) {
+            __sync_fetch_and_add(&numChunks, 1);
+        } else {
+            free(chunk);
+        }
     }
-
-    void explicitRelease() {
-        thread_ids[myslot] = 0;
+    size_t getMemoryBytes() {
+        return sizeof(*this) + (size_t) numChunks*KCAS_DESC_CHUNK*sizeof(T);
     }
-
 };
 
-
-thread_local TIDGenerator kcas_tid;
-
 struct rdcssdesc_t {
     volatile seqbits_t seqBits;
     casword_t volatile * addr1;
@@ -213,6 +232,26 @@ struct kcasentry_t { // just part of kcasdesc_t, not a standalone descriptor
     casword_t newval;
 };
 
+/**
+ * A read entry (added with addReadValAddr/addReadPtrAddr) only checks that its address still holds oldval: it is
+ * never locked or written. It is marked by setting the low bit of addr (addresses are word aligned), so it sorts
+ * with the other entries and costs no extra space in the descriptor.
+ *
+ * Read entries keep the engine lock-free. A read that finds an undecided kcas in its word does not help it through
+ * phase 1 (that kcas may need a word we hold), and instead resolves the conflict by tagptr (see validateRead): the
+ * kcas with the larger tagptr wins and the other is decided as failed. So among kcases that conflict through
+ * reads, the one with the largest tagptr is never failed by another, and some kcas always completes.
+ */
+#define KCAS_READ_ENTRY 0x1
+
+static inline bool kcasentry_isRead(const kcasentry_t & entry) {
+    return ((uintptr_t) entry.addr) & KCAS_READ_ENTRY;
+}
+
+static inline casword_t volatile * kcasentry_readAddr(const kcasentry_t & entry) {
+    return (casword_t volatile *) (((uintptr_t) entry.addr) & ~(uintptr_t) KCAS_READ_ENTRY);
+}
+
 
 template <int MAX_K>
 class kcasdesc_t {
@@ -223,6 +262,11 @@ public:
     const static int size = sizeof(seqBits)+sizeof(numEntries)+sizeof(entries);
     volatile char padding[128+((64-size%64)%64)]; // add padding to prevent false sharing
 
+    // bytes of the descriptor that hold its first n entries (what a snapshot needs to copy)
+    static int sizeWith(const casword_t n) {
+        return sizeof(seqBits)+sizeof(numEntries)+n*sizeof(kcasentry_t);
+    }
+
     void addValAddr(casword_t volatile * addr, casword_t oldval, casword_t newval) {
         entries[numEntries].addr = addr;
         entries[numEntries].oldval = oldval << KCAS_LEFTSHIFT;
@@ -238,6 +282,21 @@ public:
         ++numEntries;
         assert(numEntries <= MAX_K);
     }
+
+    // the kcas succeeds only if addr holds expected when it takes effect (addr must not also be written by it).
+    // validation assumes addr never returns to expected after changing (e.g., a mark that is only ever set), or
+    // cannot change at all while the kcas holds its write entries (e.g., a child pointer of a node it marks)
+    void addReadValAddr(casword_t volatile * addr, casword_t expected) {
+        addReadPtrAddr(addr, expected << KCAS_LEFTSHIFT);
+    }
+
+    void addReadPtrAddr(casword_t volatile * addr, casword_t expected) {
+        entries[numEntries].addr = (casword_t volatile *) (((uintptr_t) addr) | KCAS_READ_ENTRY);
+        entries[numEntries].oldval = expected;
+        entries[numEntries].newval = expected;
+        ++numEntries;
+        assert(numEntries <= MAX_K);
+    }
 };
 
 
@@ -267,9 +326,10 @@ private:
 #define RDCSS_SEQBITS_NEW(seqBits) \
         (((seqBits)&MASK_SEQ)+(1<<OFFSET_SEQ))
     volatile char __padding_desc[128];
-    kcasdesc_t<MAX_K> kcasDescriptors[LAST_TID+1] __attribute__ ((aligned(64)));
-    rdcssdesc_t rdcssDescriptors[LAST_TID+1] __attribute__ ((aligned(64)));
+    kcasDescTable<kcasdesc_t<MAX_K>> kcasDescriptors;
+    kcasDescTable<rdcssdesc_t> rdcssDescriptors;
     volatile char __padding_desc3[128];
+    KCAS_CM cm; // decides when to help another kcas (see kcas_contention.h)
 
     /**
      * Function declarations
@@ -280,6 +340,8 @@ public:
     void writeInitVal(casword_t volatile * addr, casword_t const newval);
     casword_t readPtr(casword_t volatile * addr);
     casword_t readVal(casword_t volatile * addr);
+    casword_t readPtrNoHelp(casword_t volatile * addr);
+    casword_t readValNoHelp(casword_t volatile * addr);
     bool execute();
 
     kcasptr_t getDescriptor();
@@ -287,15 +349,25 @@ public:
     casword_t rdcssRead(casword_t volatile * addr);
     void helpOther(kcastagptr_t tagptr);
     void deinitThread();
+    size_t getDescriptorBytes();
+    void printContentionStats();
     template<typename T>
     void add(casword<T> * caswordptr, T oldVal, T newVal);
     template<typename T, typename... Args>
     void add(casword<T> * caswordptr, T oldVal, T newVal, Args... args);
+    template<typename T>
+    void addRead(casword<T> * caswordptr, T expected);
+    template<typename T, typename... Args>
+    void addRead(casword<T> * caswordptr, T expected, Args... args);
 private:
     casword_t rdcss(rdcssptr_t ptr, rdcsstagptr_t tagptr);
     bool help(kcastagptr_t tagptr, kcasptr_t ptr, bool helpingOther);
     void rdcssHelp(rdcsstagptr_t tagptr, rdcssptr_t snapshot, bool helpingOther);
     void rdcssHelpOther(rdcsstagptr_t tagptr);
+    bool lockEntry(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * ptr, kcasentry_t * entry);
+    template <int I> bool lockEntries(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * ptr, kcasdesc_t<MAX_K> * snapshot, const int first);
+    template <int I> void unlockEntries(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * snapshot, const bool succeeded);
+    bool validateRead(kcastagptr_t tagptr, kcasentry_t * entry);
 };
 
 
@@ -348,21 +420,117 @@ casword_t KCASLockFree<MAX_K>::rdcssRead(casword_t volatile * addr) {
 }
 
 template <int MAX_K>
-KCASLockFree<MAX_K>::KCASLockFree() {
-    DESC_INIT_ALL(kcasDescriptors, KCAS_SEQBITS_NEW);
-    DESC_INIT_ALL(rdcssDescriptors, RDCSS_SEQBITS_NEW);
+KCASLockFree<MAX_K>::KCASLockFree()
+: kcasDescriptors(KCAS_SEQBITS_NEW(0)), rdcssDescriptors(RDCSS_SEQBITS_NEW(0)) {
 }
 
 template <int MAX_K>
 void KCASLockFree<MAX_K>::helpOther(kcastagptr_t tagptr) {
     kcasdesc_t<MAX_K> newSnapshot;
+#ifdef KCAS_GENERIC
     const int sz = kcasdesc_t<MAX_K>::size;
+#else
+    // copy only the entries in use. numEntries may be torn if the descriptor is being reused, but then the
+    // sequence number check in DESC_SNAPSHOT fails, so clamping it is enough to keep the copy in bounds
+    const casword_t n = *(casword_t volatile *) &TAGPTR_UNPACK_PTR(kcasDescriptors, tagptr)->numEntries;
+    const int sz = kcasdesc_t<MAX_K>::sizeWith(n < MAX_K ? n : MAX_K);
+#endif
     //cout<<"size of kcas descriptor is "<<sizeof(kcasdesc_t<MAX_K>)<<" and sz="<<sz<<endl;
     if (DESC_SNAPSHOT(kcasdesc_t<MAX_K>, kcasDescriptors, &newSnapshot, tagptr, sz)) {
         help(tagptr, &newSnapshot, true);
     }
 }
 
+// phase 1 for one entry: "lock" entry->addr for this kcas with an rdcss (helping any other kcas in the way).
+// returns false if the address held a value other than entry->oldval
+template <int MAX_K>
+bool KCASLockFree<MAX_K>::lockEntry(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * ptr, kcasentry_t * entry) {
+    if (kcasentry_isRead(*entry)) return true; // validated once the writes are locked
+    const int tid = kcas_tid.getId();
+    rdcssDescriptors.ensure(tid); // we may be helping without ever having started a kcas
+    while (true) {
+        // prepare rdcss descriptor and run rdcss
+        rdcssdesc_t *rdcssptr = DESC_NEW(rdcssDescriptors, RDCSS_SEQBITS_NEW, tid);
+        rdcssptr->addr1 = (casword_t*) &ptr->seqBits;
+        rdcssptr->old1 = tagptr; // pass the sequence number (as part of tagptr)
+        rdcssptr->old2 = entry->oldval;
+        rdcssptr->addr2 = entry->addr; // p stopped here (step 2)
+        rdcssptr->new2 = (casword_t) tagptr;
+        DESC_INITIALIZED(rdcssDescriptors, tid);
+
+        casword_t val;
+        val = rdcss(rdcssptr, TAGPTR_NEW(tid, rdcssptr->seqBits, RDCSS_TAGBIT));
+
+        // check for failure of rdcss and handle it
+        if (isKcas(val)) {
+            // if rdcss failed because of a /different/ kcas, we help it (when the contention manager says so)
+            if (val != (casword_t) tagptr) {
+                if (cm.shouldHelp(tid, entry->addr, val)) helpOther((kcastagptr_t) val);
+                continue;
+            }
+        } else {
+            if (val != entry->oldval) return false;
+        }
+        return true;
+    }
+}
+
+// phase 1 for entries I, I+1, ... of snapshot (skipping those before first), unrolled at compile time
+template <int MAX_K>
+template <int I>
+bool KCASLockFree<MAX_K>::lockEntries(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * ptr, kcasdesc_t<MAX_K> * snapshot, const int first) {
+    if constexpr (I < MAX_K) {
+        if (I >= (int) snapshot->numEntries) return true;
+        if (I >= first && !lockEntry(tagptr, ptr, &snapshot->entries[I])) return false;
+        return lockEntries<I+1>(tagptr, ptr, snapshot, first);
+    } else {
+        return true;
+    }
+}
+
+// phase 2 for entries I, I+1, ... of snapshot, unrolled at compile time
+template <int MAX_K>
+template <int I>
+void KCASLockFree<MAX_K>::unlockEntries(kcastagptr_t tagptr, kcasdesc_t<MAX_K> * snapshot, const bool succeeded) {
+    if constexpr (I < MAX_K) {
+        if (I >= (int) snapshot->numEntries) return;
+        if (!kcasentry_isRead(snapshot->entries[I])) {
+            casword_t newval = succeeded ? snapshot->entries[I].newval : snapshot->entries[I].oldval;
+            BOOL_CAS(snapshot->entries[I].addr, (casword_t) tagptr, newval);
+        }
+        unlockEntries<I+1>(tagptr, snapshot, succeeded);
+    }
+}
+
+// after phase 1 locked every write entry: does the read entry's address (logically) still hold its expected value?
+// a word locked by a kcas that has already decided is helped (that is just its phase 2). one that is still undecided
+// may be waiting on a word we hold, so running its phase 1 could lead straight back to us. instead, the kcas with
+// the larger tagptr wins: if the other one's tagptr is below ours, we decide it (as failed) and help it unlock,
+// and if it is above ours, we fail. of two kcases that each read a word the other writes, exactly one proceeds
+// (see KCAS_READ_ENTRY). given the assumption on read entries (see addReadPtrAddr), a read that validates also
+// held its expected value when our last write entry was locked, which is where a successful kcas takes effect.
+template <int MAX_K>
+bool KCASLockFree<MAX_K>::validateRead(kcastagptr_t tagptr, kcasentry_t * entry) {
+    casword_t volatile * addr = kcasentry_readAddr(*entry);
+    while (true) {
+        casword_t val = rdcssRead(addr);
+        if (!isKcas(val)) return val == entry->oldval;
+        assert(val != (casword_t) tagptr); // an address is never both read and written by one kcas
+        kcasdesc_t<MAX_K> * other = TAGPTR_UNPACK_PTR(kcasDescriptors, val);
+        bool successBit;
+        int state = DESC_READ_FIELD(successBit, other->seqBits, val, KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE);
+        if (successBit && state == KCAS_STATE_UNDECIDED) {
+            if (val > (casword_t) tagptr) return false;
+            // fails only if the other kcas decided (or finished) meanwhile; either way it is no longer undecided
+            SEQBITS_CAS_FIELD(successBit
+            , other->seqBits, val
+            , KCAS_STATE_UNDECIDED, KCAS_STATE_FAILED
+            , KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE);
+        }
+        helpOther((kcastagptr_t) val);
+    }
+}
+
 template <int MAX_K>
 bool KCASLockFree<MAX_K>::help(kcastagptr_t tagptr, kcasptr_t snapshot, bool helpingOther) {
     // phase 1: "locking" addresses for this kcas
@@ -378,33 +546,20 @@ bool KCASLockFree<MAX_K>::help(kcastagptr_t tagptr, kcasptr_t snapshot, bool hel
     }
 
     if (state == KCAS_STATE_UNDECIDED) {
+#ifdef KCAS_GENERIC
         newstate = KCAS_STATE_SUCCEEDED;
         for (int i = helpingOther; i < snapshot->numEntries; i++) {
-            retry_entry:
-            // prepare rdcss descriptor and run rdcss
-            rdcssdesc_t *rdcssptr = DESC_NEW(rdcssDescriptors, RDCSS_SEQBITS_NEW, kcas_tid.getId());
-            rdcssptr->addr1 = (casword_t*) &ptr->seqBits;
-            rdcssptr->old1 = tagptr; // pass the sequence number (as part of tagptr)
-            rdcssptr->old2 = snapshot->entries[i].oldval;
-            rdcssptr->addr2 = snapshot->entries[i].addr; // p stopped here (step 2)
-            rdcssptr->new2 = (casword_t) tagptr;
-            DESC_INITIALIZED(rdcssDescriptors, kcas_tid.getId());
-
-            casword_t val;
-            val = rdcss(rdcssptr, TAGPTR_NEW(kcas_tid.getId(), rdcssptr->seqBits, RDCSS_TAGBIT));
-
-            // check for failure of rdcss and handle it
-            if (isKcas(val)) {
-                // if rdcss failed because of a /different/ kcas, we help it
-                if (val != (casword_t) tagptr) {
-                    helpOther((kcastagptr_t) val);
-                    goto retry_entry;
-                }
-            } else {
-                if (val != snapshot->entries[i].oldval) {
-                    newstate = KCAS_STATE_FAILED;
-                    break;
-                }
+            if (!lockEntry(tagptr, ptr, &snapshot->entries[i])) {
+                newstate = KCAS_STATE_FAILED;
+                break;
+            }
+        }
+#else
+        newstate = lockEntries<0>(tagptr, ptr, snapshot, helpingOther) ? KCAS_STATE_SUCCEEDED : KCAS_STATE_FAILED;
+#endif
+        for (int i = 0; newstate == KCAS_STATE_SUCCEEDED && i < (int) snapshot->numEntries; i++) {
+            if (kcasentry_isRead(snapshot->entries[i]) && !validateRead(tagptr, &snapshot->entries[i])) {
+                newstate = KCAS_STATE_FAILED;
             }
         }
         SEQBITS_CAS_FIELD(successBit
@@ -418,17 +573,91 @@ bool KCASLockFree<MAX_K>::help(kcastagptr_t tagptr, kcasptr_t snapshot, bool hel
 
     bool succeeded = (state == KCAS_STATE_SUCCEEDED);
 
+#ifdef KCAS_GENERIC
     for (int i = 0; i < snapshot->numEntries; i++) {
+        if (kcasentry_isRead(snapshot->entries[i])) continue;
         casword_t newval = succeeded ? snapshot->entries[i].newval : snapshot->entries[i].oldval;
         BOOL_CAS(snapshot->entries[i].addr, (casword_t) tagptr, newval);
     }
+#else
+    unlockEntries<0>(tagptr, snapshot, succeeded);
+#endif
 
     return succeeded;
 }
 
-// TODO: replace crappy bubblesort with something fast for large MAX_K (maybe even use insertion sort for small MAX_K)
+/**
+ * Sorting networks for the entries of a kcas descriptor, built at compile time: Batcher's merge exchange
+ * (Knuth, TAOCP vol. 3, 5.2.2, Algorithm M), which works for any number of inputs n. A network with C comparators
+ * runs as C straight-line compare-exchanges with no loop or data-dependent control flow beyond the swaps.
+ */
+struct kcasComparator {
+    uint8_t a, b;
+};
+
+template <int N>
+struct kcasSortNetwork {
+    // visit(a, b) for each comparator of the network, in order
+    template <class Visit>
+    static constexpr void generate(Visit visit) {
+        int t = 0;
+        while ((1 << t) < N) ++t;
+        for (int p = (t ? 1 << (t-1) : 0); p > 0; p >>= 1) {
+            int q = 1 << (t-1), r = 0, d = p;
+            while (true) {
+                for (int i = 0; i < N - d; ++i) {
+                    if ((i & p) == r) visit(i, i + d);
+                }
+                if (q == p) break;
+                d = q - p;
+                q >>= 1;
+                r = p;
+            }
+        }
+    }
+    static constexpr int countComparators() {
+        int count = 0;
+        generate([&](int, int) { ++count; });
+        return count;
+    }
+    static constexpr int SIZE = countComparators();
+    static constexpr array<kcasComparator, SIZE> makeComparators() {
+        array<kcasComparator, SIZE> result {};
+        int i = 0;
+        generate([&](int a, int b) { result[i].a = a; result[i].b = b; ++i; });
+        return result;
+    }
+    static constexpr array<kcasComparator, SIZE> comparators = makeComparators();
+};
+
+static inline void kcasentry_compareExchange(kcasentry_t & x, kcasentry_t & y) {
+    if (x.addr > y.addr) {
+        kcasentry_t temp = x;
+        x = y;
+        y = temp;
+    }
+}
+
+template <int N, size_t... I>
+static inline void kcasentry_sortNetwork(kcasentry_t * entries, index_sequence<I...>) {
+    (kcasentry_compareExchange(entries[kcasSortNetwork<N>::comparators[I].a], entries[kcasSortNetwork<N>::comparators[I].b]), ...);
+}
+
+// sort the first n entries with the network for exactly n inputs (for each n <= N, chosen at compile time)
+template <int N>
+static inline void kcasentry_sort(kcasentry_t * entries, const int n) {
+    if constexpr (N >= 2) {
+        if (n == N) {
+            kcasentry_sortNetwork<N>(entries, make_index_sequence<kcasSortNetwork<N>::SIZE>());
+        } else {
+            kcasentry_sort<N-1>(entries, n);
+        }
+    }
+}
+
 template <int MAX_K>
-static void kcasdesc_sort(kcasptr_t ptr) {
+static void kcasdesc_sort(kcasdesc_t<MAX_K> * ptr) {
+#ifdef KCAS_GENERIC
     kcasentry_t temp;
     for (int i = 0; i < ptr->numEntries; i++) {
         for (int j = 0; j < ptr->numEntries - i - 1; j++) {
@@ -439,19 +668,23 @@ static void kcasdesc_sort(kcasptr_t ptr) {
             }
         }
     }
+#else
+    kcasentry_sort<MAX_K>(ptr->entries, ptr->numEntries);
+#endif
 }
 
 template <int MAX_K>
 bool KCASLockFree<MAX_K>::execute() {
-    assert(kcas_tid.getId() != -1);
-    auto desc = &kcasDescriptors[kcas_tid.getId()];
+    const int tid = kcas_tid.getId();
+    auto desc = &kcasDescriptors[tid];
     // sort entries in the kcas descriptor to guarantee progress
     kcasdesc_sort<MAX_K>(desc);
-    DESC_INITIALIZED(kcasDescriptors, kcas_tid.getId());
-    kcastagptr_t tagptr = TAGPTR_NEW(kcas_tid.getId(), desc->seqBits, KCAS_TAGBIT);
+    DESC_INITIALIZED(kcasDescriptors, tid);
+    kcastagptr_t tagptr = TAGPTR_NEW(tid, desc->seqBits, KCAS_TAGBIT);
 
     // perform the kcas and retire the old descriptor
     bool result = help(tagptr, desc, false);
+    cm.onExecute(tid, result);
     return result;
 }
 
@@ -460,7 +693,7 @@ casword_t KCASLockFree<MAX_K>::readPtr(casword_t volatile * addr) {
     casword_t r;
     do {
         r = rdcssRead(addr);
-        if (isKcas(r)) {
+        if (isKcas(r) && cm.shouldHelp(kcas_tid.getId(), addr, r)) {
             helpOther((kcastagptr_t) r);
         }
     } while (isKcas(r));
@@ -472,6 +705,49 @@ casword_t KCASLockFree<MAX_K>::readVal( casword_t volatile * addr) {
     return ((casword_t) readPtr(addr))>>KCAS_LEFTSHIFT;
 }
 
+// like readPtr, but never helps. a word that holds a descriptor gets its logical value from the descriptor: an
+// rdcss is always replacing old2 with a kcas that has not decided yet (or will put old2 back), so the value is
+// old2, and a kcas entry's value is newval if the kcas has succeeded and oldval otherwise. the fields are read
+// optimistically and kept only if the descriptor's sequence number still matches the tagptr afterwards. the kcas
+// state is read after the word, and both values were current at some point in between, which is where the read
+// takes effect
+template <int MAX_K>
+casword_t KCASLockFree<MAX_K>::readPtrNoHelp(casword_t volatile * addr) {
+    while (true) {
+        casword_t r = *addr;
+        if (isRdcss(r)) {
+            rdcssdesc_t * rdcssptr = TAGPTR_UNPACK_PTR(rdcssDescriptors, r);
+            const casword_t val = rdcssptr->old2;
+            __asm__ __volatile__ ("":::"memory");
+            if (UNPACK_SEQ(rdcssptr->seqBits) == UNPACK_SEQ(r)) return val;
+            continue; // the descriptor was reused, so the rdcss is over
+        }
+        if (!isKcas(r)) return r;
+
+        kcasptr_t ptr = TAGPTR_UNPACK_PTR(kcasDescriptors, r);
+        const seqbits_t seqBits = ptr->seqBits;
+        if (UNPACK_SEQ(seqBits) != UNPACK_SEQ(r)) continue;
+        const bool succeeded = (SEQBITS_UNPACK_FIELD(seqBits, KCAS_SEQBITS_MASK_STATE, KCAS_SEQBITS_OFFSET_STATE) == KCAS_STATE_SUCCEEDED);
+        const casword_t n = ptr->numEntries;
+        bool found = false;
+        casword_t val = 0;
+        for (int i = 0; i < (int) (n < MAX_K ? n : MAX_K); i++) {
+            if (ptr->entries[i].addr == addr) {
+                val = succeeded ? ptr->entries[i].newval : ptr->entries[i].oldval;
+                found = true;
+                break;
+            }
+        }
+        __asm__ __volatile__ ("":::"memory");
+        if (found && UNPACK_SEQ(ptr->seqBits) == UNPACK_SEQ(r)) return val;
+    }
+}
+
+template <int MAX_K>
+casword_t KCASLockFree<MAX_K>::readValNoHelp(casword_t volatile * addr) {
+    return ((casword_t) readPtrNoHelp(addr))>>KCAS_LEFTSHIFT;
+}
+
 template <int MAX_K>
 void KCASLockFree<MAX_K>::writeInitPtr(casword_t volatile * addr, casword_t const newval) {
     *addr = newval;
@@ -484,8 +760,10 @@ void KCASLockFree<MAX_K>::writeInitVal(casword_t volatile * addr, casword_t cons
 
 template <int MAX_K>
 void KCASLockFree<MAX_K>::start() {
+    const int tid = kcas_tid.getId();
+    kcasDescriptors.ensure(tid);
     // allocate a new kcas descriptor
-    kcasptr_t ptr = DESC_NEW(kcasDescriptors, KCAS_SEQBITS_NEW, kcas_tid.getId());
+    kcasptr_t ptr = DESC_NEW(kcasDescriptors, KCAS_SEQBITS_NEW, tid);
     ptr->numEntries = 0;
 }
 
@@ -500,6 +778,17 @@ void KCASLockFree<MAX_K>::deinitThread() {
     kcas_tid.explicitRelease();
 }
 
+template <int MAX_K>
+void KCASLockFree<MAX_K>::printContentionStats() {
+    cm.printStats(KCAS_CM::NAME);
+}
+
+// bytes of descriptor storage (the tables and the chunks allocated so far)
+template <int MAX_K>
+size_t KCASLockFree<MAX_K>::getDescriptorBytes() {
+    return kcasDescriptors.getMemoryBytes() + rdcssDescriptors.getMemoryBytes();
+}
+
 template<int MAX_K>
 template<typename T>
 void KCASLockFree<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal) {
@@ -511,3 +800,14 @@ void KCASLockFree<MAX_K>::add(casword<T> * caswordptr, T oldVal, T newVal, Args.
     caswordptr->addToDescriptor(oldVal, newVal);
     add(args...);
 }
+template<int MAX_K>
+template<typename T>
+void KCASLockFree<MAX_K>::addRead(casword<T> * caswordptr, T expected) {
+    caswordptr->addReadToDescriptor(expected);
+}
+template<int MAX_K>
+template<typename T, typename... Args>
+void KCASLockFree<MAX_K>::addRead(casword<T> * caswordptr, T expected, Args... args) {
+    caswordptr->addReadToDescriptor(expected);
+    addRead(args...);
+}
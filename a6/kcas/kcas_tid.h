@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * Thread ids for the kcas engines. A thread registers (takes the lowest free slot) the first time it asks for its
+ * id, and deregisters (gives the slot back) when it exits, or earlier with explicitRelease. A thread that uses kcas
+ * again after explicitRelease registers again. Since slots are reused lowest first, the ids in use stay dense, and
+ * per-thread storage indexed by id (e.g. KCASLockFree's descriptors) only has to cover the largest id ever handed
+ * out (kcas_tid_highWater), not KCAS_MAX_THREADS.
+ *
+ * A thread must not deregister in the middle of a kcas.
+ */
+
+#define KCAS_MAX_THREADS 500
+
+
+void * volatile thread_ids[KCAS_MAX_THREADS] = {};
+volatile int thread_ids_highWater = 0; // 1 + the largest id ever handed out
+
+class TIDGenerator {
+public:
+    int myslot = -1;
+
+    ~TIDGenerator() {
+        explicitRelease();
+    }
+
+    operator int() {
+        return getId();
+    }
+
+    int getId(){
+        if (myslot < 0) acquire();
+        return myslot;
+    }
+
+    void explicitRelease() {
+        if (myslot < 0) return;
+        thread_ids[myslot] = 0;
+        myslot = -1;
+    }
+
+private:
+    void acquire() {
+        while (true) {
+            int i = 0;
+            while (i < KCAS_MAX_THREADS && thread_ids[i]) { ++i; }
+            if (i == KCAS_MAX_THREADS) {
+                fprintf(stderr, "ERROR: more than KCAS_MAX_THREADS=%d threads are using kcas\n", KCAS_MAX_THREADS);
+                exit(-1);
+            }
+            if (__sync_bool_compare_and_swap(&thread_ids[i], 0, this)) {
+                myslot = i;
+                break;
+            }
+        }
+        int hw = thread_ids_highWater;
+        while (hw <= myslot && !__sync_bool_compare_and_swap(&thread_ids_highWater, hw, myslot+1)) {
+            hw = thread_ids_highWater;
+        }
+    }
+};
+
+
+thread_local TIDGenerator kcas_tid;
+
+// 1 + the largest thread id handed out so far
+static int kcas_tid_highWater() {
+    return thread_ids_highWater;
+}
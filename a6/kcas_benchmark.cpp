@@ -0,0 +1,201 @@
+/**
+ * A KCAS microbenchmark for the kcas namespace API: threads repeatedly increment K random words with one K-CAS,
+ * for each K in [1, maxK] (see a5/kcas_benchmark.cpp).
+ *
+ * The engine is chosen at compile time, as for benchmark.cpp: make kcas_benchmark (KCASLockFree),
+ * kcas_benchmark_locked (KCASLocked, with 2^KCAS_LOCK_TABLE_BITS locks) or kcas_benchmark_kplus1 (KCASKPlus1).
+ * Contention is set with -s (fewer words means more K-CASes on the same words) and -n.
+ *
+ * Every successful K-CAS adds K to the sum of the words, which is checked at the end of each K.
+ */
+
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include "defines.h"
+#include "util.h"
+
+#define MAX_KCAS 16
+#include "kcas/kcas.h"
+
+using namespace std;
+
+// one word per cache line, so the K entries of a K-CAS are K different lines
+struct paddedWord {
+    casword<casword_t> v;
+    volatile char padding[PADDING_BYTES - sizeof(casword<casword_t>)];
+};
+
+struct kResult {
+    long long ops;
+    long long successes;
+    int64_t elapsedMillis;
+};
+
+kResult runK(const int K, const int numWords, const int millisToRun, const int totalThreads) {
+    auto words = new paddedWord[numWords];
+    for (int i=0;i<numWords;++i) words[i].v.setInitVal(0);
+
+    PaddedRandom rngs[MAX_THREADS];
+    for (int i=0;i<MAX_THREADS;++i) rngs[i].setSeed(i+1);
+    debugCounter numTotalOps;
+    debugCounter numSuccesses;
+    ElapsedTimer timer;
+    volatile bool done = false;
+    volatile bool start = false;
+    atomic_int running(0);
+
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+            const int OPS_BETWEEN_TIME_CHECKS = 500;
+            int indices[MAX_KCAS];
+
+            // BARRIER WAIT
+            running.fetch_add(1);
+            while (!start) { TRACE TPRINT("waiting to start"<<endl); }
+
+            for (int cnt=0; !done; ++cnt) {
+                if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0
+                        && timer.getElapsedMillis() >= millisToRun)
+                    done = true;
+
+                // K distinct words
+                for (int i=0;i<K;++i) {
+                    bool duplicate;
+                    do {
+                        indices[i] = rngs[tid].nextNatural() % numWords;
+                        duplicate = false;
+                        for (int j=0;j<i;++j) duplicate |= (indices[j] == indices[i]);
+                    } while (duplicate);
+                }
+
+                kcas::start();
+                for (int i=0;i<K;++i) {
+                    casword_t old = words[indices[i]].v;
+                    kcas::add(&words[indices[i]].v, old, old+1);
+                }
+                if (kcas::execute()) numSuccesses.inc(tid);
+                numTotalOps.inc(tid);
+            }
+
+            running.fetch_add(-1);
+        });
+    }
+
+    while (running < totalThreads) {}
+    timer.startTimer();
+    __sync_synchronize();
+    start = true;
+    while (running > 0) {}
+
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+
+    kResult result;
+    result.elapsedMillis = timer.getElapsedMillis();
+    result.ops = numTotalOps.getTotal();
+    result.successes = numSuccesses.getTotal();
+
+    long long sum = 0;
+    for (int i=0;i<numWords;++i) sum += (casword_t) words[i].v;
+    cout<<"K="<<K<<" Validation: sum of words = "<<sum<<" and K * successful kcas = "<<(K * result.successes)<<".";
+    cout<<((sum == K * result.successes) ? " OK." : " FAILED.")<<endl;
+    if (sum != K * result.successes) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+
+    delete[] words;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
+        cout<<"Options:"<<endl;
+        cout<<"    -t [int]     milliseconds to run for each K"<<endl;
+        cout<<"    -s [int]     number of words that K-CASes pick their K words from"<<endl;
+        cout<<"    -n [int]     number of threads"<<endl;
+        cout<<"    -k [int]     largest K to run (K = 1, 2, ..., k; at most "<<MAX_KCAS<<")"<<endl;
+        cout<<endl;
+        cout<<"Example: "<<argv[0]<<" -t 1000 -s 1000000 -n 16 -k 16"<<endl;
+        return 1;
+    }
+
+    int millisToRun = -1;
+    int numWords = 0;
+    int totalThreads = 0;
+    int maxK = MAX_KCAS;
+
+    for (int i=1;i<argc;++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            numWords = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            totalThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            maxK = atoi(argv[++i]);
+        } else {
+            cout<<"bad arguments"<<endl;
+            exit(1);
+        }
+    }
+
+    std::cout<<"Cmd:";
+    for (int i=0;i<argc;++i) {
+        std::cout<<" "<<argv[i];
+    }
+    std::cout<<std::endl;
+
+#ifdef KCAS_KPLUS1
+    const char * kcasEngine = "kplus1";
+#elif defined(KCAS_LOCKED)
+    const char * kcasEngine = "locked";
+#else
+    const char * kcasEngine = "reuse";
+#endif
+    PRINT(kcasEngine);
+#ifdef KCAS_LOCKED
+    PRINT(KCAS_LOCK_TABLE_BITS);
+#endif
+    PRINT(MAX_THREADS);
+    PRINT(totalThreads);
+    PRINT(numWords);
+    PRINT(maxK);
+    PRINT(millisToRun);
+    cout<<endl;
+
+    if (totalThreads >= MAX_THREADS) {
+        std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
+        return 1;
+    }
+    if (maxK < 1 || maxK > MAX_KCAS || numWords < maxK) {
+        cout<<"need 1 <= -k <= "<<MAX_KCAS<<" and -s >= -k"<<endl;
+        return 1;
+    }
+
+    kResult results[MAX_KCAS+1];
+    for (int k=1;k<=maxK;++k) {
+        results[k] = runK(k, numWords, millisToRun, totalThreads);
+    }
+
+    cout<<endl;
+    cout<<"K\tthroughput\tsuccess%"<<endl;
+    for (int k=1;k<=maxK;++k) {
+        cout<<k<<"\t"<<(long long) (results[k].ops * 1000. / results[k].elapsedMillis)
+            <<"\t"<<(100. * results[k].successes / max(1LL, results[k].ops))<<endl;
+    }
+#if !defined(KCAS_KPLUS1) && !defined(KCAS_LOCKED)
+    cout<<endl;
+    cout<<"descriptor bytes="<<kcas::instance.getDescriptorBytes()<<" for "<<kcas_tid_highWater()<<" thread ids"<<endl;
+#endif
+    return 0;
+}
@@ -39,7 +39,8 @@ private:
 public:
     lockfreeblockbag() {
         VERBOSE DEBUG std::cout<<"constructor lockfreeblockbag lockfree="<<head.is_lock_free()<<std::endl;
-        assert(head.is_lock_free());
+        // not asserting head.is_lock_free(): since gcc 7 it is false for every 16-byte atomic, even where
+        // libatomic implements it with cmpxchg16b (and the tag keeps the stack correct either way)
         head.store(tagged_ptr({NULL,0}));
     }
     ~lockfreeblockbag() {
@@ -88,6 +88,7 @@ public:
     PAD;
     const int NUM_PROCESSES;
     const int neutralizeSignal;
+    sigjmp_buf * ownSetjmpbuffers; // setjmpbuffers is shared by every instance (the last one created wins)
     PAD;
     
     inline int getTidInefficient(const pthread_t me) {
@@ -162,7 +163,7 @@ public:
     
     RecoveryMgr(const int numProcesses, const int _neutralizeSignal, MasterRecordMgr * const masterRecordMgr)
             : NUM_PROCESSES(numProcesses) , neutralizeSignal(_neutralizeSignal){
-        setjmpbuffers = new sigjmp_buf[numProcesses];
+        setjmpbuffers = ownSetjmpbuffers = new sigjmp_buf[numProcesses];
         pthread_key_create(&pthreadkey, NULL);
         
         if (MasterRecordMgr::supportsCrashRecovery()) {
@@ -183,7 +184,7 @@ public:
         ___singleton = (void *) masterRecordMgr;
     }
     ~RecoveryMgr() {
-        delete[] setjmpbuffers;
+        delete[] ownSetjmpbuffers;
     }
 };
 
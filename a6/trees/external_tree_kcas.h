@@ -139,7 +139,7 @@ bool ExternalKCAS::insertIfAbsent(const int tid, const int & key) {
         auto n1 = createInternal(std::min(key, (int) ret.n->key), leftChild, rightChild);
 
         kcas::start();
-        kcas::add(&ret.p->marked, false, false);
+        kcas::addRead(&ret.p->marked, false);
 
         auto direction = ret.p->whichParent(ret.n);
         if (direction == LEFT) kcas::add(&ret.p->left, ret.n, n1);
@@ -175,26 +175,26 @@ bool ExternalKCAS::erase(const int tid, const int & key) {
 			kcas::start();
             kcas::add(
                 &ret.n->marked, nMark, true,
-                &ret.p->marked, pMark, true,
-				&ret.gp->marked, false, false
+                &ret.p->marked, pMark, true
             );
+            kcas::addRead(&ret.gp->marked, false);
 	
 	    Node * sib;
             if (gpDir == LEFT) {
                 if (pDir == LEFT) {
 		    		sib = ret.p->right;
-                    kcas::add(
-                        &ret.p->left, ret.n, ret.n,
-                        &ret.gp->left, ret.p, sib,
-						&ret.p->right, sib, sib
+                    kcas::add(&ret.gp->left, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->left, ret.n,
+                        &ret.p->right, sib
                     );
                 }
                 else if (pDir == RIGHT) {
 		    		sib = ret.p->left;
-                    kcas::add(
-                        &ret.p->right, ret.n, ret.n,
-                        &ret.gp->left, ret.p, sib,
-						&ret.p->left, sib, sib
+                    kcas::add(&ret.gp->left, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->right, ret.n,
+                        &ret.p->left, sib
                     );
                 } 
             }
@@ -202,18 +202,18 @@ bool ExternalKCAS::erase(const int tid, const int & key) {
             else if (gpDir == RIGHT) {
                 if (pDir == LEFT) {
 		    		sib = ret.p->right;
-                    kcas::add(
-                        &ret.p->left, ret.n, ret.n,
-                        &ret.gp->right, ret.p, sib,
-						&ret.p->right, sib, sib
+                    kcas::add(&ret.gp->right, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->left, ret.n,
+                        &ret.p->right, sib
                     );
                 }
                 else if (pDir == RIGHT) {
 		    		sib = ret.p->left;
-                    kcas::add(
-                        &ret.p->right, ret.n, ret.n,
-                        &ret.gp->right, ret.p, sib,
-						&ret.p->left, sib, sib
+                    kcas::add(&ret.gp->right, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->right, ret.n,
+                        &ret.p->left, sib
                     );
                 } 
             }
@@ -114,12 +114,13 @@ inline auto ExternalKCASReclaim::search(const int tid, const int & key) {
 }
 
 bool ExternalKCASReclaim::contains(const int tid, const int & key) {
+    auto guard = recmgr->getGuard(tid, true);
     auto rec = search(tid, key);
     return (rec.n->key == key);
 }
 
 bool ExternalKCASReclaim::insertIfAbsent(const int tid, const int & key) {
-    recmgr->getGuard(tid);
+    auto guard = recmgr->getGuard(tid);
     assert(key <= maxKey);
     while (true) {
         auto ret = search(tid, key);
@@ -132,7 +133,7 @@ bool ExternalKCASReclaim::insertIfAbsent(const int tid, const int & key) {
         auto n1 = createInternal(tid, std::min(key, (int) ret.n->key), leftChild, rightChild);
 
         kcas::start();
-        kcas::add(&ret.p->marked, false, false);
+        kcas::addRead(&ret.p->marked, false);
 
         auto direction = ret.p->whichParent(ret.n);
         if (direction == LEFT) kcas::add(&ret.p->left, ret.n, n1);
@@ -152,7 +153,7 @@ bool ExternalKCASReclaim::insertIfAbsent(const int tid, const int & key) {
 }
 
 bool ExternalKCASReclaim::erase(const int tid, const int & key) {
-    recmgr->getGuard(tid);
+    auto guard = recmgr->getGuard(tid);
     assert(key <= maxKey);
     while (true) {
         auto ret = search(tid, key);
@@ -168,26 +169,26 @@ bool ExternalKCASReclaim::erase(const int tid, const int & key) {
 			kcas::start();
             kcas::add(
                 &ret.n->marked, nMark, true,
-                &ret.p->marked, pMark, true,
-				&ret.gp->marked, false, false
+                &ret.p->marked, pMark, true
             );
+            kcas::addRead(&ret.gp->marked, false);
 	
 	    Node * sib;
             if (gpDir == LEFT) {
                 if (pDir == LEFT) {
 		    		sib = ret.p->right;
-                    kcas::add(
-                        &ret.p->left, ret.n, ret.n,
-                        &ret.gp->left, ret.p, sib,
-						&ret.p->right, sib, sib
+                    kcas::add(&ret.gp->left, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->left, ret.n,
+                        &ret.p->right, sib
                     );
                 }
                 else if (pDir == RIGHT) {
 		    		sib = ret.p->left;
-                    kcas::add(
-                        &ret.p->right, ret.n, ret.n,
-                        &ret.gp->left, ret.p, sib,
-						&ret.p->left, sib, sib
+                    kcas::add(&ret.gp->left, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->right, ret.n,
+                        &ret.p->left, sib
                     );
                 } 
             }
@@ -195,18 +196,18 @@ bool ExternalKCASReclaim::erase(const int tid, const int & key) {
             else if (gpDir == RIGHT) {
                 if (pDir == LEFT) {
 		    		sib = ret.p->right;
-                    kcas::add(
-                        &ret.p->left, ret.n, ret.n,
-                        &ret.gp->right, ret.p, sib,
-						&ret.p->right, sib, sib
+                    kcas::add(&ret.gp->right, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->left, ret.n,
+                        &ret.p->right, sib
                     );
                 }
                 else if (pDir == RIGHT) {
 		    		sib = ret.p->left;
-                    kcas::add(
-                        &ret.p->right, ret.n, ret.n,
-                        &ret.gp->right, ret.p, sib,
-						&ret.p->left, sib, sib
+                    kcas::add(&ret.gp->right, ret.p, sib);
+                    kcas::addRead(
+                        &ret.p->right, ret.n,
+                        &ret.p->left, sib
                     );
                 } 
             }